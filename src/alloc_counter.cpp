@@ -0,0 +1,80 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc_counter.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+thread_local bool is_armed = false;
+thread_local uint64_t allocations = 0;
+
+}  // namespace
+
+bool IsCountingAllocations() {
+#ifdef CHIP8_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ArmAllocationCounter() {
+  allocations = 0;
+  is_armed = true;
+}
+
+uint64_t DisarmAllocationCounter() {
+  is_armed = false;
+  return allocations;
+}
+
+AllocationCounterPause::AllocationCounterPause() : was_armed_{is_armed} {
+  is_armed = false;
+}
+
+AllocationCounterPause::~AllocationCounterPause() {
+  is_armed = was_armed_;
+}
+
+#ifdef CHIP8_COUNT_ALLOCATIONS
+namespace {
+
+void* Allocate(std::size_t size) {
+  if (is_armed) ++allocations;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc{};
+}
+
+}  // namespace
+#endif
+
+} // namespace chip8_emu
+
+#ifdef CHIP8_COUNT_ALLOCATIONS
+// The nothrow forms call these; the aligned ones keep the library's own.
+void* operator new(std::size_t size) {
+  return chip8_emu::Allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+  return chip8_emu::Allocate(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  std::free(p);
+}
+#endif
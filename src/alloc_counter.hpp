@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace chip8_emu {
+
+// Counts the global operator new calls of one thread while armed. Only
+// alloc_counter_check.o (make alloc-check) replaces operator new; in the
+// regular build nothing is counted and IsCountingAllocations is false.
+bool IsCountingAllocations();
+void ArmAllocationCounter();  // for the calling thread
+uint64_t DisarmAllocationCounter();  // returns the allocations since arming
+
+// Stops counting on the calling thread while in scope. Debugger commands
+// parse and print text, so they allocate by nature, and they only run when
+// the user types one; they are left out of the check.
+class AllocationCounterPause {
+ public:
+  AllocationCounterPause();
+  ~AllocationCounterPause();
+
+ private:
+  bool was_armed_;
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,35 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "aot.hpp"
+#include "chip8.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+std::vector<const AotTranslation*>& GetRegistry() {
+  static std::vector<const AotTranslation*> registry;
+  return registry;
+}
+
+}  // namespace
+
+void AotInterpret(AotContext& context) {
+  context.chip8->InterpretUntranslated();
+}
+
+bool RegisterAotTranslation(const AotTranslation& translation) {
+  GetRegistry().push_back(&translation);
+  return true;
+}
+
+const AotTranslation* FindAotTranslation(std::string_view sha1) {
+  for (const AotTranslation* translation : GetRegistry()) {
+    if (sha1 == translation->sha1) return translation;
+  }
+  return nullptr;
+}
+
+} // namespace chip8_emu
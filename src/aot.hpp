@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace chip8_emu {
+
+class Chip8;
+
+// Machine state seen by translated code, pointing into one Chip8
+struct AotContext {
+  uint8_t* v;
+  uint16_t* i;
+  uint16_t* pc;
+  uint16_t* stack;
+  uint8_t* sp;
+  const uint8_t* mem;
+  Chip8* chip8;
+};
+
+// Runs one basic block from *pc, which must be one of its entries, and
+// returns with *pc at the next instruction. Every instruction decrements
+// budget, and the block returns early when it reaches 0.
+using AotFunction = void (*)(AotContext& context, uint64_t& budget);
+
+struct AotBlock {
+  uint16_t begin;
+  uint32_t end;  // one past the last byte of its last instruction
+  AotFunction function;
+};
+
+// Instruction address a block can be entered at
+struct AotEntry {
+  uint16_t addr;
+  uint16_t block;  // index into AotTranslation::blocks
+};
+
+// Output of the recompiler (emu -A) for one ROM and quirk profile
+struct AotTranslation {
+  const char* sha1;  // of the ROM
+  uint8_t quirks;    // Quirks::ToBits
+  uint16_t code_begin;  // of the first block
+  uint32_t code_end;    // of the last block
+  const AotBlock* blocks;
+  size_t num_blocks;
+  const AotEntry* entries;
+  size_t num_entries;
+};
+
+// Called by translated code for instructions it leaves to the interpreter.
+// Interprets the instruction at *pc and drops the translated blocks that it
+// writes to.
+void AotInterpret(AotContext& context);
+
+// Translations linked into the binary register themselves before main, and
+// Chip8::LoadROM picks the one matching the ROM.
+bool RegisterAotTranslation(const AotTranslation& translation);
+const AotTranslation* FindAotTranslation(std::string_view sha1);
+
+} // namespace chip8_emu
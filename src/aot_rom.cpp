@@ -0,0 +1,165 @@
+// Translated from /root/repo/test/random_probe.ch8 by emu -A. Do not edit.
+// Quirks: vf_reset,memory_increment,index_overflow,clip
+
+#include <cstdint>
+
+#include "aot.hpp"
+
+namespace {
+
+using chip8_emu::AotContext;
+using chip8_emu::AotInterpret;
+
+void Block_0200(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x0200:  // 00E0
+      *c.pc = 0x0200;
+      AotInterpret(c);
+      if (--budget == 0 || *c.pc != 0x0202) return;
+      [[fallthrough]];
+    case 0x0202:  // 6A00
+      c.v[0xA] = 0x00;
+      *c.pc = 0x0204;
+      --budget;
+      return;
+  }
+}
+
+void Block_0204(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x0204:  // C03F
+      *c.pc = 0x0204;
+      AotInterpret(c);
+      if (--budget == 0 || *c.pc != 0x0206) return;
+      [[fallthrough]];
+    case 0x0206:  // C11F
+      *c.pc = 0x0206;
+      AotInterpret(c);
+      if (--budget == 0 || *c.pc != 0x0208) return;
+      [[fallthrough]];
+    case 0x0208:  // A220
+      *c.i = 0x220;
+      if (--budget == 0) {
+        *c.pc = 0x020A;
+        return;
+      }
+      [[fallthrough]];
+    case 0x020A:  // D011
+      *c.pc = 0x020A;
+      AotInterpret(c);
+      if (--budget == 0 || *c.pc != 0x020C) return;
+      [[fallthrough]];
+    case 0x020C:  // 6205
+      c.v[0x2] = 0x05;
+      if (--budget == 0) {
+        *c.pc = 0x020E;
+        return;
+      }
+      [[fallthrough]];
+    case 0x020E:  // F215
+      *c.pc = 0x020E;
+      AotInterpret(c);
+      --budget;
+      return;
+  }
+}
+
+void Block_0210(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x0210:  // F207
+      *c.pc = 0x0210;
+      AotInterpret(c);
+      if (--budget == 0 || *c.pc != 0x0212) return;
+      [[fallthrough]];
+    case 0x0212:  // 3200
+      *c.pc = c.v[0x2] == 0x00 ? 0x0216 : 0x0214;
+      --budget;
+      return;
+  }
+}
+
+void Block_0214(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x0214:  // 1210
+      *c.pc = 0x0210;
+      --budget;
+      return;
+  }
+}
+
+void Block_0216(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x0216:  // 7A01
+      c.v[0xA] += 0x01;
+      if (--budget == 0) {
+        *c.pc = 0x0218;
+        return;
+      }
+      [[fallthrough]];
+    case 0x0218:  // 3A40
+      *c.pc = c.v[0xA] == 0x40 ? 0x021C : 0x021A;
+      --budget;
+      return;
+  }
+}
+
+void Block_021A(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x021A:  // 1204
+      *c.pc = 0x0204;
+      --budget;
+      return;
+  }
+}
+
+void Block_021C(AotContext& c, uint64_t& budget) {
+  switch (*c.pc) {
+    case 0x021C:  // 121C
+      *c.pc = 0x021C;
+      --budget;
+      return;
+  }
+}
+
+const chip8_emu::AotBlock kBlocks[] = {
+  {0x0200, 0x0204, &Block_0200},
+  {0x0204, 0x0210, &Block_0204},
+  {0x0210, 0x0214, &Block_0210},
+  {0x0214, 0x0216, &Block_0214},
+  {0x0216, 0x021A, &Block_0216},
+  {0x021A, 0x021C, &Block_021A},
+  {0x021C, 0x021E, &Block_021C},
+};
+
+const chip8_emu::AotEntry kEntries[] = {
+  {0x0200, 0},
+  {0x0202, 0},
+  {0x0204, 1},
+  {0x0206, 1},
+  {0x0208, 1},
+  {0x020A, 1},
+  {0x020C, 1},
+  {0x020E, 1},
+  {0x0210, 2},
+  {0x0212, 2},
+  {0x0214, 3},
+  {0x0216, 4},
+  {0x0218, 4},
+  {0x021A, 5},
+  {0x021C, 6},
+};
+
+const chip8_emu::AotTranslation kTranslation{
+  "1aa1a1163568a961515ed2d2a0c907d60dd9765c",
+  0x17,
+  0x0200,
+  0x021E,
+  kBlocks,
+  sizeof(kBlocks) / sizeof(kBlocks[0]),
+  kEntries,
+  sizeof(kEntries) / sizeof(kEntries[0]),
+};
+
+[[maybe_unused]] const bool kRegistered = chip8_emu::RegisterAotTranslation(kTranslation);
+
+}  // namespace
@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+
+#include "bench.hpp"
+#include "chip8.hpp"
+#include "config.hpp"
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+const std::string kBenchTracePath{"bench_trace.c8t"};
+
+struct BenchResult {
+  std::string quirks;
+  std::string policy;
+  double seconds;
+};
+
+} // namespace
+
+void RunBenchmark(const std::string& rom, uint64_t instructions, int cycles) {
+  const std::pair<const char*, Quirks> quirk_profiles[] = {
+    {"chip8", kChip8Quirks},
+    {"vip", kVipQuirks},
+    {"schip", kSchipQuirks},
+    {"xochip", kXoChipQuirks},
+  };
+  const std::pair<const char*, Policy> policies[] = {
+    {"plain", {Trace::kNone, false, Display::kHeadless, TimerSource::kEmulated}},
+    {"profile", {Trace::kNone, true, Display::kHeadless, TimerSource::kEmulated}},
+    {"binary", {Trace::kBinary, false, Display::kHeadless, TimerSource::kEmulated}},
+    {"text", {Trace::kText, false, Display::kHeadless, TimerSource::kEmulated}},
+  };
+
+  std::vector<BenchResult> results;
+  for (const auto& [quirks_name, quirks] : quirk_profiles) {
+    for (const auto& [policy_name, policy] : policies) {
+      auto chip8 = std::make_unique<Chip8>(cycles);
+      chip8->LoadROM(rom);
+      chip8->SetQuirks(quirks);
+      chip8->SetPolicy(policy);
+      chip8->SetInstructionLimit(instructions);
+      if (policy.trace == Trace::kBinary && !chip8->OpenTrace(kBenchTracePath)) return;
+
+      const auto start_time = std::chrono::steady_clock::now();
+      chip8->Run();
+      const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+      results.push_back({quirks_name, policy_name, elapsed.count()});
+    }
+  }
+
+  std::filesystem::remove(kBenchTracePath);
+
+  fprintf(stderr, "%-8s %-8s %10s %10s %8s\n", "quirks", "policy", "time [s]", "MIPS", "cost");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& base = results[i - i % std::size(policies)];  // plain policy of the same quirks
+    fprintf(stderr, "%-8s %-8s %10.3f %10.2f %7.2fx\n", results[i].quirks.c_str(), results[i].policy.c_str(),
+      results[i].seconds, instructions / results[i].seconds / 1e6, results[i].seconds / base.seconds);
+  }
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace chip8_emu {
+
+// Runs the ROM headless for the given number of instructions under each
+// quirk profile and policy, and prints the achieved instruction rates to
+// stderr. Text trace output goes to stdout, so redirect it to /dev/null.
+void RunBenchmark(const std::string& rom, uint64_t instructions, int cycles);
+
+} // namespace chip8_emu
@@ -1,4 +1,7 @@
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -7,147 +10,1139 @@
 #include <chrono>
 #include <random>
 #include <filesystem>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include <bit>
+#include <optional>
 
+#include <fcntl.h>
+#include <unistd.h>
 #include <SDL2/SDL.h>
 
 #include "chip8.hpp"
+#include "alloc_counter.hpp"
 #include "utils.hpp"
 #include "graphic.hpp"
 #include "delay_timer.hpp"
 #include "sound_timer.hpp"
+#include "quirks.hpp"
+#include "rom_database.hpp"
+#include "debugger.hpp"
+#include "core.hpp"
 
 namespace chip8_emu {
 
-Chip8::Chip8(bool debug_mode)
+Chip8::Chip8(int cycles)
     : mem_{},
+      mem_hash_{0},
+      reset_mem_hash_{0},
       stack_{},
       v_{},
+      rpl_{},
       i_{0},
       pc_{0x200},
       sp_{0},
-      debug_mode_{debug_mode},
+      cycles_{cycles},
+      quirks_{kChip8Quirks},
+      policy_{kDefaultPolicy},
+      instruction_limit_{UINT64_MAX},
       drawable_{false},
       is_sleeping_{false},
-      is_running_{false},
+      is_running_{true},
       exit_success_{true},
+      fault_{Fault::kNone},
+      fault_inst_{0},
+      input_log_{},
+      next_key_event_{0},
+      coverage_map_{nullptr},
+      memory_limit_{kMemorySize},
+      previous_location_{0},
+      previous_kind_{0},
+      cycle_{0},
+      trace_writer_{},
+      video_writer_{},
+      shared_state_{},
+      run_ahead_frames_{0},
+      run_ahead_snapshot_{},
+      speed_index_{kNormalSpeed},
+      speed_credit_{0},
+      translation_{nullptr},
+      translated_{},
+      aot_context_{v_.data(), &i_, &pc_, stack_.data(), &sp_, mem_.data(), this},
+      core_{},
+      profile_counts_{},
+      profile_run_time_{0},
+      profile_render_time_{0},
+      profile_cpu_seconds_{0},
+      metrics_{},
+      has_metrics_overlay_{false},
+      rom_path_{},
+      rom_buffer_{},
+      rom_watcher_{},
       rand_{std::make_unique<Rand>()},
-      graphic_{std::make_shared<Graphic>()},
+      graphic_{std::make_unique<Graphic>()},
       delay_timer_{std::make_unique<DelayTimer>(is_sleeping_)},
       sound_timer_{std::make_unique<SoundTimer>(is_sleeping_)},
-      input_{std::make_unique<Input>(graphic_)} {
-  std::copy(kSprites.begin(), kSprites.end(), mem_.begin());
+      input_{std::make_unique<Input>(*graphic_)},
+      debugger_{} {
+  Reset();
+}
+
+Chip8::~Chip8() = default;
+
+const char* FaultToString(Fault fault) {
+  switch (fault) {
+    case Fault::kNone:
+      return "none";
+    case Fault::kInvalidInstruction:
+      return "invalid_instruction";
+    case Fault::kStackOverflow:
+      return "stack_overflow";
+    case Fault::kStackUnderflow:
+      return "stack_underflow";
+    case Fault::kMemoryOutOfBounds:
+      return "memory_out_of_bounds";
+  }
+  return "unknown";
+}
+
+void Chip8::Reset() {
+  mem_.fill(0);
+  std::copy(kSprites.begin(), kSprites.end(), mem_.begin() + kSpritesAddress);
+  std::copy(kBigSprites.begin(), kBigSprites.end(), mem_.begin() + kBigSpritesAddress);
+  // Memory is the same after every reset, so it is hashed only once
+  if (reset_mem_hash_ == 0) {
+    RehashMemory();
+    reset_mem_hash_ = mem_hash_;
+  }
+  mem_hash_ = reset_mem_hash_;
+
+  stack_.fill(0);
+  v_.fill(0);
+  rpl_.fill(0);
+  i_ = 0;
+  pc_ = 0x200;
+  sp_ = 0;
+  drawable_ = false;
+  is_running_ = true;
+  exit_success_ = true;
+  fault_ = Fault::kNone;
+  fault_inst_ = 0;
+  next_key_event_ = 0;
+  previous_location_ = 0;
+  previous_kind_ = 0;
+  cycle_ = 0;
+  translation_ = nullptr;
+  translated_.clear();
+
+  FrameBuffer& frame_buffer = graphic_->GetBuffer();
+  frame_buffer.SetHighResolution(false);
+  frame_buffer.SelectPlanes(0xF);
+  frame_buffer.Clear();
+  frame_buffer.SelectPlanes(0x1);
+  delay_timer_->SetRegisterValue(0);
+  sound_timer_->Reset();
+  for (uint8_t key = 0; key < 16; ++key) input_->SetKey(key, false);
+}
+
+void Chip8::LoadProgram(const std::vector<uint8_t>& program) {
+  for (size_t k = 0; k < program.size(); ++k) {
+    WriteMemory(0x200 + k, program[k]);
+  }
 }
 
 void Chip8::LoadROM(const std::string& rom) {
+  auto data = ReadROM(rom);
+  if (!data) std::exit(EXIT_FAILURE);
+  rom_path_ = rom;
+  LoadProgram(*data);
+  std::cout << "Loaded ROM" << std::endl;
+
+  const std::string sha1 = Sha1(*data);
+  std::cout << "ROM SHA-1: " << sha1 << std::endl;
+  if (auto quirks = LookUpQuirks(sha1)) {
+    SetQuirks(*quirks);
+  }
+  FindTranslation(sha1);
+  if (translation_) {
+    std::cout << "AOT translation: " << translation_->num_blocks << " blocks for quirks "
+      << QuirksToString(Quirks::FromBits(translation_->quirks)) << std::endl;
+  }
+
+  // Room for any ROM and translation, so that reloads do not allocate in the
+  // run loop. Reserved pages are not touched until a reload needs them.
+  rom_buffer_.reserve(kMemorySize - 0x200 + 1);
+  translated_.reserve(kMemorySize);
+}
+
+bool Chip8::ReloadROM() {
+  // The run loop is compiled for the quirks, so they stay as they are
+  const int fd = open(rom_path_.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Failed to open ROM: " << rom_path_ << std::endl;
+    return false;
+  }
+  // One byte more than fits tells a ROM that is too large
+  rom_buffer_.resize(rom_buffer_.capacity());
+  size_t size = 0;
+  ssize_t length = 0;
+  while (size < rom_buffer_.size() && (length = read(fd, rom_buffer_.data() + size, rom_buffer_.size() - size)) > 0) {
+    size += length;
+  }
+  close(fd);
+  rom_buffer_.resize(size);
+  if (length < 0 || 0x200 + size > kMemorySize) {
+    std::cerr << (length < 0 ? "Failed to read ROM: " : "ROM size is too large: ") << rom_path_ << std::endl;
+    return false;
+  }
+
+  Reset();
+  LoadProgram(rom_buffer_);
+  Sha1Digest sha1;
+  Sha1(rom_buffer_, sha1);
+  FindTranslation({sha1.data(), sha1.size()});
+  drawable_ = true;
+  return true;
+}
+
+bool Chip8::WatchROM() {
+  rom_watcher_ = std::make_unique<RomWatcher>();
+  return rom_watcher_->Open(rom_path_);
+}
+
+std::optional<std::vector<uint8_t>> Chip8::ReadROM(const std::string& rom) {
   namespace fs = std::filesystem;
   if (!fs::is_regular_file(rom)) {
     std::cerr << fs::weakly_canonical(fs::absolute(rom)) << " is not a regular file" << std::endl;
-    std::exit(EXIT_FAILURE);
+    return std::nullopt;
   }
   std::ifstream ifs{rom, std::ios::binary | std::ios::in};
   if (!ifs.is_open()) {
     std::cerr << "Failed to open ROM: " << fs::weakly_canonical(fs::absolute(rom)) << std::endl;
-    std::exit(EXIT_FAILURE);
+    return std::nullopt;
   }
 
-  char data;
-  for (uint16_t i = 0x200; ifs.get(data); ++i) {
-    if (i >= 4096) {
-      std::cerr << "ROM size is too large" << std::endl;
-      std::exit(EXIT_FAILURE);
+  std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  if (0x200 + data.size() > kMemorySize) {
+    std::cerr << "ROM size is too large" << std::endl;
+    return std::nullopt;
+  }
+  return data;
+}
+
+void Chip8::FindTranslation(std::string_view sha1) {
+  translation_ = FindAotTranslation(sha1);
+  if (translation_) {
+    uint16_t last = 0;
+    for (size_t k = 0; k < translation_->num_entries; ++k) last = std::max(last, translation_->entries[k].addr);
+    translated_.assign(last + 1, nullptr);
+    for (size_t k = 0; k < translation_->num_entries; ++k) {
+      const AotEntry& entry = translation_->entries[k];
+      translated_[entry.addr] = translation_->blocks[entry.block].function;
     }
-    mem_[i] = static_cast<uint8_t>(data);
   }
-  std::cout << "Loaded ROM" << std::endl;
 }
 
-void Chip8::InitializeWindow(int window_scale) {
-  graphic_->InitializeWindow(window_scale);
+template <size_t kPolicyIndex, size_t... kBits>
+constexpr Chip8::RunLoopTable Chip8::MakeRunLoopTable(std::index_sequence<kBits...>) {
+  return {&Chip8::RunLoop<Config{Quirks::FromBits(kBits), kPolicies[kPolicyIndex]}>...};
+}
+
+template <size_t... kPolicyIndices>
+constexpr std::array<Chip8::RunLoopTable, sizeof...(kPolicyIndices)> Chip8::MakeRunLoopTables(
+    std::index_sequence<kPolicyIndices...>) {
+  return {MakeRunLoopTable<kPolicyIndices>(std::make_index_sequence<1 << kNumQuirks>{})...};
+}
+
+void Chip8::SetQuirks(const Quirks& quirks) {
+  quirks_ = quirks;
+  std::cout << "Quirks: " << QuirksToString(quirks) << std::endl;
+}
+
+void Chip8::SetPolicy(const Policy& policy) {
+  assert(FindPolicy(policy) < kPolicies.size());
+  policy_ = policy;
+}
+
+void Chip8::SetCycles(int cycles) {
+  cycles_ = cycles;
+}
+
+void Chip8::SetInstructionLimit(uint64_t limit) {
+  instruction_limit_ = limit;
+}
+
+void Chip8::SetInputLog(const std::vector<KeyEvent>& input_log) {
+  input_log_ = input_log;
+  next_key_event_ = 0;
+}
+
+bool Chip8::OpenTrace(const std::string& path) {
+  trace_writer_ = std::make_unique<TraceWriter>();
+  return trace_writer_->Open(path);
+}
+
+bool Chip8::OpenVideo(const std::string& path) {
+  video_writer_ = std::make_unique<VideoWriter>();
+  return video_writer_->Open(path, graphic_->GetPalette());
+}
+
+bool Chip8::OpenSharedState(const std::string& name) {
+  shared_state_ = std::make_unique<SharedState>();
+  return shared_state_->Open(name);
+}
+
+void Chip8::SetRunAhead(int frames) {
+  run_ahead_frames_ = frames;
+  if (frames > 0 && !run_ahead_snapshot_) run_ahead_snapshot_ = std::make_unique<Snapshot>();
+}
+
+bool Chip8::EnableMetrics(bool overlay, const std::string& stats_path) {
+  metrics_ = std::make_unique<Metrics>();
+  if (!stats_path.empty() && !metrics_->StartStatsFile(stats_path)) return false;
+  has_metrics_overlay_ = overlay;
+  if (overlay) graphic_->SetOverlay(metrics_->GetOverlay());
+  delay_timer_->SetDriftHistogram(&metrics_->Get(HistogramId::kTimerDrift));
+  sound_timer_->SetMetrics(metrics_.get());
+  return true;
+}
+
+bool Chip8::EnableDebugger(const DebuggerOptions& options) {
+  debugger_ = std::make_unique<Debugger>(*this, options);
+  return debugger_->Start();
+}
+
+void Chip8::InitializeWindow(int window_scale, UpscaleFilter filter) {
+  graphic_->InitializeWindow(window_scale, filter);
+}
+
+bool Chip8::InitializeTerminal(TerminalCells cells) {
+  // Terminal sessions are often remote, without an audio device to open
+  sound_timer_->DisableSound();
+  if (!input_->UseTerminal()) return false;
+  graphic_->InitializeTerminal(cells);
+  return true;
+}
+
+void Chip8::SetSeed(uint32_t seed) {
+  rand_->Seed(seed);
+}
+
+void Chip8::SetKey(uint8_t key, bool pressed) {
+  input_->SetKey(key, pressed);
+}
+
+uint64_t Chip8::BeginFrame(uint64_t frame) {
+  StepTimers();
+  return GetFrameBudget(frame);
+}
+
+template <Policy kPolicy>
+void Chip8::StepWith() {
+  using StepFunc = void (Chip8::*)();
+  static constexpr auto kSteps = []<size_t... kBits>(std::index_sequence<kBits...>) {
+    return std::array<StepFunc, 1 << kNumQuirks>{&Chip8::Tick<Config{Quirks::FromBits(kBits), kPolicy}>...};
+  }(std::make_index_sequence<1 << kNumQuirks>{});
+  (this->*kSteps[quirks_.ToBits()])();
+}
+
+void Chip8::Step() {
+  StepWith<kHeadlessPolicy>();
+}
+
+void Chip8::StepTranslated() {
+  if (!HasTranslation()) {
+    Step();
+  } else if (pc_ < translated_.size() && translated_[pc_]) {
+    uint64_t budget = 1;
+    translated_[pc_](aot_context_, budget);
+  } else {
+    InterpretUntranslated();
+  }
+}
+
+bool Chip8::HasTranslation() const {
+  return translation_ && translation_->quirks == quirks_.ToBits();
+}
+
+void Chip8::StepCore() {
+  if (!core_) core_ = std::make_unique<CoreState>();
+  CoreState& core = *core_;
+  FrameBuffer& frame_buffer = graphic_->GetBuffer();
+  std::copy(mem_.begin(), mem_.begin() + kLegacyMemorySize, core.mem.begin());
+  for (int y = 0; y < kHighResHeight; ++y) core.display[y] = frame_buffer.GetRow(0, y);
+  core.stack = stack_;
+  core.v = v_;
+  core.rpl = rpl_;
+  core.i = i_;
+  core.pc = pc_;
+  core.keys = 0;
+  for (uint8_t k = 0; k < 16; ++k) core.keys |= input_->GetKey(k) << k;
+  core.fault_inst = fault_inst_;
+  core.sp = sp_;
+  core.delay_timer = delay_timer_->GetRegisterValue();
+  core.sound_timer = sound_timer_->GetRegisterValue();
+  core.high_resolution = frame_buffer.IsHighResolution();
+  core.is_running = is_running_;
+  core.fault = fault_;
+
+  const MemoryAccess access = GetMemoryAccess(GetNextInstruction());  // before I moves
+  chip8_emu::StepCore(core, quirks_, *rand_);
+
+  if (access.write) {
+    for (uint32_t addr = access.begin; addr < access.end; ++addr) {
+      const uint16_t legacy_addr = addr & (kLegacyMemorySize - 1);  // the core wraps at 4 KB
+      if (core.mem[legacy_addr] != mem_[legacy_addr]) WriteMemory(legacy_addr, core.mem[legacy_addr]);
+    }
+  }
+  if (core.high_resolution != frame_buffer.IsHighResolution()) frame_buffer.SetHighResolution(core.high_resolution);
+  for (int y = 0; y < kHighResHeight; ++y) {
+    if (core.display[y] != frame_buffer.GetRow(0, y)) frame_buffer.SetRow(0, y, core.display[y]);
+  }
+  stack_ = core.stack;
+  v_ = core.v;
+  rpl_ = core.rpl;
+  i_ = core.i;
+  pc_ = core.pc;
+  sp_ = core.sp;
+  delay_timer_->SetRegisterValue(core.delay_timer);
+  sound_timer_->SetRegisterValue(core.sound_timer);
+  if (core.fault != fault_) {
+    RaiseFault(core.fault, core.fault_inst);
+  } else if (!core.is_running) {
+    is_running_ = false;
+  }
+}
+
+uint64_t Chip8::RunTranslated(uint64_t budget) {
+  const uint64_t initial_budget = budget;
+  while (budget > 0 && is_running_) {
+    if (pc_ < translated_.size() && translated_[pc_]) {
+      translated_[pc_](aot_context_, budget);
+    } else {
+      InterpretUntranslated();
+      --budget;
+    }
+  }
+  return initial_budget - budget;
+}
+
+void Chip8::InterpretUntranslated() {
+  const MemoryAccess access = GetMemoryAccess(GetNextInstruction());  // before I moves
+  Step();
+  if (access.write) InvalidateTranslation(access.begin, access.end);
+}
+
+void Chip8::InvalidateTranslation(uint32_t begin, uint32_t end) {
+  // Self-modifying code: blocks written to are interpreted from now on
+  if (end <= translation_->code_begin || begin >= translation_->code_end) return;
+  for (size_t k = 0; k < translation_->num_entries; ++k) {
+    const AotEntry& entry = translation_->entries[k];
+    const AotBlock& block = translation_->blocks[entry.block];
+    if (block.begin < end && begin < block.end) translated_[entry.addr] = nullptr;
+  }
+}
+
+void Chip8::StepWithCoverage() {
+  StepWith<kCoveragePolicy>();
+}
+
+void Chip8::SetCoverage(uint8_t* coverage_map, uint32_t memory_limit) {
+  coverage_map_ = coverage_map;
+  memory_limit_ = memory_limit;
+}
+
+bool Chip8::IsRunning() const {
+  return is_running_;
+}
+
+Fault Chip8::GetFault() const {
+  return fault_;
+}
+
+uint16_t Chip8::GetPc() const {
+  return pc_;
+}
+
+uint16_t Chip8::GetNextInstruction() const {
+  return (mem_[pc_] << 8) | mem_[static_cast<uint16_t>(pc_ + 1)];
+}
+
+void Chip8::SaveSnapshot(Snapshot& snapshot) const {
+  snapshot.mem = mem_;
+  snapshot.mem_hash = mem_hash_;
+  snapshot.stack = stack_;
+  snapshot.v = v_;
+  snapshot.rpl = rpl_;
+  snapshot.i = i_;
+  snapshot.pc = pc_;
+  snapshot.sp = sp_;
+  snapshot.delay_timer = delay_timer_->GetRegisterValue();
+  snapshot.sound_timer = sound_timer_->GetRegisterValue();
+  snapshot.drawable = drawable_;
+  snapshot.is_running = is_running_;
+  snapshot.exit_success = exit_success_;
+  snapshot.fault = fault_;
+  snapshot.fault_inst = fault_inst_;
+  snapshot.frame_buffer = graphic_->GetBuffer();
+  snapshot.rand = rand_->GetGenerator();
+}
+
+void Chip8::LoadSnapshot(const Snapshot& snapshot) {
+  mem_ = snapshot.mem;
+  mem_hash_ = snapshot.mem_hash;
+  stack_ = snapshot.stack;
+  v_ = snapshot.v;
+  rpl_ = snapshot.rpl;
+  i_ = snapshot.i;
+  pc_ = snapshot.pc;
+  sp_ = snapshot.sp;
+  delay_timer_->SetRegisterValue(snapshot.delay_timer);
+  sound_timer_->SetRegisterValue(snapshot.sound_timer);
+  drawable_ = snapshot.drawable;
+  is_running_ = snapshot.is_running;
+  exit_success_ = snapshot.exit_success;
+  fault_ = snapshot.fault;
+  fault_inst_ = snapshot.fault_inst;
+  graphic_->GetBuffer() = snapshot.frame_buffer;
+  rand_->SetGenerator(snapshot.rand);
+}
+
+const FrameBuffer& Chip8::GetFrameBuffer() const {
+  return graphic_->GetBuffer();
+}
+
+uint64_t Chip8::GetStateHash() const {
+  uint64_t hash = Mix64(mem_hash_ ^ graphic_->GetBuffer().GetHash());
+  const auto combine = [&hash](uint64_t value) { hash = Mix64(hash ^ value); };
+  for (size_t k = 0; k < v_.size(); k += 8) {
+    uint64_t v, rpl;
+    std::memcpy(&v, &v_[k], 8);
+    std::memcpy(&rpl, &rpl_[k], 8);
+    combine(v);
+    combine(rpl);
+  }
+  for (size_t k = 0; k < stack_.size(); k += 4) {
+    uint64_t entries;
+    std::memcpy(&entries, &stack_[k], 8);
+    combine(entries);
+  }
+  combine(static_cast<uint64_t>(i_) | static_cast<uint64_t>(pc_) << 16 | static_cast<uint64_t>(sp_) << 32 |
+          static_cast<uint64_t>(delay_timer_->GetRegisterValue()) << 40 |
+          static_cast<uint64_t>(sound_timer_->GetRegisterValue()) << 48);
+  return hash;
+}
+
+void Chip8::PrintStateDiff(const Chip8& other) const {
+  constexpr int kMaxLines = 8;  // per memory and display
+  const auto print_register = [](const char* name, unsigned a, unsigned b) {
+    if (a != b) printf("  %-6s 0x%04X != 0x%04X\n", name, a, b);
+  };
+  print_register("pc", pc_, other.pc_);
+  print_register("i", i_, other.i_);
+  print_register("sp", sp_, other.sp_);
+  print_register("dt", delay_timer_->GetRegisterValue(), other.delay_timer_->GetRegisterValue());
+  print_register("st", sound_timer_->GetRegisterValue(), other.sound_timer_->GetRegisterValue());
+  for (size_t k = 0; k < v_.size(); ++k) {
+    const std::string name = "v" + std::to_string(k);
+    print_register(name.c_str(), v_[k], other.v_[k]);
+  }
+  for (size_t k = 0; k < stack_.size(); ++k) {
+    const std::string name = "stack" + std::to_string(k);
+    print_register(name.c_str(), stack_[k], other.stack_[k]);
+  }
+  for (size_t k = 0; k < rpl_.size(); ++k) {
+    const std::string name = "rpl" + std::to_string(k);
+    print_register(name.c_str(), rpl_[k], other.rpl_[k]);
+  }
+
+  int lines = 0;
+  for (uint32_t addr = 0; addr < kMemorySize && lines < kMaxLines; ++addr) {
+    if (mem_[addr] == other.mem_[addr]) continue;
+    printf("  mem[0x%04X] 0x%02X != 0x%02X\n", addr, mem_[addr], other.mem_[addr]);
+    ++lines;
+  }
+
+  const FrameBuffer& frame_buffer = graphic_->GetBuffer();
+  const FrameBuffer& other_frame_buffer = other.graphic_->GetBuffer();
+  if (frame_buffer.IsHighResolution() != other_frame_buffer.IsHighResolution()) {
+    printf("  resolution %s != %s\n", frame_buffer.IsHighResolution() ? "high" : "low",
+      other_frame_buffer.IsHighResolution() ? "high" : "low");
+  }
+  print_register("planes", frame_buffer.GetSelectedPlanes(), other_frame_buffer.GetSelectedPlanes());
+  lines = 0;
+  for (int p = 0; p < kNumPlanes; ++p) {
+    for (int y = 0; y < kHighResHeight && lines < kMaxLines; ++y) {
+      const FrameBuffer::Row& row = frame_buffer.GetRow(p, y);
+      const FrameBuffer::Row& other_row = other_frame_buffer.GetRow(p, y);
+      if (row == other_row) continue;
+      printf("  plane %d row %2d %016llX%016llX != %016llX%016llX\n", p, y,
+        static_cast<unsigned long long>(row[0]), static_cast<unsigned long long>(row[1]),
+        static_cast<unsigned long long>(other_row[0]), static_cast<unsigned long long>(other_row[1]));
+      ++lines;
+    }
+  }
+}
+
+void Chip8::WriteMemory(uint16_t addr, uint8_t value) {
+  mem_hash_ ^= Mix64(static_cast<uint64_t>(addr) << 8 | mem_[addr]);
+  mem_[addr] = value;
+  mem_hash_ ^= Mix64(static_cast<uint64_t>(addr) << 8 | value);
+}
+
+void Chip8::RehashMemory() {
+  mem_hash_ = 0;
+  for (uint32_t addr = 0; addr < kMemorySize; ++addr) {
+    mem_hash_ ^= Mix64(addr << 8 | mem_[addr]);
+  }
+}
+
+void Chip8::StepTimers() {
+  delay_timer_->DecrementTimerValue();
+  sound_timer_->DecrementTimerValue();
+}
+
+void Chip8::SetSleeping(bool sleeping) {
+  is_sleeping_ = sleeping;
+  delay_timer_->Wake();
+  sound_timer_->Wake();
+}
+
+bool Chip8::IsBlockedOnKey() {
+  // Fx0A re-executes until a key is down. Nothing else changes meanwhile once
+  // the timers have run out, unless a video records every frame.
+  if ((GetNextInstruction() & 0xF0FF) != 0xF00A || video_writer_) return false;
+  for (uint8_t k = 0; k < 16; ++k) {
+    if (input_->GetKey(k)) return false;
+  }
+  return delay_timer_->GetRegisterValue() == 0 && sound_timer_->GetRegisterValue() == 0;
+}
+
+void Chip8::ChangeSpeed(size_t speed_index) {
+  speed_index_ = speed_index;
+  speed_credit_ = 0;
+  const int speed = kSpeedPercents[speed_index_];
+  // The sound timer counts emulated frames, so beeps keep their pitch and
+  // stretch or shrink with emulated time. Fast beeps are muted.
+  sound_timer_->SetMuted(speed == kUnlimitedSpeed || speed > kMaxAudibleSpeed);
+  if (speed == kUnlimitedSpeed) {
+    std::cout << "Speed: unlimited" << std::endl;
+  } else {
+    std::cout << "Speed: " << speed / 100.0 << "x" << std::endl;
+  }
+}
+
+uint64_t Chip8::GetFrameBudget(uint64_t frame) const {
+  // Spread cycles_ instructions evenly over kFrameRate frames
+  return cycles_ * (frame + 1) / kFrameRate - cycles_ * frame / kFrameRate;
+}
+
+void Chip8::RaiseFault(Fault fault, uint16_t inst) {
+  fault_ = fault;
+  fault_inst_ = inst;
+  is_running_ = false;
+  exit_success_ = false;
+}
+
+void Chip8::PublishSharedState(uint64_t frame) {
+  SharedStateLayout& state = shared_state_->BeginPublish();
+  state.frame = frame;
+  state.high_resolution = graphic_->GetBuffer().IsHighResolution();
+  state.sp = sp_;
+  state.delay_timer = delay_timer_->GetRegisterValue();
+  state.sound_timer = sound_timer_->GetRegisterValue();
+  state.i = i_;
+  state.pc = pc_;
+  state.v = v_;
+  state.stack = stack_;
+  for (int p = 0; p < kNumPlanes; ++p) {
+    for (int y = 0; y < kHighResHeight; ++y) state.planes[p][y] = graphic_->GetBuffer().GetRow(p, y);
+  }
+  shared_state_->EndPublish();
+  input_->SetExternalKeys(shared_state_->GetKeys());
+}
+
+void Chip8::PrintFault() const {
+  if (fault_ == Fault::kInvalidInstruction) {
+    std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << fault_inst_ << std::endl;
+  } else {
+    std::cerr << "Fault " << FaultToString(fault_) << " at pc=0x" << std::uppercase << std::hex << pc_
+              << ", inst=0x" << fault_inst_ << std::endl;
+  }
+}
+
+uint16_t GetOpcodeKind(uint16_t inst) {
+  switch (inst >> 12) {
+    case 0x0:
+      return (inst & 0xFFF0) == 0x00C0 || (inst & 0xFFF0) == 0x00D0 ? inst & 0xFFF0 : inst;
+    case 0x5:
+    case 0x8:
+      return inst & 0xF00F;
+    case 0xE:
+    case 0xF:
+      return inst == 0xF000 ? inst : inst & 0xF0FF;
+    default:
+      return inst & 0xF000;
+  }
+}
+
+void Chip8::RecordCoverage(uint16_t inst) {
+  // pc edges as in AFL: the previous location is shifted so that A->B and B->A differ
+  const uint16_t location = Mix64(pc_) & (kCoverageMapSize - 1);
+  ++coverage_map_[location ^ previous_location_];
+  previous_location_ = location >> 1;
+  // Opcode edges: which kind of instruction follows which
+  const uint16_t kind = GetOpcodeKind(inst);
+  ++coverage_map_[Mix64(static_cast<uint64_t>(previous_kind_) << 16 | kind | 1ULL << 32) & (kCoverageMapSize - 1)];
+  previous_kind_ = kind;
+}
+
+Chip8::MemoryAccess Chip8::GetMemoryAccess(uint16_t inst) const {
+  const uint32_t x = (inst & 0x0F00) >> 8;
+  const uint32_t y = (inst & 0x00F0) >> 4;
+  switch (inst & 0xF000) {
+    case 0x5000:
+      if ((inst & 0x000F) == 0x0002) return {i_, i_ + (x > y ? x - y : y - x) + 1, true};
+      if ((inst & 0x000F) == 0x0003) return {i_, i_ + (x > y ? x - y : y - x) + 1, false};
+      break;
+    case 0xD000: {
+      const uint32_t bytes = (inst & 0x000F) == 0 ? 32 : inst & 0x000F;
+      return {i_, i_ + bytes * std::popcount(graphic_->GetBuffer().GetSelectedPlanes()), false};
+    }
+    case 0xF000:
+      switch (inst & 0x00FF) {
+        case 0x0002:
+          return {i_, i_ + 16u, false};
+        case 0x0033:
+          return {i_, i_ + 3u, true};
+        case 0x0055:
+          return {i_, i_ + x + 1, true};
+        case 0x0065:
+          return {i_, i_ + x + 1, false};
+      }
+      break;
+  }
+  return {0, 0, false};
 }
 
-void Chip8::StartTimers() {
-  delay_timer_->Start();
-  sound_timer_->Start();
+bool Chip8::IsAccessInBounds(uint16_t inst) const {
+  if (pc_ + 2u > memory_limit_) return false;
+  if (inst == 0xF000) return pc_ + 4u <= memory_limit_;
+  return GetMemoryAccess(inst).end <= memory_limit_;
 }
 
+template <Config kConfig>
 void Chip8::Tick() {
-  uint16_t inst = (mem_[pc_] << 8) | mem_[pc_ + 1];
-  InterpretInstruction(inst);
+  uint16_t inst = (mem_[pc_] << 8) | mem_[static_cast<uint16_t>(pc_ + 1)];
+  if constexpr (kConfig.policy.instrumentation == Instrumentation::kCoverage) {
+    RecordCoverage(inst);
+    if (!IsAccessInBounds(inst)) {
+      RaiseFault(Fault::kMemoryOutOfBounds, inst);
+      return;
+    }
+  }
+  if constexpr (kConfig.policy.instrumentation == Instrumentation::kDebugger) {
+    if (debugger_->ShouldBreak(inst)) return;
+  }
+  if constexpr (kConfig.policy.trace == Trace::kText) Debug(inst);
+  if constexpr (kConfig.policy.profile) ++profile_counts_[inst >> 12];
+  if constexpr (kConfig.policy.trace == Trace::kBinary) {
+    TraceRecord record;
+    record.cycle = cycle_++;
+    record.pc = pc_;
+    record.opcode = inst;
+    InterpretInstruction<kConfig.quirks>(inst);
+    record.i = i_;
+    record.v = v_;
+    trace_writer_->Push(record);
+  } else {
+    InterpretInstruction<kConfig.quirks>(inst);
+  }
 }
 
 bool Chip8::Run() {
-  const auto interval = std::chrono::duration<int, std::ratio<1, kMainCycles>>(1);  // 1/kMainCycles seconds
-  MessageType msg;
-  bool one_step = false;
+  // One RunLoop instantiation per deployed policy and quirk combination
+  static constexpr auto kRunLoops = MakeRunLoopTables(std::make_index_sequence<kPolicies.size()>{});
+  const RunLoopFunc run_loop = kRunLoops[FindPolicy(policy_)][quirks_.ToBits()];
+  return (this->*run_loop)();
+}
 
-  StartTimers();
-  is_running_ = true;
-  while (is_running_) {
-    auto start_time = std::chrono::high_resolution_clock::now();
+template <Config kConfig>
+uint64_t Chip8::RunFrame(uint64_t budget) {
+  uint64_t n = 0;
+  if constexpr (kConfig.policy.instrumentation == Instrumentation::kDebugger) {
+    // Without breakpoints, watchpoints or a pending step the debugger engine
+    // runs the plain one, so an idle debugger costs one check per frame.
+    if (!debugger_->IsActive()) {
+      constexpr Policy kPlain{kConfig.policy.trace, kConfig.policy.profile, kConfig.policy.display,
+                              kConfig.policy.timer_source};
+      return RunFrame<Config{kConfig.quirks, kPlain}>(budget);
+    }
+    for (; n < budget && is_running_ && !is_sleeping_; ++n) {
+      Tick<kConfig>();
+    }
+    // The tick that stopped the machine returned before its instruction
+    if (is_sleeping_ && n > 0) --n;
+  } else {
+    for (; n < budget && is_running_; ++n) {
+      Tick<kConfig>();
+    }
+  }
+  return n;
+}
 
-    msg = input_->ProcessInput();
-    switch (msg) {
-      case MSG_NONE:
-        break;
-      case MSG_CHANGE_SLEEP_STATE:
-        is_sleeping_ = !is_sleeping_;
-        break;
-      case MSG_TICK_WHILE_SLEEP:
-        one_step = true;
-        break;
-      case MSG_REDRAW:
-        graphic_->Render();
-        break;
-      case MSG_SHUTDOWN:
-        std::cout << "Shutdown..." << std::endl;
-        is_running_ = false;
-        break;
-      default:
-        assert(false);
+template <Config kConfig>
+void Chip8::RunAhead(uint64_t frame) {
+  // Runs the next frames with the current keys and presents the result, so
+  // that a ROM reacting to input a few frames late shows it right away. The
+  // speculative frames are undone and run for real later, without tracing,
+  // profiling or debugging, and without sound.
+  constexpr Policy kSpeculative{Trace::kNone, false, kConfig.policy.display, TimerSource::kEmulated};
+  SaveSnapshot(*run_ahead_snapshot_);
+  for (int k = 0; k < run_ahead_frames_ && is_running_; ++k) {
+    delay_timer_->DecrementTimerValue();
+    const uint8_t st = sound_timer_->GetRegisterValue();
+    if (st > 0) sound_timer_->SetRegisterValue(st - 1);
+    RunFrame<Config{kConfig.quirks, kSpeculative}>(GetFrameBudget(frame + k));
+  }
+  if (drawable_ || run_ahead_snapshot_->drawable) graphic_->Render();
+  LoadSnapshot(*run_ahead_snapshot_);
+  drawable_ = false;
+}
+
+template <Config kConfig>
+bool Chip8::RunLoop() {
+  constexpr Policy kPolicy = kConfig.policy;
+  using Clock = std::chrono::steady_clock;
+  const auto run_start_time = Clock::now();
+  const std::clock_t run_start_cpu_time = std::clock();
+
+  if constexpr (kPolicy.timer_source == TimerSource::kThreaded) {
+    delay_timer_->Start();
+    sound_timer_->Start();
+  } else if constexpr (kPolicy.display == Display::kWindow) {
+    sound_timer_->InitializeSound();
+  }
+
+  is_running_ = true;
+  bool shutdown = false;  // by the user rather than the program
+  // Everything the loop needs is allocated by now (make alloc-check)
+  ArmAllocationCounter();
+  if constexpr (kPolicy.display == Display::kHeadless) {
+    uint64_t executed = 0;
+    for (uint64_t frame = 0; is_running_ && executed < instruction_limit_; ++frame) {
+      for (; next_key_event_ < input_log_.size() && input_log_[next_key_event_].frame <= frame; ++next_key_event_) {
+        input_->SetKey(input_log_[next_key_event_].key, input_log_[next_key_event_].pressed);
+      }
+      StepTimers();
+      const uint64_t budget = std::min(GetFrameBudget(frame), instruction_limit_ - executed);
+      // A program that stops partway through the frame counts only what it ran
+      const uint64_t ran = kPolicy == kHeadlessPolicy && HasTranslation() ? RunTranslated(budget)
+                                                                         : RunFrame<kConfig>(budget);
+      executed += ran;
+      if (metrics_) {
+        metrics_->Get(CounterId::kInstructions).Add(ran);
+        metrics_->Get(CounterId::kFrames).Add(1);
+      }
+      if (video_writer_) video_writer_->Push(graphic_->GetBuffer());
+      if (shared_state_) PublishSharedState(frame);
     }
+  } else {
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<int, std::ratio<1, kFrameRate>>(1));  // 1/kFrameRate seconds
+    MessageType msg;
+    bool one_step = false;
+    uint64_t frame = 0;
+    int skipped_frames = 0;
+    auto deadline = Clock::now();  // of the current host frame
+    Clock::time_point key_event_time{};  // of a key event not presented yet, with metrics
 
-    if ((is_running_ && !is_sleeping_) ||
-        (is_running_ && is_sleeping_ && one_step)) {
-      Tick();
-      if (drawable_) {
-        drawable_ = false;
-        graphic_->Render();
+    // Render once per host frame, so that high instruction rates (XO-CHIP)
+    // and speeds above 1x are not bound by rendering.
+    const auto run_emulated_frame = [&] {
+      if constexpr (kPolicy.timer_source == TimerSource::kEmulated) StepTimers();
+      const uint64_t budget = GetFrameBudget(frame);
+      ++frame;
+      const uint64_t ran = RunFrame<kConfig>(budget);
+      if (metrics_) {
+        metrics_->Get(CounterId::kInstructions).Add(ran);
+        metrics_->Get(CounterId::kFrames).Add(1);
+      }
+      if (video_writer_) video_writer_->Push(graphic_->GetBuffer());
+      if (shared_state_) PublishSharedState(frame);
+    };
+
+    // A watched ROM keeps the window open after the program stops, for the next reload
+    bool stop_reported = false;
+    while (is_running_ || (rom_watcher_ && !shutdown)) {
+      if constexpr (kPolicy.instrumentation == Instrumentation::kDebugger) debugger_->ProcessCommands();
+      if (rom_watcher_ && !is_running_ && !stop_reported) {
+        ReportStop();
+        std::cout << "Waiting for the ROM to change" << std::endl;
+        stop_reported = true;
+      }
+
+      // Block on input when no emulated progress is possible, rather than spin
+      const bool idle = !is_running_ || is_sleeping_ || IsBlockedOnKey();
+      msg = input_->ProcessInput(idle ? kIdleWaitMs : 0);
+      if (metrics_ && key_event_time == Clock::time_point{}) {
+        key_event_time = input_->TakeKeyEventTime().value_or(Clock::time_point{});
+      }
+      switch (msg) {
+        case MSG_NONE:
+          break;
+        case MSG_CHANGE_SLEEP_STATE:
+          SetSleeping(!is_sleeping_);
+          if constexpr (kPolicy.timer_source == TimerSource::kEmulated) {
+            sound_timer_->SetPaused(is_sleeping_);
+          }
+          break;
+        case MSG_TICK_WHILE_SLEEP:
+          one_step = true;
+          break;
+        case MSG_REDRAW:
+          graphic_->Render();
+          break;
+        case MSG_SPEED_DOWN:
+        case MSG_SPEED_UP:
+        case MSG_SPEED_RESET:
+          // Threaded timers follow the wall clock, so only emulated ones can keep up
+          if constexpr (kPolicy.timer_source == TimerSource::kEmulated) {
+            if (msg == MSG_SPEED_RESET) {
+              ChangeSpeed(kNormalSpeed);
+            } else if (msg == MSG_SPEED_UP) {
+              ChangeSpeed(std::min(speed_index_ + 1, kSpeedPercents.size() - 1));
+            } else {
+              ChangeSpeed(speed_index_ > 0 ? speed_index_ - 1 : 0);
+            }
+          } else {
+            std::cout << "Speed control needs emulated timers (-e)" << std::endl;
+          }
+          break;
+        case MSG_SHUTDOWN:
+          std::cout << "Shutdown..." << std::endl;
+          is_running_ = false;
+          shutdown = true;
+          break;
+        case MSG_RELOAD:
+          break;
+        default:
+          assert(false);
       }
-      if (one_step) one_step = false;
-      std::this_thread::sleep_until(start_time + interval);
+
+      if (!shutdown && (msg == MSG_RELOAD || (rom_watcher_ && rom_watcher_->HasChanged()))) {
+        // Threads, window and audio device stay; only the machine starts over
+        const auto reload_start_time = Clock::now();
+        if (ReloadROM()) {
+          drawable_ = false;
+          graphic_->Render();
+          printf("Reloaded ROM in %.3f ms\n",
+                 std::chrono::duration<double, std::milli>(Clock::now() - reload_start_time).count());
+          stop_reported = false;
+          deadline = Clock::now();
+        }
+      }
+
+      if (is_running_ && !is_sleeping_ && !(idle && IsBlockedOnKey())) {
+        const auto frame_start_time = Clock::now();
+        if constexpr (kPolicy.timer_source == TimerSource::kEmulated) {
+          // Emulated timers step with the frames, so they drift as late as the host wakes
+          if (metrics_) metrics_->Get(HistogramId::kTimerDrift).Record(frame_start_time - deadline);
+        }
+        deadline += interval;
+        const int speed = kSpeedPercents[speed_index_];
+        int emulated_frames = 0;
+        if (speed == kUnlimitedSpeed) {
+          do {
+            run_emulated_frame();
+            ++emulated_frames;
+          } while (is_running_ && Clock::now() < deadline);
+        } else {
+          for (speed_credit_ += speed; speed_credit_ >= 100 && is_running_; speed_credit_ -= 100) {
+            run_emulated_frame();
+            ++emulated_frames;
+          }
+        }
+
+        // A host that falls behind skips presenting frames rather than
+        // slowing down emulated time, up to kMaxFrameSkip in a row
+        auto now = Clock::now();
+        const bool on_time = now <= deadline || speed == kUnlimitedSpeed;
+        if (emulated_frames > 0 && (on_time || skipped_frames >= kMaxFrameSkip)) {
+          skipped_frames = 0;
+          if constexpr (kPolicy.timer_source == TimerSource::kEmulated) {
+            if (run_ahead_frames_ > 0 && is_running_ && !is_sleeping_) RunAhead<kConfig>(frame);
+          }
+          if (has_metrics_overlay_ && metrics_->UpdateOverlay(now)) drawable_ = true;
+          if (drawable_) {
+            drawable_ = false;
+            const auto render_start_time = Clock::now();
+            graphic_->Render();
+            if constexpr (kPolicy.profile) profile_render_time_ += Clock::now() - render_start_time;
+            if (metrics_) {
+              const auto render_end_time = Clock::now();
+              metrics_->Get(HistogramId::kRenderTime).Record(render_end_time - render_start_time);
+              metrics_->Get(CounterId::kPresentedFrames).Add(1);
+              if (key_event_time != Clock::time_point{}) {
+                metrics_->Get(HistogramId::kInputLatency).Record(render_end_time - key_event_time);
+                key_event_time = {};
+              }
+            }
+          }
+          now = Clock::now();
+        } else if (emulated_frames > 0) {
+          ++skipped_frames;
+          if (metrics_) metrics_->Get(CounterId::kSkippedFrames).Add(1);
+        }
+        if (metrics_ && emulated_frames > 0) metrics_->Get(HistogramId::kFrameTime).Record(now - frame_start_time);
+
+        if (now < deadline) {
+          std::this_thread::sleep_until(deadline);
+        } else if (speed == kUnlimitedSpeed || now - deadline > kMaxFrameSkip * interval) {
+          deadline = now;  // too far behind to catch up
+        }
+      } else {
+        deadline = Clock::now();
+        if (is_running_ && one_step) {
+          Tick<kConfig>();
+          if (drawable_) {
+            drawable_ = false;
+            graphic_->Render();
+          }
+          one_step = false;
+        }
+      }
+    }
+  }
+
+  const uint64_t allocations = DisarmAllocationCounter();
+  if (IsCountingAllocations()) {
+    if (allocations > 0) {
+      std::cerr << "The run loop made " << allocations << " heap allocations" << std::endl;
+      exit_success_ = false;
+    } else {
+      std::cout << "The run loop made no heap allocations" << std::endl;
     }
   }
 
+  if (!shutdown) ReportStop();
+  if constexpr (kPolicy.profile) {
+    profile_run_time_ = Clock::now() - run_start_time;
+    profile_cpu_seconds_ = static_cast<double>(std::clock() - run_start_cpu_time) / CLOCKS_PER_SEC;
+    PrintProfile();
+  }
+  if constexpr (kPolicy.trace == Trace::kBinary) trace_writer_->Close();
+  if (video_writer_) video_writer_->Close();
   return exit_success_;
 }
 
+void Chip8::ReportStop() const {
+  if (fault_ != Fault::kNone) {
+    PrintFault();
+  } else if (!is_running_) {
+    std::cout << "Program exited" << std::endl;
+  }
+}
+
+void Chip8::PrintProfile() const {
+  uint64_t total = 0;
+  for (uint64_t count : profile_counts_) total += count;
+  const double seconds = std::chrono::duration<double>(profile_run_time_).count();
+
+  printf("Profile: %llu instructions in %.3f s (%.2f MIPS), render %.3f s\n",
+    static_cast<unsigned long long>(total), seconds, seconds > 0 ? total / seconds / 1e6 : 0.0,
+    std::chrono::duration<double>(profile_render_time_).count());
+  printf("Profile: CPU %.3f s (%.1f%% of a core)\n", profile_cpu_seconds_,
+    seconds > 0 ? 100.0 * profile_cpu_seconds_ / seconds : 0.0);
+  for (int group = 0; group < 16; ++group) {
+    if (profile_counts_[group] == 0) continue;
+    printf("Profile: %Xnnn %12llu (%5.1f%%)\n", group,
+      static_cast<unsigned long long>(profile_counts_[group]), 100.0 * profile_counts_[group] / total);
+  }
+}
+
+void Chip8::SkipInstruction() {
+  // XO-CHIP: F000 nnnn is 4 bytes long and must be skipped as a whole
+  if (mem_[pc_] == 0xF0 && mem_[static_cast<uint16_t>(pc_ + 1)] == 0x00) {
+    pc_ += 4;
+  } else {
+    pc_ += 2;
+  }
+}
+
 void Chip8::Debug(uint16_t inst) {
   printf("Debug: pc=0x%04X, inst=0x%04X, i=0x%04X, sp=0x%02X, dt=0x%02X, st=0x%02X\n",
     pc_, inst, i_, sp_, delay_timer_->GetRegisterValue(), sound_timer_->GetRegisterValue());
 }
 
+template <Quirks kQuirks>
 void Chip8::InterpretInstruction(uint16_t inst) {
-  if (debug_mode_) Debug(inst);
-
   switch (inst & 0xF000) {
     case 0x0000:
+      if ((inst & 0xFFF0) == 0x00C0) {
+        // 0x00Cn
+        // SCD nibble (SUPER-CHIP)
+        graphic_->GetBuffer().ScrollDown(inst & 0x000F);
+        drawable_ = true;
+        pc_ += 2;
+        break;
+      }
+      if ((inst & 0xFFF0) == 0x00D0) {
+        // 0x00Dn
+        // SCU nibble (XO-CHIP)
+        graphic_->GetBuffer().ScrollUp(inst & 0x000F);
+        drawable_ = true;
+        pc_ += 2;
+        break;
+      }
       switch (inst) {
         case 0x00E0:
           // CLS
-          graphic_->GetBuffer().fill({}); // 0-fill
+          graphic_->GetBuffer().Clear();
           drawable_ = true;
           pc_ += 2;
           break;
         case 0x00EE:
           // RET
+          if (sp_ == 0) {
+            RaiseFault(Fault::kStackUnderflow, inst);
+            break;
+          }
           --sp_;
           pc_ = stack_[sp_]; // pop
           pc_ += 2;
           break;
-        default:
-          std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << inst << std::endl;
+        case 0x00FB:
+          // SCR (SUPER-CHIP)
+          graphic_->GetBuffer().ScrollRight();
+          drawable_ = true;
+          pc_ += 2;
+          break;
+        case 0x00FC:
+          // SCL (SUPER-CHIP)
+          graphic_->GetBuffer().ScrollLeft();
+          drawable_ = true;
+          pc_ += 2;
+          break;
+        case 0x00FD:
+          // EXIT (SUPER-CHIP), reported by RunLoop
           is_running_ = false;
-          exit_success_ = false;
+          break;
+        case 0x00FE:
+          // LOW (SUPER-CHIP)
+          graphic_->GetBuffer().SetHighResolution(false);
+          drawable_ = true;
+          pc_ += 2;
+          break;
+        case 0x00FF:
+          // HIGH (SUPER-CHIP)
+          graphic_->GetBuffer().SetHighResolution(true);
+          drawable_ = true;
+          pc_ += 2;
+          break;
+        default:
+          RaiseFault(Fault::kInvalidInstruction, inst);
           break;
       }
       break;
@@ -159,6 +1154,10 @@ void Chip8::InterpretInstruction(uint16_t inst) {
     case 0x2000:
       // 0x2nnn
       // CALL addr
+      if (sp_ == stack_.size()) {
+        RaiseFault(Fault::kStackOverflow, inst);
+        break;
+      }
       stack_[sp_] = pc_;  // push
       ++sp_;
       pc_ = inst & 0x0FFF;
@@ -166,26 +1165,57 @@ void Chip8::InterpretInstruction(uint16_t inst) {
     case 0x3000:
       // 0x3xkk
       // SE Vx, byte
+      pc_ += 2;
       if (v_[(inst & 0x0F00) >> 8] == (inst & 0x00FF)) {
-        pc_ += 2;
+        SkipInstruction();
       }
-      pc_ += 2;
       break;
     case 0x4000:
       // 0x4xkk
       // SNE Vx, byte
+      pc_ += 2;
       if (v_[(inst & 0x0F00) >> 8] != (inst & 0x00FF)) {
-        pc_ += 2;
+        SkipInstruction();
       }
-      pc_ += 2;
       break;
     case 0x5000:
-      // 0x5xy0
-      // SE Vx, Vy
-      if (v_[(inst & 0x0F00) >> 8] == v_[(inst & 0x00F0) >> 4]) {
-        pc_ += 2;
+      switch (inst & 0x000F) {
+        case 0x0000:
+          // 0x5xy0
+          // SE Vx, Vy
+          pc_ += 2;
+          if (v_[(inst & 0x0F00) >> 8] == v_[(inst & 0x00F0) >> 4]) {
+            SkipInstruction();
+          }
+          break;
+        case 0x0002: {
+          // 0x5xy2
+          // LD [I], Vx-Vy (XO-CHIP)
+          const int x = (inst & 0x0F00) >> 8;
+          const int y = (inst & 0x00F0) >> 4;
+          const int step = x <= y ? 1 : -1;
+          for (int k = 0; k <= std::abs(y - x); ++k) {
+            WriteMemory((i_ + k) & 0xFFFF, v_[x + step * k]);
+          }
+          pc_ += 2;
+          break;
+        }
+        case 0x0003: {
+          // 0x5xy3
+          // LD Vx-Vy, [I] (XO-CHIP)
+          const int x = (inst & 0x0F00) >> 8;
+          const int y = (inst & 0x00F0) >> 4;
+          const int step = x <= y ? 1 : -1;
+          for (int k = 0; k <= std::abs(y - x); ++k) {
+            v_[x + step * k] = mem_[(i_ + k) & 0xFFFF];
+          }
+          pc_ += 2;
+          break;
+        }
+        default:
+          RaiseFault(Fault::kInvalidInstruction, inst);
+          break;
       }
-      pc_ += 2;
       break;
     case 0x6000:
       // 0x6xkk
@@ -211,21 +1241,21 @@ void Chip8::InterpretInstruction(uint16_t inst) {
           // 0x8xy1
           // OR Vx, Vy
           v_[(inst & 0x0F00) >> 8] |= v_[(inst & 0x00F0) >> 4];
-          v_[0xF] = 0;
+          if constexpr (kQuirks.vf_reset) v_[0xF] = 0;
           pc_ += 2;
           break;
         case 0x0002:
           // 0x8xy2
           // AND Vx, Vy
           v_[(inst & 0x0F00) >> 8] &= v_[(inst & 0x00F0) >> 4];
-          v_[0xF] = 0;
+          if constexpr (kQuirks.vf_reset) v_[0xF] = 0;
           pc_ += 2;
           break;
         case 0x0003:
           // 0x8xy3
           // XOR Vx, Vy
           v_[(inst & 0x0F00) >> 8] ^= v_[(inst & 0x00F0) >> 4];
-          v_[0xF] = 0;
+          if constexpr (kQuirks.vf_reset) v_[0xF] = 0;
           pc_ += 2;
           break;
         case 0x0004: {
@@ -252,13 +1282,15 @@ void Chip8::InterpretInstruction(uint16_t inst) {
           v_[(inst & 0x0F00) >> 8] -= v_[(inst & 0x00F0) >> 4];
           pc_ += 2;
           break;
-        case 0x0006:
+        case 0x0006: {
           // 0x8xy6
           // SHR Vx {, Vy}
-          v_[0xF] = v_[(inst & 0x0F00) >> 8] & 0x01;
-          v_[(inst & 0x0F00) >> 8] >>= 1;
+          const uint8_t src = kQuirks.shift_vy ? v_[(inst & 0x00F0) >> 4] : v_[(inst & 0x0F00) >> 8];
+          v_[(inst & 0x0F00) >> 8] = src >> 1;
+          v_[0xF] = src & 0x01;
           pc_ += 2;
           break;
+        }
         case 0x0007:
           // 0x8xy7
           // SUBN Vx, Vy
@@ -270,27 +1302,27 @@ void Chip8::InterpretInstruction(uint16_t inst) {
           v_[(inst & 0x0F00) >> 8] = v_[(inst & 0x00F0) >> 4] - v_[(inst & 0x0F00) >> 8];
           pc_ += 2;
           break;
-        case 0x000E:
+        case 0x000E: {
           // 0x8xyE
           // SHL Vx {, Vy}
-          v_[0xF] = v_[(inst & 0x0F00) >> 8] >> 7;
-          v_[(inst & 0x0F00) >> 8] <<= 1;
+          const uint8_t src = kQuirks.shift_vy ? v_[(inst & 0x00F0) >> 4] : v_[(inst & 0x0F00) >> 8];
+          v_[(inst & 0x0F00) >> 8] = src << 1;
+          v_[0xF] = src >> 7;
           pc_ += 2;
           break;
+        }
         default:
-          std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << inst << std::endl;
-          is_running_ = false;
-          exit_success_ = false;
+          RaiseFault(Fault::kInvalidInstruction, inst);
           break;
       }
       break;
     case 0x9000:
       // 0x9xy0
       // SNE Vx, Vy
+      pc_ += 2;
       if (v_[(inst & 0x0F00) >> 8] != v_[(inst & 0x00F0) >> 4]) {
-        pc_ += 2;
+        SkipInstruction();
       }
-      pc_ += 2;
       break;
     case 0xA000:
       // 0xAnnn
@@ -301,7 +1333,13 @@ void Chip8::InterpretInstruction(uint16_t inst) {
     case 0xB000:
       // 0xBnnn
       // JP V0, addr
-      pc_ = (inst & 0x0FFF) + v_[0];
+      // 0xBxnn
+      // JP Vx, addr (SUPER-CHIP)
+      if constexpr (kQuirks.jump_vx) {
+        pc_ = (inst & 0x0FFF) + v_[(inst & 0x0F00) >> 8];
+      } else {
+        pc_ = (inst & 0x0FFF) + v_[0];
+      }
       break;
     case 0xC000:
       // 0xCxkk
@@ -312,23 +1350,42 @@ void Chip8::InterpretInstruction(uint16_t inst) {
     case 0xD000: {
       // 0xDxyn
       // DRW Vx, Vy, nibble
-        uint16_t x = v_[(inst & 0x0F00) >> 8] % 64;
-        uint16_t y = v_[(inst & 0x00F0) >> 4] % 32;
-        const uint16_t n = inst & 0x000F;
+      // 0xDxy0
+      // DRW Vx, Vy, 0 (SUPER-CHIP 16x16 sprite)
+      // XO-CHIP draws the sprite once per selected plane with consecutive sprite data.
         auto& frame_buffer = graphic_->GetBuffer();
+        const uint16_t x = v_[(inst & 0x0F00) >> 8] % frame_buffer.GetWidth();
+        const uint16_t y = v_[(inst & 0x00F0) >> 4] % frame_buffer.GetHeight();
+        const bool wide = (inst & 0x000F) == 0;
+        const uint16_t n = wide ? 16 : inst & 0x000F;
+        const uint16_t bytes_per_row = wide ? 2 : 1;
+        const uint8_t planes = frame_buffer.GetSelectedPlanes();
+        uint16_t addr = i_;
 
         v_[0xF] = 0;
-        for (uint16_t h = 0; h < n; ++h) {
-          uint8_t sprite = mem_[i_ + h];
-          for (uint16_t w = 0; w < 8; ++w) {
-            if (x + w >= 64 || y + h >= 32) break;
-            if ((sprite & (0x80 >> w)) != 0) {
-              if (frame_buffer[y + h][x + w] == 1) {
-                v_[0xF]= 1;
-              }
-              frame_buffer[y + h][x + w] ^= 1;
+        for (int plane = 0; plane < kNumPlanes; ++plane) {
+          if (!(planes & (1 << plane))) continue;
+          for (uint16_t h = 0; h < n; ++h) {
+            if constexpr (kQuirks.clip_sprites) {
+              if (y + h >= frame_buffer.GetHeight()) break;
+            }
+            uint16_t sprite;
+            if (wide) {
+              sprite = (mem_[(addr + 2 * h) & 0xFFFF] << 8) | mem_[(addr + 2 * h + 1) & 0xFFFF];
+            } else {
+              sprite = mem_[(addr + h) & 0xFFFF] << 8;
+            }
+            bool collision;
+            if constexpr (kQuirks.clip_sprites) {
+              collision = frame_buffer.DrawRow(plane, x, y + h, sprite);
+            } else {
+              collision = frame_buffer.DrawRowWrapped(plane, x, (y + h) % frame_buffer.GetHeight(), sprite);
+            }
+            if (collision) {
+              v_[0xF] = 1;
             }
           }
+          addr += n * bytes_per_row;
         }
 
         drawable_ = true;
@@ -340,28 +1397,50 @@ void Chip8::InterpretInstruction(uint16_t inst) {
         case 0x009E:
           // 0xEx9E
           // SKP Vx
+          pc_ += 2;
           if (input_->GetKey(v_[(inst & 0x0F00) >> 8]) == 1) {
-            pc_ += 2;
+            SkipInstruction();
           }
-          pc_ += 2;
           break;
         case 0x00A1:
           // 0xExA1
           // SKNP Vx
+          pc_ += 2;
           if (input_->GetKey(v_[(inst & 0x0F00) >> 8]) == 0) {
-            pc_ += 2;
+            SkipInstruction();
           }
-          pc_ += 2;
           break;
         default:
-          std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << inst << std::endl;
-          is_running_ = false;
-          exit_success_ = false;
+          RaiseFault(Fault::kInvalidInstruction, inst);
           break;
       }
       break;
     case 0xF000:
+      if (inst == 0xF000) {
+        // 0xF000 nnnn
+        // LD I, long addr (XO-CHIP)
+        i_ = (mem_[static_cast<uint16_t>(pc_ + 2)] << 8) | mem_[static_cast<uint16_t>(pc_ + 3)];
+        pc_ += 4;
+        break;
+      }
       switch (inst & 0x00FF) {
+        case 0x0001:
+          // 0xFn01
+          // PLANE n (XO-CHIP)
+          graphic_->GetBuffer().SelectPlanes((inst & 0x0F00) >> 8);
+          pc_ += 2;
+          break;
+        case 0x0002: {
+          // 0xF002
+          // AUDIO (XO-CHIP)
+          std::array<uint8_t, 16> pattern;
+          for (uint16_t i = 0; i < pattern.size(); ++i) {
+            pattern[i] = mem_[(i_ + i) & 0xFFFF];
+          }
+          sound_timer_->SetAudioPattern(pattern);
+          pc_ += 2;
+          break;
+        }
         case 0x0007:
           // 0xFx07
           // LD Vx, DT
@@ -398,11 +1477,15 @@ void Chip8::InterpretInstruction(uint16_t inst) {
         case 0x001E:
           // 0xFx1E
           // ADD I, Vx
-          // Amiga
-          if ((i_ += v_[(inst & 0x0F00) >> 8]) > 0x0FFF) {
-            v_[0xF] = 1;
+          if constexpr (kQuirks.index_overflow) {
+            // Amiga
+            if ((i_ += v_[(inst & 0x0F00) >> 8]) > 0x0FFF) {
+              v_[0xF] = 1;
+            } else {
+              v_[0xF] = 0;
+            }
           } else {
-            v_[0xF] = 0;
+            i_ += v_[(inst & 0x0F00) >> 8];
           }
           pc_ += 2;
           break;
@@ -412,23 +1495,34 @@ void Chip8::InterpretInstruction(uint16_t inst) {
           i_ = 5 * v_[(inst & 0x0F00) >> 8]; // The first address of the sprites is 0x000
           pc_ += 2;
           break;
+        case 0x0030:
+          // 0xFx30
+          // LD HF, Vx (SUPER-CHIP)
+          i_ = kBigSpritesAddress + 10 * (v_[(inst & 0x0F00) >> 8] & 0x0F);
+          pc_ += 2;
+          break;
+        case 0x003A:
+          // 0xFx3A
+          // PITCH Vx (XO-CHIP)
+          sound_timer_->SetPitch(v_[(inst & 0x0F00) >> 8]);
+          pc_ += 2;
+          break;
         case 0x0033:
           // 0xFx33
           // LD B, Vx
-          mem_[i_] = v_[(inst & 0x0F00) >> 8] / 100;
-          mem_[i_ + 1] = (v_[(inst & 0x0F00) >> 8] / 10) % 10;
-          mem_[i_ + 2] = v_[(inst & 0x0F00) >> 8] % 10;
+          WriteMemory(i_, v_[(inst & 0x0F00) >> 8] / 100);
+          WriteMemory((i_ + 1) & 0xFFFF, (v_[(inst & 0x0F00) >> 8] / 10) % 10);
+          WriteMemory((i_ + 2) & 0xFFFF, v_[(inst & 0x0F00) >> 8] % 10);
           pc_ += 2;
           break;
         case 0x0055: {
           // 0xFx55
           // LD [I], Vx
-          // Original COSMAC VIP implementation for old ROMs
             const uint16_t tmp = (inst & 0x0F00) >> 8;
             for (uint16_t i = 0; i <= tmp; ++i) {   // Forgetting the equal sign causes tons of weird behavior
-              mem_[i_ + i] = v_[i];
+              WriteMemory((i_ + i) & 0xFFFF, v_[i]);
             }
-            i_ += tmp + 1;
+            if constexpr (kQuirks.memory_increment) i_ += tmp + 1;  // COSMAC VIP
             pc_ += 2;
           break;
         }
@@ -437,23 +1531,35 @@ void Chip8::InterpretInstruction(uint16_t inst) {
           // LD Vx, [I]
             const uint16_t tmp = (inst & 0x0F00) >> 8;
             for (uint16_t i = 0; i <= tmp; ++i) {   // Forgetting the equal sign causes tons of weird behavior
-              v_[i] = mem_[i_ + i];
+              v_[i] = mem_[(i_ + i) & 0xFFFF];
             }
-            i_ += tmp + 1;
+            if constexpr (kQuirks.memory_increment) i_ += tmp + 1;  // COSMAC VIP
+            pc_ += 2;
+          break;
+        }
+        case 0x0075: {
+          // 0xFx75
+          // LD R, Vx (SUPER-CHIP)
+            const uint16_t tmp = (inst & 0x0F00) >> 8;
+            std::copy(v_.begin(), v_.begin() + tmp + 1, rpl_.begin());
+            pc_ += 2;
+          break;
+        }
+        case 0x0085: {
+          // 0xFx85
+          // LD Vx, R (SUPER-CHIP)
+            const uint16_t tmp = (inst & 0x0F00) >> 8;
+            std::copy(rpl_.begin(), rpl_.begin() + tmp + 1, v_.begin());
             pc_ += 2;
           break;
         }
         default:
-          std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << inst << std::endl;
-          is_running_ = false;
-          exit_success_ = false;
+          RaiseFault(Fault::kInvalidInstruction, inst);
           break;
       }
       break;
     default:
-      std::cerr << "Non-existent instruction: 0x" << std::uppercase << std::hex << inst << std::endl;
-      is_running_ = false;
-      exit_success_ = false;
+      RaiseFault(Fault::kInvalidInstruction, inst);
       break;
   }
 }
@@ -5,48 +5,252 @@
 #include <memory>
 #include <atomic>
 #include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <chrono>
+#include <optional>
+#include <vector>
 
 #include "utils.hpp"
 #include "graphic.hpp"
 #include "delay_timer.hpp"
 #include "sound_timer.hpp"
 #include "input.hpp"
+#include "quirks.hpp"
+#include "config.hpp"
+#include "trace.hpp"
+#include "video.hpp"
+#include "shared_state.hpp"
+#include "input_log.hpp"
+#include "aot.hpp"
+#include "metrics.hpp"
+#include "rom_watcher.hpp"
 
 namespace chip8_emu {
 
+class Debugger;
+struct DebuggerOptions;
+struct CoreState;
+
 constexpr int kMainCycles = 500;  // 500 Hz
+constexpr int kFrameRate = 60;    // 60 Hz
+static_assert(kVideoFrameRate == kFrameRate);
+constexpr uint32_t kMemorySize = 0x10000;  // XO-CHIP 64 KB address space
+constexpr uint32_t kLegacyMemorySize = 0x1000;  // CHIP-8 and SUPER-CHIP
+constexpr size_t kCoverageMapSize = 1 << 14;
+constexpr size_t kStackSize = 16;
+
+// Emulation speeds selectable at runtime with emulated timers, in percent of
+// real time. kUnlimitedSpeed runs as many frames as the host allows.
+constexpr int kUnlimitedSpeed = 0;
+constexpr std::array<int, 8> kSpeedPercents = {25, 50, 100, 200, 400, 800, 1600, kUnlimitedSpeed};
+constexpr size_t kNormalSpeed = 2;
+constexpr int kMaxAudibleSpeed = 400;  // beeps get too short to hear beyond
+constexpr int kMaxFrameSkip = 4;  // late frames skipped in a row before one is presented anyway
+constexpr int kIdleWaitMs = 50;  // bounds the latency of shared-memory keys while idle
+
+// Why the machine stopped on its own
+enum class Fault {
+  kNone,
+  kInvalidInstruction,
+  kStackOverflow,
+  kStackUnderflow,
+  kMemoryOutOfBounds,  // detected with Instrumentation::kCoverage only
+};
+
+const char* FaultToString(Fault fault);
+uint16_t GetOpcodeKind(uint16_t inst);  // instruction with its operands masked out
 
 class Chip8 {
  public:
-  Chip8(bool debug_mode);
-  void LoadROM(const std::string& rom);
-  void InitializeWindow(int window_scale);
+  Chip8(int cycles = kMainCycles);
+  ~Chip8();
+  void LoadROM(const std::string& rom);  // also selects quirks from the ROM database
+  // Reset and load the ROM file again, keeping the quirks, window, audio
+  // device and timer threads. Returns false, changing nothing, if the file
+  // cannot be read.
+  bool ReloadROM();
+  bool WatchROM();  // reloads in the window whenever the ROM file is rewritten
+  void SetQuirks(const Quirks& quirks);
+  void SetCycles(int cycles);
+  void SetPolicy(const Policy& policy);  // must be one of kPolicies
+  void SetInstructionLimit(uint64_t limit);  // headless only
+  void SetInputLog(const std::vector<KeyEvent>& input_log);  // headless only
+  bool OpenTrace(const std::string& path);  // for Trace::kBinary
+  bool OpenVideo(const std::string& path);  // records one image per frame
+  bool OpenSharedState(const std::string& name);  // publishes each frame and takes keys
+  bool EnableDebugger(const DebuggerOptions& options);  // for Instrumentation::kDebugger
+  void SetRunAhead(int frames);  // window with emulated timers only
+  // Collects runtime metrics, shown over the window and/or exported to
+  // stats_path (none if empty)
+  bool EnableMetrics(bool overlay, const std::string& stats_path);
+  void InitializeWindow(int window_scale, UpscaleFilter filter = UpscaleFilter::kNearest);
+  bool InitializeTerminal(TerminalCells cells);  // instead of InitializeWindow, without sound
   bool Run();
 
+  // Instruction-level stepping for lockstep runs (headless, emulated timers)
+  void Reset();  // power-on state without a program; quirks, cycles and the random generator carry on
+  void LoadProgram(const std::vector<uint8_t>& program);  // at 0x200, must fit in memory
+  void SetSeed(uint32_t seed);
+  void SetKey(uint8_t key, bool pressed);
+  uint64_t BeginFrame(uint64_t frame);  // steps the timers and returns the frame's instruction budget
+  void Step();  // executes one instruction with the selected quirks
+  // Step through the AOT translation of the ROM, or Step without one. The
+  // translation only applies with the quirks it was made for.
+  void StepTranslated();
+  bool HasTranslation() const;
+  // Step on the compact core (core.hpp) instead: the machine is copied to a
+  // CoreState, runs one instruction there with this generator and is copied
+  // back. Only the first 4 KB of memory and plane 0 are carried over.
+  void StepCore();
+  // Step with Instrumentation::kCoverage. Edge hit counts go to the map, and
+  // I-relative accesses at or beyond memory_limit raise kMemoryOutOfBounds.
+  void StepWithCoverage();
+  void SetCoverage(uint8_t* coverage_map, uint32_t memory_limit);
+  bool IsRunning() const;
+  Fault GetFault() const;
+  uint16_t GetPc() const;
+  uint16_t GetNextInstruction() const;
+  const FrameBuffer& GetFrameBuffer() const;
+  // Hash of the full machine state (registers, stack, memory, timers and
+  // display). Memory and display hashes are maintained incrementally.
+  uint64_t GetStateHash() const;
+  void PrintStateDiff(const Chip8& other) const;
+
+  // Everything an instruction can change, except XO-CHIP audio patterns
+  struct Snapshot {
+    std::array<uint8_t, kMemorySize> mem;
+    uint64_t mem_hash;
+    std::array<uint16_t, kStackSize> stack;
+    std::array<uint8_t, 16> v;
+    std::array<uint8_t, 16> rpl;
+    uint16_t i;
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool drawable;
+    bool is_running;
+    bool exit_success;
+    Fault fault;
+    uint16_t fault_inst;
+    FrameBuffer frame_buffer;
+    std::mt19937 rand;
+  };
+  void SaveSnapshot(Snapshot& snapshot) const;
+  void LoadSnapshot(const Snapshot& snapshot);
+
  private:
-  void StartTimers();
-  void Tick();
-  void InterpretInstruction(uint16_t inst);
+  friend class Debugger;
+  friend void AotInterpret(AotContext& context);
+
+  struct MemoryAccess {
+    uint32_t begin;  // first address accessed through I
+    uint32_t end;    // one past the last one, equal to begin without access
+    bool write;
+  };
+
+  using RunLoopFunc = bool (Chip8::*)();
+  using RunLoopTable = std::array<RunLoopFunc, 1 << kNumQuirks>;
+
+  template <size_t kPolicyIndex, size_t... kBits>
+  static constexpr RunLoopTable MakeRunLoopTable(std::index_sequence<kBits...>);
+  template <size_t... kPolicyIndices>
+  static constexpr std::array<RunLoopTable, sizeof...(kPolicyIndices)> MakeRunLoopTables(
+      std::index_sequence<kPolicyIndices...>);
+
+  template <Config kConfig> bool RunLoop();
+  template <Config kConfig> uint64_t RunFrame(uint64_t budget);  // returns the instructions executed
+  template <Config kConfig> void RunAhead(uint64_t frame);
+  template <Config kConfig> void Tick();
+  template <Quirks kQuirks> void InterpretInstruction(uint16_t inst);
+  template <Policy kPolicy> void StepWith();
+  static std::optional<std::vector<uint8_t>> ReadROM(const std::string& rom);
+  void FindTranslation(std::string_view sha1);
+  uint64_t RunTranslated(uint64_t budget);  // returns the instructions executed
+  void InterpretUntranslated();
+  void InvalidateTranslation(uint32_t begin, uint32_t end);
+  void RaiseFault(Fault fault, uint16_t inst);
+  void PublishSharedState(uint64_t frame);
+  void PrintFault() const;
+  void ReportStop() const;  // fault or exit, if the program stopped
+  MemoryAccess GetMemoryAccess(uint16_t inst) const;
+  // Also covers fetching inst. Ex9E and ExA1 are not checked: they use the
+  // low nibble of Vx as the key, so any Vx is in bounds.
+  bool IsAccessInBounds(uint16_t inst) const;
+  void RecordCoverage(uint16_t inst);
+  void WriteMemory(uint16_t addr, uint8_t value);
+  void RehashMemory();
+  void StepTimers();
+  void SetSleeping(bool sleeping);
+  bool IsBlockedOnKey();
+  void ChangeSpeed(size_t speed_index);
+  uint64_t GetFrameBudget(uint64_t frame) const;
+  void SkipInstruction();
   void Debug(uint16_t inst);
+  void PrintProfile() const;
 
-  std::array<uint8_t, 4096> mem_;
-  std::array<uint16_t, 16> stack_;
+  std::array<uint8_t, kMemorySize> mem_;
+  uint64_t mem_hash_;  // XOR of Mix64(addr << 8 | value), updated by WriteMemory
+  uint64_t reset_mem_hash_;  // mem_hash_ after Reset, 0 until the first one
+  std::array<uint16_t, kStackSize> stack_;
   std::array<uint8_t, 16> v_;
+  std::array<uint8_t, 16> rpl_;  // SUPER-CHIP RPL user flags
   uint16_t i_;
   uint16_t pc_;
   uint8_t sp_;
 
-  bool debug_mode_;
+  int cycles_;  // instructions per second
+  Quirks quirks_;
+  Policy policy_;
+  uint64_t instruction_limit_;
   bool drawable_;
   std::atomic_bool is_sleeping_;
   bool is_running_;
   bool exit_success_;
+  Fault fault_;
+  uint16_t fault_inst_;
+
+  std::vector<KeyEvent> input_log_;
+  size_t next_key_event_;
+
+  uint8_t* coverage_map_;  // kCoverageMapSize hit counters, for Instrumentation::kCoverage
+  uint32_t memory_limit_;
+  uint16_t previous_location_;
+  uint16_t previous_kind_;
+
+  uint64_t cycle_;  // executed instructions, counted with Trace::kBinary
+  std::unique_ptr<TraceWriter> trace_writer_;
+  std::unique_ptr<VideoWriter> video_writer_;
+  std::unique_ptr<SharedState> shared_state_;
+  int run_ahead_frames_;
+  std::unique_ptr<Snapshot> run_ahead_snapshot_;
+  size_t speed_index_;  // into kSpeedPercents
+  int speed_credit_;  // percent of a frame owed to the emulation
+  const AotTranslation* translation_;  // of the loaded ROM, if linked in
+  std::vector<AotFunction> translated_;  // per instruction address, null where interpreted
+  AotContext aot_context_;
+  std::unique_ptr<CoreState> core_;  // for StepCore, allocated by its first call
+
+  // Filled by policies with profile enabled
+  std::array<uint64_t, 16> profile_counts_;  // per opcode group (inst >> 12)
+  std::chrono::nanoseconds profile_run_time_;
+  std::chrono::nanoseconds profile_render_time_;
+  double profile_cpu_seconds_;  // of the whole process, timer threads included
+
+  std::unique_ptr<Metrics> metrics_;  // null unless enabled
+  bool has_metrics_overlay_;
+  std::string rom_path_;
+  std::vector<uint8_t> rom_buffer_;  // for ReloadROM, reserved by LoadROM
+  std::unique_ptr<RomWatcher> rom_watcher_;  // null unless watching
 
   std::unique_ptr<Rand> rand_;
-  std::shared_ptr<Graphic> graphic_;
+  std::unique_ptr<Graphic> graphic_;
   std::unique_ptr<DelayTimer> delay_timer_;
   std::unique_ptr<SoundTimer> sound_timer_;
   std::unique_ptr<Input> input_;
+  std::unique_ptr<Debugger> debugger_;
 };
 
 } // namespace chip8_emu
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <array>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+enum class Display {
+  kWindow,    // SDL window, input and sound, paced at kFrameRate
+  kHeadless,  // no SDL, runs unthrottled up to an instruction limit
+};
+
+enum class Trace {
+  kNone,
+  kText,    // print the state before every instruction (-d)
+  kBinary,  // stream TraceRecords to a compressed file (-t)
+};
+
+enum class TimerSource {
+  kThreaded,  // DelayTimer/SoundTimer threads tick on the wall clock
+  kEmulated,  // the run loop ticks the timers once per emulated frame
+};
+
+enum class Instrumentation {
+  kNone,
+  kCoverage,  // record pc and opcode edge coverage and check memory bounds (fuzzer)
+  kDebugger,  // check breakpoints and watchpoints while the debugger has any
+};
+
+// Everything in a configuration other than the quirks.
+struct Policy {
+  Trace trace;
+  bool profile;  // count instructions per opcode group and time the run loop
+  Display display;
+  TimerSource timer_source;
+  Instrumentation instrumentation = Instrumentation::kNone;
+
+  constexpr bool operator==(const Policy&) const = default;
+};
+
+// Compile-time configuration of a Chip8 run loop. It is used as a template
+// parameter, so a configuration pays nothing for the features it disables.
+struct Config {
+  Quirks quirks;
+  Policy policy;
+};
+
+constexpr Policy kDefaultPolicy{Trace::kNone, false, Display::kWindow, TimerSource::kThreaded};
+constexpr Policy kHeadlessPolicy{Trace::kNone, false, Display::kHeadless, TimerSource::kEmulated};
+constexpr Policy kCoveragePolicy{
+  Trace::kNone, false, Display::kHeadless, TimerSource::kEmulated, Instrumentation::kCoverage};
+
+// Policies that get an instantiation for every quirk combination.
+// Chip8::Run picks one of them at startup.
+constexpr std::array<Policy, 14> kPolicies = {{
+  {Trace::kNone, false, Display::kWindow, TimerSource::kThreaded},
+  {Trace::kText, false, Display::kWindow, TimerSource::kThreaded},
+  {Trace::kBinary, false, Display::kWindow, TimerSource::kThreaded},
+  {Trace::kNone, true, Display::kWindow, TimerSource::kThreaded},
+  {Trace::kNone, false, Display::kWindow, TimerSource::kEmulated},
+  {Trace::kText, false, Display::kWindow, TimerSource::kEmulated},
+  {Trace::kBinary, false, Display::kWindow, TimerSource::kEmulated},
+  {Trace::kNone, true, Display::kWindow, TimerSource::kEmulated},
+  {Trace::kNone, false, Display::kHeadless, TimerSource::kEmulated},
+  {Trace::kText, false, Display::kHeadless, TimerSource::kEmulated},
+  {Trace::kBinary, false, Display::kHeadless, TimerSource::kEmulated},
+  {Trace::kNone, true, Display::kHeadless, TimerSource::kEmulated},
+  {Trace::kNone, false, Display::kWindow, TimerSource::kThreaded, Instrumentation::kDebugger},
+  kCoveragePolicy,  // -H -B, to replay fuzzer findings
+}};
+
+// Returns kPolicies.size() if the policy is not deployed.
+constexpr size_t FindPolicy(const Policy& policy) {
+  for (size_t i = 0; i < kPolicies.size(); ++i) {
+    if (kPolicies[i] == policy) return i;
+  }
+  return kPolicies.size();
+}
+
+} // namespace chip8_emu
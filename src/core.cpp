@@ -0,0 +1,417 @@
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <utility>
+#include <vector>
+
+#include "core.hpp"
+#include "graphic.hpp"
+#include "utils.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr uint16_t kAddressMask = kLegacyMemorySize - 1;
+
+int GetWidth(const CoreState& core) {
+  return core.high_resolution ? kHighResWidth : kLowResWidth;
+}
+
+int GetHeight(const CoreState& core) {
+  return core.high_resolution ? kHighResHeight : kLowResHeight;
+}
+
+uint8_t GetRandomByte(CoreState& core) {
+  uint32_t x = core.rand;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  core.rand = x;
+  return static_cast<uint8_t>(x >> 24);
+}
+
+void WriteMemory(CoreState& core, uint16_t addr, uint8_t value) {
+  core.mem[addr & kAddressMask] = value;
+}
+
+uint8_t ReadMemory(const CoreState& core, uint16_t addr) {
+  return core.mem[addr & kAddressMask];
+}
+
+void RaiseFault(CoreState& core, Fault fault, uint16_t inst) {
+  core.fault = fault;
+  core.fault_inst = inst;
+  core.is_running = false;
+}
+
+void SetHighResolution(CoreState& core, bool high_resolution) {
+  core.high_resolution = high_resolution;
+  core.display.fill({});
+}
+
+// Chip8::InterpretInstruction without the XO-CHIP instructions. Cxkk takes
+// its bytes from next_byte, so that lockstep can feed Chip8's generator.
+template <Quirks kQuirks, typename NextByte>
+void InterpretInstruction(CoreState& core, uint16_t inst, NextByte&& next_byte) {
+  const int x = (inst & 0x0F00) >> 8;
+  const int y = (inst & 0x00F0) >> 4;
+  const uint8_t kk = inst & 0x00FF;
+  auto& v = core.v;
+  switch (inst & 0xF000) {
+    case 0x0000:
+      if ((inst & 0xFFF0) == 0x00C0) {
+        // SCD nibble (SUPER-CHIP)
+        ScrollPlaneDown(core.display, GetHeight(core), inst & 0x000F);
+        core.pc += 2;
+        break;
+      }
+      switch (inst) {
+        case 0x00E0:
+          // CLS
+          core.display.fill({});
+          core.pc += 2;
+          break;
+        case 0x00EE:
+          // RET
+          if (core.sp == 0) {
+            RaiseFault(core, Fault::kStackUnderflow, inst);
+            break;
+          }
+          --core.sp;
+          core.pc = core.stack[core.sp] + 2;
+          break;
+        case 0x00FB:
+          // SCR (SUPER-CHIP)
+          ScrollPlaneRight(core.display, core.high_resolution);
+          core.pc += 2;
+          break;
+        case 0x00FC:
+          // SCL (SUPER-CHIP)
+          ScrollPlaneLeft(core.display);
+          core.pc += 2;
+          break;
+        case 0x00FD:
+          // EXIT (SUPER-CHIP)
+          core.is_running = false;
+          break;
+        case 0x00FE:
+          // LOW (SUPER-CHIP)
+          SetHighResolution(core, false);
+          core.pc += 2;
+          break;
+        case 0x00FF:
+          // HIGH (SUPER-CHIP)
+          SetHighResolution(core, true);
+          core.pc += 2;
+          break;
+        default:
+          RaiseFault(core, Fault::kInvalidInstruction, inst);
+          break;
+      }
+      break;
+    case 0x1000:
+      // JP addr
+      core.pc = inst & 0x0FFF;
+      break;
+    case 0x2000:
+      // CALL addr
+      if (core.sp == core.stack.size()) {
+        RaiseFault(core, Fault::kStackOverflow, inst);
+        break;
+      }
+      core.stack[core.sp++] = core.pc;
+      core.pc = inst & 0x0FFF;
+      break;
+    case 0x3000:
+      // SE Vx, byte
+      core.pc += v[x] == kk ? 4 : 2;
+      break;
+    case 0x4000:
+      // SNE Vx, byte
+      core.pc += v[x] != kk ? 4 : 2;
+      break;
+    case 0x5000:
+      // SE Vx, Vy
+      if ((inst & 0x000F) != 0) {
+        RaiseFault(core, Fault::kInvalidInstruction, inst);
+        break;
+      }
+      core.pc += v[x] == v[y] ? 4 : 2;
+      break;
+    case 0x6000:
+      // LD Vx, byte
+      v[x] = kk;
+      core.pc += 2;
+      break;
+    case 0x7000:
+      // ADD Vx, byte
+      v[x] += kk;
+      core.pc += 2;
+      break;
+    case 0x8000:
+      switch (inst & 0x000F) {
+        case 0x0000:
+          // LD Vx, Vy
+          v[x] = v[y];
+          break;
+        case 0x0001:
+          // OR Vx, Vy
+          v[x] |= v[y];
+          if constexpr (kQuirks.vf_reset) v[0xF] = 0;
+          break;
+        case 0x0002:
+          // AND Vx, Vy
+          v[x] &= v[y];
+          if constexpr (kQuirks.vf_reset) v[0xF] = 0;
+          break;
+        case 0x0003:
+          // XOR Vx, Vy
+          v[x] ^= v[y];
+          if constexpr (kQuirks.vf_reset) v[0xF] = 0;
+          break;
+        case 0x0004: {
+          // ADD Vx, Vy
+          const uint16_t sum = v[x] + v[y];
+          v[0xF] = sum > 0xFF;
+          v[x] = static_cast<uint8_t>(sum);
+          break;
+        }
+        case 0x0005: {
+          // SUB Vx, Vy
+          const uint8_t flag = v[x] > v[y];
+          v[0xF] = flag;
+          v[x] -= v[y];
+          break;
+        }
+        case 0x0006: {
+          // SHR Vx {, Vy}
+          const uint8_t src = kQuirks.shift_vy ? v[y] : v[x];
+          v[x] = src >> 1;
+          v[0xF] = src & 0x01;
+          break;
+        }
+        case 0x0007: {
+          // SUBN Vx, Vy
+          const uint8_t flag = v[y] > v[x];
+          v[0xF] = flag;
+          v[x] = v[y] - v[x];
+          break;
+        }
+        case 0x000E: {
+          // SHL Vx {, Vy}
+          const uint8_t src = kQuirks.shift_vy ? v[y] : v[x];
+          v[x] = src << 1;
+          v[0xF] = src >> 7;
+          break;
+        }
+        default:
+          RaiseFault(core, Fault::kInvalidInstruction, inst);
+          return;
+      }
+      core.pc += 2;
+      break;
+    case 0x9000:
+      // SNE Vx, Vy
+      core.pc += v[x] != v[y] ? 4 : 2;
+      break;
+    case 0xA000:
+      // LD I, addr
+      core.i = inst & 0x0FFF;
+      core.pc += 2;
+      break;
+    case 0xB000:
+      // JP V0, addr, or JP Vx, addr (SUPER-CHIP)
+      core.pc = (inst & 0x0FFF) + v[kQuirks.jump_vx ? x : 0];
+      break;
+    case 0xC000:
+      // RND Vx, byte
+      v[x] = next_byte() & kk;
+      core.pc += 2;
+      break;
+    case 0xD000: {
+      // DRW Vx, Vy, nibble, or a 16x16 sprite for n = 0 (SUPER-CHIP)
+      const int height = GetHeight(core);
+      const uint16_t left = v[x] % GetWidth(core);
+      const uint16_t top = v[y] % height;
+      const bool wide = (inst & 0x000F) == 0;
+      const uint16_t n = wide ? 16 : inst & 0x000F;
+      v[0xF] = 0;
+      for (uint16_t h = 0; h < n; ++h) {
+        if constexpr (kQuirks.clip_sprites) {
+          if (top + h >= height) break;
+        }
+        uint16_t sprite;
+        if (wide) {
+          sprite = ReadMemory(core, core.i + 2 * h) << 8 | ReadMemory(core, core.i + 2 * h + 1);
+        } else {
+          sprite = ReadMemory(core, core.i + h) << 8;
+        }
+        bool collision;
+        if constexpr (kQuirks.clip_sprites) {
+          collision = DrawPlaneRow(core.display, core.high_resolution, left, top + h, sprite);
+        } else {
+          collision = DrawPlaneRowWrapped(core.display, core.high_resolution, left, (top + h) % height, sprite);
+        }
+        if (collision) v[0xF] = 1;
+      }
+      core.pc += 2;
+      break;
+    }
+    case 0xE000:
+      switch (inst & 0x00FF) {
+        case 0x009E:
+          // SKP Vx
+          core.pc += (core.keys >> (v[x] & 0xF)) & 1 ? 4 : 2;
+          break;
+        case 0x00A1:
+          // SKNP Vx
+          core.pc += (core.keys >> (v[x] & 0xF)) & 1 ? 2 : 4;
+          break;
+        default:
+          RaiseFault(core, Fault::kInvalidInstruction, inst);
+          break;
+      }
+      break;
+    case 0xF000:
+      switch (inst & 0x00FF) {
+        case 0x0007:
+          // LD Vx, DT
+          v[x] = core.delay_timer;
+          break;
+        case 0x000A:
+          // LD Vx, K. Vx gets the key state rather than the key number, as in
+          // Chip8, so that both agree on the same input.
+          if (core.keys == 0) return;
+          v[x] = 1;
+          break;
+        case 0x0015:
+          // LD DT, Vx
+          core.delay_timer = v[x];
+          break;
+        case 0x0018:
+          // LD ST, Vx
+          core.sound_timer = v[x];
+          break;
+        case 0x001E:
+          // ADD I, Vx
+          core.i += v[x];
+          if constexpr (kQuirks.index_overflow) v[0xF] = core.i > 0x0FFF;  // Amiga
+          break;
+        case 0x0029:
+          // LD F, Vx
+          core.i = kSpritesAddress + 5 * v[x];
+          break;
+        case 0x0030:
+          // LD HF, Vx (SUPER-CHIP)
+          core.i = kBigSpritesAddress + 10 * (v[x] & 0x0F);
+          break;
+        case 0x0033:
+          // LD B, Vx
+          WriteMemory(core, core.i, v[x] / 100);
+          WriteMemory(core, core.i + 1, (v[x] / 10) % 10);
+          WriteMemory(core, core.i + 2, v[x] % 10);
+          break;
+        case 0x0055:
+          // LD [I], Vx
+          for (int k = 0; k <= x; ++k) WriteMemory(core, core.i + k, v[k]);
+          if constexpr (kQuirks.memory_increment) core.i += x + 1;  // COSMAC VIP
+          break;
+        case 0x0065:
+          // LD Vx, [I]
+          for (int k = 0; k <= x; ++k) v[k] = ReadMemory(core, core.i + k);
+          if constexpr (kQuirks.memory_increment) core.i += x + 1;  // COSMAC VIP
+          break;
+        case 0x0075:
+          // LD R, Vx (SUPER-CHIP)
+          std::copy(v.begin(), v.begin() + x + 1, core.rpl.begin());
+          break;
+        case 0x0085:
+          // LD Vx, R (SUPER-CHIP)
+          std::copy(core.rpl.begin(), core.rpl.begin() + x + 1, v.begin());
+          break;
+        default:
+          RaiseFault(core, Fault::kInvalidInstruction, inst);
+          return;
+      }
+      core.pc += 2;
+      break;
+  }
+}
+
+uint16_t FetchInstruction(const CoreState& core) {
+  return ReadMemory(core, core.pc) << 8 | ReadMemory(core, core.pc + 1);
+}
+
+template <Quirks kQuirks>
+uint64_t RunFrame(CoreState& core, uint64_t budget) {
+  uint64_t n = 0;
+  for (; n < budget && core.is_running; ++n) {
+    InterpretInstruction<kQuirks>(core, FetchInstruction(core), [&core] { return GetRandomByte(core); });
+  }
+  return n;
+}
+
+template <Quirks kQuirks>
+void StepWithRand(CoreState& core, Rand& rand) {
+  InterpretInstruction<kQuirks>(core, FetchInstruction(core), [&rand] { return rand.GetRandomByte(); });
+}
+
+}  // namespace
+
+void ResetCore(CoreState& core, uint32_t seed) {
+  core.mem.fill(0);
+  std::copy(kSprites.begin(), kSprites.end(), core.mem.begin() + kSpritesAddress);
+  std::copy(kBigSprites.begin(), kBigSprites.end(), core.mem.begin() + kBigSpritesAddress);
+  core.display.fill({});
+  core.stack.fill(0);
+  core.v.fill(0);
+  core.rpl.fill(0);
+  core.i = 0;
+  core.pc = 0x200;
+  core.keys = 0;
+  core.fault_inst = 0;
+  core.sp = 0;
+  core.delay_timer = 0;
+  core.sound_timer = 0;
+  core.high_resolution = false;
+  core.is_running = true;
+  core.fault = Fault::kNone;
+  SeedCore(core, seed);
+}
+
+bool LoadCoreProgram(CoreState& core, const std::vector<uint8_t>& program) {
+  if (0x200 + program.size() > core.mem.size()) return false;
+  std::copy(program.begin(), program.end(), core.mem.begin() + 0x200);
+  return true;
+}
+
+void SeedCore(CoreState& core, uint32_t seed) {
+  const uint32_t state = static_cast<uint32_t>(Mix64(seed));
+  core.rand = state != 0 ? state : 1;
+}
+
+uint64_t RunCoreFrame(CoreState& core, const Quirks& quirks, uint64_t budget) {
+  using FrameFunc = uint64_t (*)(CoreState&, uint64_t);
+  static constexpr auto kFrames = []<size_t... kBits>(std::index_sequence<kBits...>) {
+    return std::array<FrameFunc, 1 << kNumQuirks>{&RunFrame<Quirks::FromBits(kBits)>...};
+  }(std::make_index_sequence<1 << kNumQuirks>{});
+  if (core.delay_timer > 0) --core.delay_timer;
+  if (core.sound_timer > 0) --core.sound_timer;
+  return kFrames[quirks.ToBits()](core, budget);
+}
+
+void StepCore(CoreState& core, const Quirks& quirks, Rand& rand) {
+  using StepFunc = void (*)(CoreState&, Rand&);
+  static constexpr auto kSteps = []<size_t... kBits>(std::index_sequence<kBits...>) {
+    return std::array<StepFunc, 1 << kNumQuirks>{&StepWithRand<Quirks::FromBits(kBits)>...};
+  }(std::make_index_sequence<1 << kNumQuirks>{});
+  kSteps[quirks.ToBits()](core, rand);
+}
+
+uint8_t GetCorePixel(const CoreState& core, int x, int y) {
+  return (core.display[y][x >> 6] >> (63 - (x & 63))) & 1;
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <type_traits>
+#include <vector>
+
+#include "chip8.hpp"
+#include "frame_buffer.hpp"
+#include "quirks.hpp"
+#include "utils.hpp"
+
+namespace chip8_emu {
+
+// Machine state of a compact CHIP-8 and SUPER-CHIP core, for running very
+// many machines at once. Unlike Chip8 it has no threads, locks, devices or
+// heap members: the 4 KB address space, one 128x64 plane and a 32-bit
+// xorshift generator in place of mt19937, so that a machine is a few KB that
+// can be copied with memcpy. Timers count emulated frames and keys are set
+// by the caller. XO-CHIP instructions raise kInvalidInstruction, and
+// addresses wrap at 4 KB like on the COSMAC VIP. The instructions are checked
+// against Chip8 with the lockstep engine "core".
+struct CoreState {
+  std::array<uint8_t, kLegacyMemorySize> mem;
+  FrameBuffer::Plane display;  // rows in FrameBuffer layout
+  std::array<uint16_t, kStackSize> stack;
+  std::array<uint8_t, 16> v;
+  std::array<uint8_t, 16> rpl;  // SUPER-CHIP RPL user flags
+  uint32_t rand;  // xorshift32, never 0
+  uint16_t i;
+  uint16_t pc;
+  uint16_t keys;  // bit n is set while key n is down
+  uint16_t fault_inst;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  bool high_resolution;
+  bool is_running;
+  Fault fault;
+};
+
+static_assert(std::is_trivially_copyable_v<CoreState>);
+
+// Power-on state with the fonts loaded and the generator seeded
+void ResetCore(CoreState& core, uint32_t seed);
+// Copies the program to 0x200. Returns false if it does not fit in 4 KB.
+bool LoadCoreProgram(CoreState& core, const std::vector<uint8_t>& program);
+void SeedCore(CoreState& core, uint32_t seed);
+// Steps the timers and executes up to budget instructions, stopping early
+// when the program exits or faults, and returns the number executed. The
+// quirks are dispatched once per frame to an interpreter instantiated for
+// them, as in Chip8.
+uint64_t RunCoreFrame(CoreState& core, const Quirks& quirks, uint64_t budget);
+// Executes one instruction without stepping the timers, taking Cxkk bytes
+// from rand instead of core.rand. This is the lockstep engine "core", which
+// checks the compact core against Chip8 on the same seed.
+void StepCore(CoreState& core, const Quirks& quirks, Rand& rand);
+uint8_t GetCorePixel(const CoreState& core, int x, int y);
+
+} // namespace chip8_emu
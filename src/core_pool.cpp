@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core_pool.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+CorePool::CorePool(size_t capacity)
+    : states_{std::make_unique_for_overwrite<CoreState[]>(capacity)},
+      free_(capacity),
+      mutex_{} {
+  // Slot 0 on top, so that a partly used pool stays at the front of the block
+  for (size_t k = 0; k < capacity; ++k) free_[k] = static_cast<uint32_t>(capacity - 1 - k);
+}
+
+CoreState* CorePool::Acquire() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.empty()) return nullptr;
+  const uint32_t slot = free_.back();
+  free_.pop_back();
+  return &states_[slot];
+}
+
+void CorePool::Release(CoreState* core) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_.push_back(static_cast<uint32_t>(core - states_.get()));  // within the capacity reserved up front
+}
+
+namespace {
+
+// Frames each machine runs before the job moves on to the next one, so that
+// its state stays in cache for more than the few instructions of one frame
+constexpr uint64_t kBatchFrames = kFrameRate;
+
+struct JobResult {
+  uint64_t instructions;
+  uint64_t restarts;
+};
+
+// Runs the instances [begin, end) of the pool run
+JobResult RunJob(CorePool& pool, const CoreState& prototype, const Quirks& quirks, const CorePoolOptions& options,
+                 size_t begin, size_t end) {
+  std::vector<CoreState*> cores;
+  cores.reserve(end - begin);
+  for (size_t n = begin; n < end; ++n) {
+    CoreState* core = pool.Acquire();
+    *core = prototype;  // first touch on the thread that runs it
+    SeedCore(*core, options.seed + n);
+    cores.push_back(core);
+  }
+
+  JobResult result{0, 0};
+  std::array<uint16_t, kBatchFrames> keys{};  // per frame of the batch
+  std::array<uint64_t, kBatchFrames> budgets{};
+  uint16_t held = 0;
+  size_t next_key_event = 0;
+  uint64_t budgeted = 0;
+  for (uint64_t first_frame = 0; budgeted < options.instructions; first_frame += kBatchFrames) {
+    size_t num_frames = 0;
+    for (; num_frames < kBatchFrames && budgeted < options.instructions; ++num_frames) {
+      const uint64_t frame = first_frame + num_frames;
+      for (; next_key_event < options.input_log.size() && options.input_log[next_key_event].frame <= frame;
+           ++next_key_event) {
+        const KeyEvent& event = options.input_log[next_key_event];
+        held = event.pressed ? held | 1 << event.key : held & ~(1 << event.key);
+      }
+      const uint64_t cycles = options.cycles;
+      keys[num_frames] = held;
+      budgets[num_frames] = std::min(cycles * (frame + 1) / kFrameRate - cycles * frame / kFrameRate,
+                                     options.instructions - budgeted);
+      budgeted += budgets[num_frames];
+    }
+
+    for (size_t k = 0; k < cores.size(); ++k) {
+      CoreState*& core = cores[k];
+      for (size_t n = 0; n < num_frames; ++n) {
+        core->keys = keys[n];
+        result.instructions += RunCoreFrame(*core, quirks, budgets[n]);
+        if (core->is_running) continue;
+        pool.Release(core);
+        core = pool.Acquire();
+        *core = prototype;
+        SeedCore(*core, options.seed + begin + k);
+        ++result.restarts;
+      }
+    }
+  }
+  for (CoreState* core : cores) pool.Release(core);
+  return result;
+}
+
+}  // namespace
+
+bool RunCorePool(const std::string& rom, const CorePoolOptions& options) {
+  std::ifstream ifs{rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    fprintf(stderr, "Failed to open ROM: %s\n", rom.c_str());
+    return false;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  CoreState prototype;
+  ResetCore(prototype, 0);
+  if (!LoadCoreProgram(prototype, data)) {
+    fprintf(stderr, "ROM does not fit in the 4 KB memory of a compact core\n");
+    return false;
+  }
+  const Quirks quirks = options.quirks.value_or(LookUpQuirks(Sha1(data)).value_or(kChip8Quirks));
+
+  constexpr size_t kGiB = size_t{1} << 30;
+  CorePool pool{options.instances};
+  printf("Core pool: %zu instances of %zu bytes (%zu per GiB), %.1f MiB in one block\n", options.instances,
+    CorePool::kBytesPerInstance, kGiB / CorePool::kBytesPerInstance,
+    static_cast<double>(options.instances * CorePool::kBytesPerInstance) / (1 << 20));
+
+  const size_t jobs = std::min<size_t>(options.jobs, options.instances);
+  std::vector<JobResult> results(jobs);
+  std::vector<std::thread> threads;
+  const auto start_time = std::chrono::steady_clock::now();
+  for (size_t job = 0; job < jobs; ++job) {
+    threads.emplace_back([&, job] {
+      const size_t begin = options.instances * job / jobs;
+      const size_t end = options.instances * (job + 1) / jobs;
+      results[job] = RunJob(pool, prototype, quirks, options, begin, end);
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  JobResult total{0, 0};
+  for (const JobResult& result : results) {
+    total.instructions += result.instructions;
+    total.restarts += result.restarts;
+  }
+  printf("Core pool: %llu instructions in %.2f s (%.1f MIPS on %zu jobs), %llu restarts\n",
+    static_cast<unsigned long long>(total.instructions), seconds, total.instructions / seconds / 1e6, jobs,
+    static_cast<unsigned long long>(total.restarts));
+  return true;
+}
+
+} // namespace chip8_emu
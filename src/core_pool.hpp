@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "core.hpp"
+#include "input_log.hpp"
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+// Fixed number of CoreStates in one contiguous allocation, handed out and
+// taken back through a free list of slot indices. Nothing is allocated
+// after construction, and slots are left untouched until first acquired,
+// so a large pool costs address space rather than memory up front.
+// Acquire and Release may be called from any thread.
+class CorePool {
+ public:
+  explicit CorePool(size_t capacity);
+  CoreState* Acquire();  // nullptr when every slot is in use
+  void Release(CoreState* core);
+  // The state and its free list entry
+  static constexpr size_t kBytesPerInstance = sizeof(CoreState) + sizeof(uint32_t);
+
+ private:
+  std::unique_ptr<CoreState[]> states_;
+  std::vector<uint32_t> free_;  // used as a stack, so recycled slots are still in cache
+  std::mutex mutex_;
+};
+
+struct CorePoolOptions {
+  size_t instances;
+  uint64_t instructions;  // per instance
+  int jobs;
+  int cycles;
+  uint32_t seed;  // instance n is seeded with seed + n
+  std::optional<Quirks> quirks;  // ROM database quirks if empty
+  std::vector<KeyEvent> input_log;  // applied to every instance
+};
+
+// Runs instances copies of the ROM on compact cores from one CorePool,
+// frame by frame on jobs threads, and reports the memory per instance,
+// instances per GiB and the combined instruction rate. A machine that
+// stops is released and replaced by a fresh one from the pool.
+bool RunCorePool(const std::string& rom, const CorePoolOptions& options);
+
+} // namespace chip8_emu
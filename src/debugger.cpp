@@ -0,0 +1,503 @@
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "debugger.hpp"
+#include "alloc_counter.hpp"
+#include "chip8.hpp"
+#include "gdb_stub.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr char kHelp[] =
+  "Debugger commands (numbers are C-style, e.g. 0x200):\n"
+  "  b <addr> [<v0-vF|i> <==|!=|<|>|<=|>=> <value>]  set a (conditional) breakpoint\n"
+  "  d [addr]                 delete the breakpoints at addr, or all\n"
+  "  w <r|w|rw> <first> [last]  set a memory watchpoint\n"
+  "  u [addr]                 delete the watchpoints containing addr, or all\n"
+  "  c                        continue\n"
+  "  s                        step one instruction\n"
+  "  n                        step over a 2nnn call\n"
+  "  f                        run to the return of the current subroutine\n"
+  "  r                        print the registers\n"
+  "  x <addr> [length]        examine memory\n"
+  "  l                        list breakpoints and watchpoints\n";
+
+bool ParseNumber(const std::string& token, uint32_t& value) {
+  char* end;
+  value = std::strtoul(token.c_str(), &end, 0);
+  return !token.empty() && *end == '\0';
+}
+
+bool ParseOperator(const std::string& token, Debugger::Operator& op) {
+  static const std::pair<const char*, Debugger::Operator> kOperators[] = {
+    {"==", Debugger::Operator::kEqual},
+    {"!=", Debugger::Operator::kNotEqual},
+    {"<", Debugger::Operator::kLess},
+    {">", Debugger::Operator::kGreater},
+    {"<=", Debugger::Operator::kLessEqual},
+    {">=", Debugger::Operator::kGreaterEqual},
+  };
+  for (const auto& [name, value] : kOperators) {
+    if (token == name) {
+      op = value;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* OperatorToString(Debugger::Operator op) {
+  switch (op) {
+    case Debugger::Operator::kEqual:
+      return "==";
+    case Debugger::Operator::kNotEqual:
+      return "!=";
+    case Debugger::Operator::kLess:
+      return "<";
+    case Debugger::Operator::kGreater:
+      return ">";
+    case Debugger::Operator::kLessEqual:
+      return "<=";
+    case Debugger::Operator::kGreaterEqual:
+      return ">=";
+  }
+  return "?";
+}
+
+} // namespace
+
+Debugger::Debugger(Chip8& chip8, const DebuggerOptions& options)
+    : chip8_{chip8},
+      options_{options},
+      breakpoints_{},
+      watchpoints_{},
+      breakpoint_bits_{},
+      watch_pages_{},
+      step_mode_{StepMode::kNone},
+      step_pc_{0},
+      step_sp_{0},
+      resume_{false},
+      active_{false},
+      queue_{std::make_shared<TaskQueue>()},
+      gdb_stub_{} {}
+
+Debugger::~Debugger() {
+  std::lock_guard<std::mutex> lock(queue_->mutex);
+  queue_->wake = nullptr;
+}
+
+bool Debugger::Start() {
+  queue_->wake = [&input = *chip8_.input_] { input.Wake(); };
+  if (options_.gdb_port != 0) {
+    gdb_stub_ = std::make_unique<GdbStub>(*this, options_.gdb_port);
+    if (!gdb_stub_->Start()) return false;
+  }
+  if (options_.console) {
+    printf("Debugger: type h for help\n");
+    // Detached, since a blocking read on stdin cannot be interrupted. The
+    // tasks only run through ProcessCommands, while the debugger is alive.
+    std::thread([this, queue = queue_] {
+      std::string line;
+      while (std::getline(std::cin, line)) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->tasks.push_back([this, line] { Execute(line); });
+        if (queue->wake) queue->wake();
+      }
+    }).detach();
+  }
+  return true;
+}
+
+void Debugger::PostCommand(const std::string& command) {
+  PostTask([this, command] { Execute(command); });
+}
+
+void Debugger::PostTask(std::function<void()> task) {
+  std::lock_guard<std::mutex> lock(queue_->mutex);
+  queue_->tasks.push_back(std::move(task));
+  if (queue_->wake) queue_->wake();
+}
+
+void Debugger::ProcessCommands() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(queue_->mutex);
+      if (queue_->tasks.empty()) return;
+      task = std::move(queue_->tasks.front());
+      queue_->tasks.pop_front();
+    }
+    const AllocationCounterPause pause;
+    task();
+  }
+}
+
+bool Debugger::IsActive() const {
+  return active_;
+}
+
+bool Debugger::ShouldBreak(uint16_t inst) {
+  if (chip8_.is_sleeping_) return false;  // single step with T while paused
+  if (resume_) {
+    resume_ = false;
+    return false;
+  }
+
+  const uint16_t pc = chip8_.pc_;
+  switch (step_mode_) {
+    case StepMode::kStep:
+      Stop("step");
+      return true;
+    case StepMode::kStepOver:
+      if (pc == step_pc_ && chip8_.sp_ == step_sp_) {
+        Stop("step over");
+        return true;
+      }
+      break;
+    case StepMode::kRunToReturn:
+      if (chip8_.sp_ < step_sp_) {
+        Stop("return");
+        return true;
+      }
+      break;
+    case StepMode::kNone:
+      break;
+  }
+
+  if ((breakpoint_bits_[pc >> 6] >> (pc & 63)) & 1) {
+    for (const Breakpoint& breakpoint : breakpoints_) {
+      if (breakpoint.pc == pc && (!breakpoint.condition || Matches(*breakpoint.condition))) {
+        Stop("breakpoint");
+        return true;
+      }
+    }
+  }
+
+  if (!watchpoints_.empty()) {
+    const Chip8::MemoryAccess access = chip8_.GetMemoryAccess(inst);
+    // An access past 0xFFFF wraps to the bottom of memory, as in the interpreter
+    const std::array<std::pair<uint32_t, uint32_t>, 2> ranges{{
+        {access.begin, std::min(access.end, kMemorySize)},
+        {0, access.end > kMemorySize ? access.end - kMemorySize : 0}}};
+    for (const auto& [begin, end] : ranges) {
+      bool watched_page = false;
+      for (uint32_t page = begin >> 8; begin < end && page <= (end - 1) >> 8; ++page) {
+        watched_page |= (watch_pages_[page >> 6] >> (page & 63)) & 1;
+      }
+      if (!watched_page) continue;
+      for (const Watchpoint& watchpoint : watchpoints_) {
+        if ((access.write ? watchpoint.write : watchpoint.read) && begin < watchpoint.end && watchpoint.begin < end) {
+          Stop(access.write ? "write watchpoint" : "read watchpoint");
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void Debugger::AddBreakpoint(const Breakpoint& breakpoint) {
+  breakpoints_.push_back(breakpoint);
+  breakpoint_bits_[breakpoint.pc >> 6] |= 1ULL << (breakpoint.pc & 63);
+  UpdateActive();
+}
+
+void Debugger::RemoveBreakpoints(uint16_t pc, Owner owner) {
+  std::erase_if(breakpoints_, [pc, owner](const Breakpoint& breakpoint) {
+    return breakpoint.pc == pc && breakpoint.owner == owner;
+  });
+  UpdateBreakpointBits();
+}
+
+void Debugger::ClearBreakpoints(Owner owner) {
+  std::erase_if(breakpoints_, [owner](const Breakpoint& breakpoint) { return breakpoint.owner == owner; });
+  UpdateBreakpointBits();
+}
+
+void Debugger::UpdateBreakpointBits() {
+  breakpoint_bits_.fill(0);
+  for (const Breakpoint& breakpoint : breakpoints_) {
+    breakpoint_bits_[breakpoint.pc >> 6] |= 1ULL << (breakpoint.pc & 63);
+  }
+  UpdateActive();
+}
+
+void Debugger::AddWatchpoint(const Watchpoint& watchpoint) {
+  watchpoints_.push_back(watchpoint);
+  MarkWatchPages(watchpoint);
+  UpdateActive();
+}
+
+void Debugger::MarkWatchPages(const Watchpoint& watchpoint) {
+  // Front ends check the range, but the page bits must not overrun either way
+  const uint32_t end = std::min(watchpoint.end, kMemorySize);
+  for (uint32_t page = watchpoint.begin >> 8; watchpoint.begin < end && page <= (end - 1) >> 8; ++page) {
+    watch_pages_[page >> 6] |= 1ULL << (page & 63);
+  }
+}
+
+void Debugger::RemoveWatchpoints(uint32_t addr, Owner owner) {
+  std::erase_if(watchpoints_, [addr, owner](const Watchpoint& watchpoint) {
+    return watchpoint.begin <= addr && addr < watchpoint.end && watchpoint.owner == owner;
+  });
+  UpdateWatchPages();
+}
+
+void Debugger::ClearWatchpoints(Owner owner) {
+  std::erase_if(watchpoints_, [owner](const Watchpoint& watchpoint) { return watchpoint.owner == owner; });
+  UpdateWatchPages();
+}
+
+void Debugger::UpdateWatchPages() {
+  watch_pages_.fill(0);
+  for (const Watchpoint& watchpoint : watchpoints_) MarkWatchPages(watchpoint);
+  UpdateActive();
+}
+
+uint16_t Debugger::ReadRegister(int reg) const {
+  switch (reg) {
+    case kRegisterI:
+      return chip8_.i_;
+    case kRegisterPc:
+      return chip8_.pc_;
+    case kRegisterSp:
+      return chip8_.sp_;
+    case kRegisterDt:
+      return chip8_.delay_timer_->GetRegisterValue();
+    case kRegisterSt:
+      return chip8_.sound_timer_->GetRegisterValue();
+    default:
+      return chip8_.v_[reg & 0xF];
+  }
+}
+
+void Debugger::WriteRegister(int reg, uint16_t value) {
+  switch (reg) {
+    case kRegisterI:
+      chip8_.i_ = value;
+      break;
+    case kRegisterPc:
+      chip8_.pc_ = value;
+      break;
+    case kRegisterSp:
+      chip8_.sp_ = std::min<uint16_t>(value, chip8_.stack_.size());
+      break;
+    case kRegisterDt:
+      chip8_.delay_timer_->SetRegisterValue(value);
+      break;
+    case kRegisterSt:
+      chip8_.sound_timer_->SetRegisterValue(value);
+      break;
+    default:
+      chip8_.v_[reg & 0xF] = value;
+      break;
+  }
+}
+
+std::vector<uint8_t> Debugger::ReadMemory(uint32_t addr, uint32_t length) const {
+  std::vector<uint8_t> data(length);
+  for (uint32_t k = 0; k < length; ++k) data[k] = chip8_.mem_[(addr + k) & 0xFFFF];
+  return data;
+}
+
+void Debugger::WriteMemory(uint32_t addr, const std::vector<uint8_t>& data) {
+  for (uint32_t k = 0; k < data.size(); ++k) chip8_.WriteMemory((addr + k) & 0xFFFF, data[k]);
+}
+
+void Debugger::Continue() {
+  chip8_.SetSleeping(false);
+}
+
+void Debugger::Step() {
+  step_mode_ = StepMode::kStep;
+  UpdateActive();
+  Continue();
+}
+
+void Debugger::StepOver() {
+  const uint16_t inst = chip8_.GetNextInstruction();
+  if ((inst & 0xF000) != 0x2000) {
+    Step();
+    return;
+  }
+  step_mode_ = StepMode::kStepOver;
+  step_pc_ = chip8_.pc_ + 2;
+  step_sp_ = chip8_.sp_;
+  UpdateActive();
+  Continue();
+}
+
+void Debugger::RunToReturn() {
+  if (chip8_.sp_ == 0) {
+    printf("Debugger: not in a subroutine\n");
+    return;
+  }
+  step_mode_ = StepMode::kRunToReturn;
+  step_sp_ = chip8_.sp_;
+  UpdateActive();
+  Continue();
+}
+
+void Debugger::Kill() {
+  breakpoints_.clear();
+  watchpoints_.clear();
+  UpdateBreakpointBits();
+  UpdateWatchPages();
+  step_mode_ = StepMode::kNone;
+  chip8_.is_running_ = false;
+  chip8_.exit_success_ = false;
+  Continue();
+}
+
+void Debugger::Stop(const char* reason) {
+  step_mode_ = StepMode::kNone;
+  resume_ = true;  // the stopped instruction runs unchecked on the next resume
+  chip8_.SetSleeping(true);
+  UpdateActive();
+  printf("Debugger: stopped (%s)\n", reason);
+  PrintState();
+  if (gdb_stub_) gdb_stub_->NotifyStop();
+}
+
+void Debugger::UpdateActive() {
+  active_ = !breakpoints_.empty() || !watchpoints_.empty() || step_mode_ != StepMode::kNone;
+}
+
+bool Debugger::Matches(const Condition& condition) const {
+  const uint16_t value = ReadRegister(condition.reg);
+  switch (condition.op) {
+    case Operator::kEqual:
+      return value == condition.value;
+    case Operator::kNotEqual:
+      return value != condition.value;
+    case Operator::kLess:
+      return value < condition.value;
+    case Operator::kGreater:
+      return value > condition.value;
+    case Operator::kLessEqual:
+      return value <= condition.value;
+    case Operator::kGreaterEqual:
+      return value >= condition.value;
+  }
+  return false;
+}
+
+void Debugger::PrintState() const {
+  printf("  pc=0x%04X inst=0x%04X i=0x%04X sp=%d dt=%d st=%d\n ", chip8_.pc_, chip8_.GetNextInstruction(),
+    chip8_.i_, chip8_.sp_, chip8_.delay_timer_->GetRegisterValue(), chip8_.sound_timer_->GetRegisterValue());
+  for (int x = 0; x < 16; ++x) printf(" v%X=%02X", x, chip8_.v_[x]);
+  printf("\n");
+}
+
+void Debugger::PrintPoints() const {
+  for (const Breakpoint& breakpoint : breakpoints_) {
+    printf("  breakpoint 0x%04X", breakpoint.pc);
+    if (breakpoint.condition) {
+      const Condition& condition = *breakpoint.condition;
+      if (condition.reg < 16) {
+        printf(" if v%X", condition.reg);
+      } else {
+        printf(" if i");
+      }
+      printf(" %s 0x%X", OperatorToString(condition.op), condition.value);
+    }
+    printf("%s\n", breakpoint.owner == Owner::kGdb ? " (gdb)" : "");
+  }
+  for (const Watchpoint& watchpoint : watchpoints_) {
+    printf("  watchpoint 0x%04X-0x%04X %s%s%s\n", watchpoint.begin, watchpoint.end - 1,
+      watchpoint.read ? "r" : "", watchpoint.write ? "w" : "", watchpoint.owner == Owner::kGdb ? " (gdb)" : "");
+  }
+}
+
+void Debugger::Examine(uint32_t addr, uint32_t length) const {
+  for (uint32_t offset = 0; offset < length; offset += 16) {
+    printf("  %04X:", (addr + offset) & 0xFFFF);
+    for (uint32_t k = offset; k < std::min(offset + 16, length); ++k) {
+      printf(" %02X", chip8_.mem_[(addr + k) & 0xFFFF]);
+    }
+    printf("\n");
+  }
+}
+
+void Debugger::Execute(const std::string& command) {
+  std::istringstream iss{command};
+  std::string name;
+  if (!(iss >> name)) return;
+  std::string args[4];
+  int num_args = 0;
+  while (num_args < 4 && iss >> args[num_args]) ++num_args;
+
+  uint32_t first, second;
+  if (name == "b" && (num_args == 1 || num_args == 4) && ParseNumber(args[0], first) && first <= 0xFFFF) {
+    Breakpoint breakpoint{static_cast<uint16_t>(first), std::nullopt, Owner::kConsole};
+    if (num_args == 4) {
+      Condition condition;
+      const std::string& reg = args[1];
+      uint32_t value;
+      if (reg == "i" || reg == "I") {
+        condition.reg = kRegisterI;
+      } else if (reg.size() == 2 && (reg[0] == 'v' || reg[0] == 'V') && std::isxdigit(reg[1])) {
+        condition.reg = std::stoi(reg.substr(1), nullptr, 16);
+      } else {
+        printf("Debugger: invalid register %s\n", reg.c_str());
+        return;
+      }
+      if (!ParseOperator(args[2], condition.op) || !ParseNumber(args[3], value) || value > 0xFFFF) {
+        printf("Debugger: invalid condition\n");
+        return;
+      }
+      condition.value = static_cast<uint16_t>(value);
+      breakpoint.condition = condition;
+    }
+    AddBreakpoint(breakpoint);
+  } else if (name == "d" && num_args == 0) {
+    ClearBreakpoints(Owner::kConsole);
+  } else if (name == "d" && num_args == 1 && ParseNumber(args[0], first) && first <= 0xFFFF) {
+    RemoveBreakpoints(static_cast<uint16_t>(first), Owner::kConsole);
+  } else if (name == "w" && (num_args == 2 || num_args == 3) && (args[0] == "r" || args[0] == "w" || args[0] == "rw") &&
+             ParseNumber(args[1], first) && first <= 0xFFFF) {
+    second = first;
+    if (num_args == 3 && (!ParseNumber(args[2], second) || second < first || second > 0xFFFF)) {
+      printf("Debugger: invalid range\n");
+      return;
+    }
+    AddWatchpoint({first, second + 1, args[0] != "w", args[0] != "r", Owner::kConsole});
+  } else if (name == "u" && num_args == 0) {
+    ClearWatchpoints(Owner::kConsole);
+  } else if (name == "u" && num_args == 1 && ParseNumber(args[0], first)) {
+    RemoveWatchpoints(first, Owner::kConsole);
+  } else if (name == "c") {
+    Continue();
+  } else if (name == "s") {
+    Step();
+  } else if (name == "n") {
+    StepOver();
+  } else if (name == "f") {
+    RunToReturn();
+  } else if (name == "r") {
+    PrintState();
+  } else if (name == "x" && num_args >= 1 && ParseNumber(args[0], first)) {
+    if (num_args < 2 || !ParseNumber(args[1], second)) second = 16;
+    Examine(first, second);
+  } else if (name == "l") {
+    PrintPoints();
+  } else if (name == "h") {
+    printf("%s", kHelp);
+  } else {
+    printf("Debugger: invalid command, type h for help\n");
+  }
+  fflush(stdout);
+}
+
+} // namespace chip8_emu
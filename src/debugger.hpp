@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace chip8_emu {
+
+class Chip8;
+class GdbStub;
+
+struct DebuggerOptions {
+  bool console;  // read commands from stdin
+  int gdb_port;  // serve the GDB remote protocol on 127.0.0.1, 0 for none
+};
+
+// Breakpoints, watchpoints and stepping for Instrumentation::kDebugger.
+// Commands arrive from other threads (the stdin console, the GDB stub) and
+// are executed on the CPU thread between frames, so the machine state is
+// never shared.
+// A stop pauses the machine like Space does.
+class Debugger {
+ public:
+  enum class Operator { kEqual, kNotEqual, kLess, kGreater, kLessEqual, kGreaterEqual };
+  // Each front end removes only the points it added
+  enum class Owner { kConsole, kGdb };
+
+  struct Condition {
+    int reg;  // 0x0-0xF for Vx, kRegisterI for I
+    Operator op;
+    uint16_t value;
+  };
+
+  struct Breakpoint {
+    uint16_t pc;
+    std::optional<Condition> condition;
+    Owner owner;
+  };
+
+  struct Watchpoint {
+    uint32_t begin;  // [begin, end)
+    uint32_t end;
+    bool read;
+    bool write;
+    Owner owner;
+  };
+
+  // Register numbers: 0x0-0xF for Vx, then these
+  static constexpr int kRegisterI = 0x10;
+  static constexpr int kRegisterPc = 0x11;
+  static constexpr int kRegisterSp = 0x12;
+  static constexpr int kRegisterDt = 0x13;
+  static constexpr int kRegisterSt = 0x14;
+  static constexpr int kNumRegisters = 0x15;
+
+  Debugger(Chip8& chip8, const DebuggerOptions& options);
+  ~Debugger();
+  bool Start();  // starts the console and the GDB stub
+  void PostCommand(const std::string& command);  // thread-safe
+  void PostTask(std::function<void()> task);  // thread-safe, runs on the CPU thread
+  void ProcessCommands();  // CPU thread, between frames
+
+  // Any breakpoint, watchpoint or pending step. The plain engine runs otherwise.
+  bool IsActive() const;
+  // Called before every instruction while active. Returns true if the
+  // machine stopped before executing inst.
+  bool ShouldBreak(uint16_t inst);
+
+  // API shared by the console and remote front ends (CPU thread only)
+  void AddBreakpoint(const Breakpoint& breakpoint);
+  void RemoveBreakpoints(uint16_t pc, Owner owner);
+  void ClearBreakpoints(Owner owner);
+  void AddWatchpoint(const Watchpoint& watchpoint);
+  void RemoveWatchpoints(uint32_t addr, Owner owner);
+  void ClearWatchpoints(Owner owner);
+  uint16_t ReadRegister(int reg) const;
+  void WriteRegister(int reg, uint16_t value);
+  std::vector<uint8_t> ReadMemory(uint32_t addr, uint32_t length) const;  // wraps at 64 KB
+  void WriteMemory(uint32_t addr, const std::vector<uint8_t>& data);
+  void Continue();
+  void Step();
+  void StepOver();  // runs a 2nnn call to completion
+  void RunToReturn();
+  void Stop(const char* reason);
+  void Kill();  // ends the emulated program
+
+ private:
+  enum class StepMode { kNone, kStep, kStepOver, kRunToReturn };
+
+  void Execute(const std::string& command);
+  void UpdateActive();
+  void UpdateBreakpointBits();
+  void UpdateWatchPages();
+  void MarkWatchPages(const Watchpoint& watchpoint);
+  bool Matches(const Condition& condition) const;
+  void PrintState() const;
+  void PrintPoints() const;
+  void Examine(uint32_t addr, uint32_t length) const;
+
+  Chip8& chip8_;
+  DebuggerOptions options_;
+  std::vector<Breakpoint> breakpoints_;
+  std::vector<Watchpoint> watchpoints_;
+  std::array<uint64_t, 0x10000 / 64> breakpoint_bits_;  // bit per pc with any breakpoint
+  std::array<uint64_t, 0x100 / 64> watch_pages_;       // bit per 256-byte page with any watchpoint
+  StepMode step_mode_;
+  uint16_t step_pc_;  // return address for kStepOver
+  uint8_t step_sp_;   // stack depth when the step started
+  bool resume_;       // execute the stopped instruction without checks
+  bool active_;
+
+  // Shared with the detached console thread, which may outlive the debugger
+  struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+    std::function<void()> wake;  // makes an idle run loop take the tasks, empty once the debugger is gone
+  };
+  std::shared_ptr<TaskQueue> queue_;
+  std::unique_ptr<GdbStub> gdb_stub_;  // last, so that its thread stops first
+};
+
+} // namespace chip8_emu
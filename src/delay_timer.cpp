@@ -1,7 +1,8 @@
-#include <iostream>
+#include <cstdio>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 
 #include "delay_timer.hpp"
 
@@ -10,9 +11,11 @@ namespace chip8_emu {
 DelayTimer::DelayTimer(std::atomic_bool& is_sleeping)
     : dt_{0},
       mutex_{},
+      condition_{},
       thread_{},
       timer_is_running_{false},
-      system_is_sleeping_{is_sleeping} {
+      system_is_sleeping_{is_sleeping},
+      drift_{nullptr} {
 }
 
 DelayTimer::~DelayTimer() {
@@ -26,7 +29,17 @@ void DelayTimer::Start() {
   timer_is_running_ = true;
   thread_ = std::thread([this, interval] {
     while (timer_is_running_) {
+      {
+        // Block while the timer is 0 or the system sleeps, instead of waking at 60 Hz
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return !timer_is_running_ || (dt_ > 0 && !system_is_sleeping_); });
+      }
+      const auto sleep_start_time = std::chrono::steady_clock::now();
       std::this_thread::sleep_for(interval);
+      if (drift_) {
+        const auto late = std::chrono::steady_clock::now() - sleep_start_time - interval;
+        drift_->Record(std::chrono::duration_cast<std::chrono::nanoseconds>(late));
+      }
       if (system_is_sleeping_) {
         // stop timer
         continue;
@@ -36,6 +49,10 @@ void DelayTimer::Start() {
   });
 }
 
+void DelayTimer::SetDriftHistogram(Histogram* drift) {
+  drift_ = drift;
+}
+
 void DelayTimer::DecrementTimerValue() {
   std::lock_guard<std::mutex> lock(mutex_);
   if (dt_ > 0) {
@@ -46,6 +63,7 @@ void DelayTimer::DecrementTimerValue() {
 void DelayTimer::SetRegisterValue(uint8_t value) {
   std::lock_guard<std::mutex> lock(mutex_);
   dt_ = value;
+  condition_.notify_one();
 }
 
 uint8_t DelayTimer::GetRegisterValue() {
@@ -53,10 +71,17 @@ uint8_t DelayTimer::GetRegisterValue() {
   return dt_;
 }
 
+void DelayTimer::Wake() {
+  // Taking the mutex orders the change before the thread's next check
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  condition_.notify_one();
+}
+
 void DelayTimer::Terminate() {
   timer_is_running_ = false;
+  Wake();
   thread_.join();
-  std::cout << "Stopped DelayTimer" << std::endl;
+  std::puts("Stopped DelayTimer");
 }
 
 } // namespace chip8_emu
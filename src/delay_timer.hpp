@@ -1,10 +1,12 @@
 #pragma once
 
-#include <iostream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 
+#include "metrics.hpp"
+
 namespace chip8_emu {
 
 constexpr int kDelayTimerCycles = 60; // 60 Hz
@@ -14,18 +16,22 @@ class DelayTimer {
   DelayTimer(std::atomic_bool& is_sleeping);
   ~DelayTimer();
   void Start();
+  void SetDriftHistogram(Histogram* drift);  // records late ticks, before Start
   void SetRegisterValue(uint8_t value);
   uint8_t GetRegisterValue();
+  void DecrementTimerValue();  // called by the thread, or per frame with emulated timers
+  void Wake();  // re-checks the sleep state after it changed
   void Terminate();
 
  private:
-  void DecrementTimerValue();
 
   uint8_t dt_;
   std::mutex mutex_;
+  std::condition_variable condition_;  // the thread waits on it while there is nothing to count
   std::thread thread_;
   std::atomic_bool timer_is_running_;
   std::atomic_bool& system_is_sleeping_;
+  Histogram* drift_;
 };
 
 } // namespace chip8_emu
@@ -1,35 +1,342 @@
 #include <unistd.h>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
 
 #include "chip8.hpp"
+#include "bench.hpp"
+#include "lockstep.hpp"
+#include "input_log.hpp"
+#include "fuzz.hpp"
+#include "debugger.hpp"
+#include "golden.hpp"
+#include "recompiler.hpp"
+#include "explorer.hpp"
+#include "viewer.hpp"
+#include "core_pool.hpp"
 
 constexpr int kWindowScale = 15;  // change window size
+constexpr uint64_t kLockstepInstructions = 10000000;  // without -H
+constexpr uint64_t kFuzzInstructions = 10000;  // per execution without -H
+constexpr int kExploreStepFrames = 6;  // frames each explorer key state is held
+constexpr size_t kExploreMemoryMiB = 1024;  // without -M
+constexpr uint64_t kPoolInstructions = 100000;  // per instance without -H
+constexpr char kUsage[] = " [-d] [-t trace_path] [-r video_path] [-m shm_name] [-a frames] [-p] [-e] [-g] [-G port] [-c cycles] [-q quirks] [-u filter] [-R cells] [-o] [-S stats_path] [-w] [-H instructions] [-b instructions] [-s seed] [-k input_log] [-l engine -l engine [-i interval]] [-B memory_limit] [-f executions [-j jobs]] [-V|-U golden_manifest [-j jobs]] [-A translation_path] [-x depth [-M MiB] [-j jobs]] [-T instances [-j jobs]] [-P instances [-j jobs]] <rom_path>";
 
 int main(int argc, char** argv) {
   opterr = 0;
-  bool debug_mode = false;
+  int cycles = chip8_emu::kMainCycles;
+  std::optional<chip8_emu::Quirks> quirks;
+  chip8_emu::UpscaleFilter upscale_filter = chip8_emu::UpscaleFilter::kNearest;
+  std::optional<chip8_emu::TerminalCells> terminal_cells;
+  chip8_emu::Policy policy = chip8_emu::kDefaultPolicy;
+  uint64_t instruction_limit = 0;
+  uint64_t bench_instructions = 0;
+  std::string trace_path;
+  std::string video_path;
+  std::string shm_name;
+  int run_ahead = 0;
+  bool metrics_overlay = false;
+  bool watch_rom = false;
+  std::string stats_path;
+  std::optional<uint32_t> seed;
+  std::vector<chip8_emu::EngineSpec> engines;
+  uint64_t lockstep_interval = 1;
+  std::vector<chip8_emu::KeyEvent> input_log;
+  uint64_t fuzz_executions = 0;
+  uint32_t memory_limit = 0;
+  chip8_emu::DebuggerOptions debugger_options{false, 0};
+  std::string golden_manifest;
+  bool golden_update = false;
+  std::string translation_path;
+  int explore_depth = 0;
+  size_t explore_memory = kExploreMemoryMiB;
+  int viewer_instances = 0;
+  size_t pool_instances = 0;
+  int jobs = std::max(1u, std::thread::hardware_concurrency());
   int opt;
-  while ((opt = getopt(argc, argv, "d")) != -1) {
+  while ((opt = getopt(argc, argv, "dt:r:m:a:pegG:c:q:H:b:s:l:i:k:f:j:V:U:A:x:M:u:T:oS:wR:P:B:")) != -1) {
     switch (opt) {
       case 'd':
-        debug_mode = true;
+        policy.trace = chip8_emu::Trace::kText;
+        break;
+      case 't':
+        policy.trace = chip8_emu::Trace::kBinary;
+        trace_path = optarg;
+        break;
+      case 'r':
+        video_path = optarg;
+        break;
+      case 'm':
+        shm_name = optarg;
+        break;
+      case 'a':
+        run_ahead = std::atoi(optarg);
+        if (run_ahead <= 0) {
+          std::cerr << "Invalid run-ahead frames: " << optarg << std::endl;
+          return 1;
+        }
+        policy.timer_source = chip8_emu::TimerSource::kEmulated;
+        break;
+      case 'p':
+        policy.profile = true;
+        break;
+      case 'e':
+        policy.timer_source = chip8_emu::TimerSource::kEmulated;
+        break;
+      case 'g':
+        policy.instrumentation = chip8_emu::Instrumentation::kDebugger;
+        debugger_options.console = true;
+        break;
+      case 'G':
+        policy.instrumentation = chip8_emu::Instrumentation::kDebugger;
+        debugger_options.gdb_port = std::atoi(optarg);
+        if (debugger_options.gdb_port <= 0 || debugger_options.gdb_port > 0xFFFF) {
+          std::cerr << "Invalid port: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'c':
+        cycles = std::atoi(optarg);
+        if (cycles <= 0) {
+          std::cerr << "Invalid cycles: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'q':
+        quirks = chip8_emu::ParseQuirks(optarg);
+        if (!quirks) {
+          std::cerr << "Invalid quirks: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'u': {
+        auto filter = chip8_emu::ParseUpscaleFilter(optarg);
+        if (!filter) {
+          std::cerr << "Invalid filter: " << optarg << std::endl;
+          return 1;
+        }
+        upscale_filter = *filter;
+        break;
+      }
+      case 'R':
+        terminal_cells = chip8_emu::ParseTerminalCells(optarg);
+        if (!terminal_cells) {
+          std::cerr << "Invalid terminal cells: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'o':
+        metrics_overlay = true;
+        break;
+      case 'S':
+        stats_path = optarg;
+        break;
+      case 'w':
+        watch_rom = true;
+        break;
+      case 'H':
+        policy.display = chip8_emu::Display::kHeadless;
+        policy.timer_source = chip8_emu::TimerSource::kEmulated;
+        instruction_limit = std::strtoull(optarg, nullptr, 10);
+        break;
+      case 'b':
+        bench_instructions = std::strtoull(optarg, nullptr, 10);
+        break;
+      case 's':
+        seed = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10));
+        break;
+      case 'l': {
+        auto engine = chip8_emu::ParseEngine(optarg);
+        if (!engine) {
+          std::cerr << "Invalid engine: " << optarg << std::endl;
+          return 1;
+        }
+        engines.push_back(*engine);
+        break;
+      }
+      case 'i':
+        lockstep_interval = std::strtoull(optarg, nullptr, 10);
+        if (lockstep_interval == 0) {
+          std::cerr << "Invalid interval: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'k': {
+        auto events = chip8_emu::LoadInputLog(optarg);
+        if (!events) return 1;
+        input_log = std::move(*events);
+        break;
+      }
+      case 'f':
+        fuzz_executions = std::strtoull(optarg, nullptr, 10);
+        break;
+      case 'B':
+        memory_limit = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 0));
+        if (memory_limit <= 0x200 || memory_limit > chip8_emu::kMemorySize) {
+          std::cerr << "Invalid memory limit: " << optarg << std::endl;
+          return 1;
+        }
+        policy.instrumentation = chip8_emu::Instrumentation::kCoverage;
+        break;
+      case 'V':
+      case 'U':
+        golden_manifest = optarg;
+        golden_update = opt == 'U';
+        break;
+      case 'A':
+        translation_path = optarg;
+        break;
+      case 'x':
+        explore_depth = std::atoi(optarg);
+        if (explore_depth <= 0) {
+          std::cerr << "Invalid depth: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'M':
+        explore_memory = std::strtoull(optarg, nullptr, 10);
+        if (explore_memory == 0) {
+          std::cerr << "Invalid memory budget: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'T':
+        viewer_instances = std::atoi(optarg);
+        if (viewer_instances <= 0) {
+          std::cerr << "Invalid instances: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'P':
+        pool_instances = std::strtoull(optarg, nullptr, 10);
+        if (pool_instances == 0 || pool_instances > UINT32_MAX) {
+          std::cerr << "Invalid instances: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'j':
+        jobs = std::atoi(optarg);
+        if (jobs <= 0) {
+          std::cerr << "Invalid jobs: " << optarg << std::endl;
+          return 1;
+        }
         break;
       default:
-        std::cerr << "Usage: " << argv[0] << " [-d] <rom_path>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << kUsage << std::endl;
         return 1;
     }
   }
 
+  if (!golden_manifest.empty()) {
+    return chip8_emu::RunGoldenSuite(golden_manifest, {golden_update, jobs}) ? 0 : 1;
+  }
+
   if (optind >= argc) {
-    std::cerr << "Usage: " << argv[0] << " [-d] <rom_path>" << std::endl;
+    std::cerr << "Usage: " << argv[0] << kUsage << std::endl;
+    return 1;
+  }
+  if (!translation_path.empty()) {
+    return chip8_emu::WriteTranslation(argv[optind], quirks, translation_path) ? 0 : 1;
+  }
+  if (chip8_emu::FindPolicy(policy) == chip8_emu::kPolicies.size()) {
+    std::cerr << "-d, -t and -p cannot be combined, -g and -G cannot be combined with -d, -t, -p, -e, -a or -H, "
+      "and -B needs -H alone" << std::endl;
     return 1;
   }
+  if (terminal_cells && debugger_options.console) {
+    std::cerr << "-R and -g cannot be combined, as both read stdin" << std::endl;
+    return 1;
+  }
+
+  if (bench_instructions > 0) {
+    chip8_emu::RunBenchmark(argv[optind], bench_instructions, cycles);
+    return 0;
+  }
 
-  auto chip8 = std::make_unique<chip8_emu::Chip8>(debug_mode);
+  if (fuzz_executions > 0) {
+    const chip8_emu::FuzzOptions options{
+      fuzz_executions, instruction_limit > 0 ? instruction_limit : kFuzzInstructions, jobs, cycles,
+      seed.value_or(0), quirks};
+    chip8_emu::RunFuzzer(argv[optind], options);
+    return 0;
+  }
+
+  if (explore_depth > 0) {
+    const chip8_emu::ExploreOptions options{
+      explore_depth, kExploreStepFrames, explore_memory << 20, jobs, cycles, seed.value_or(0), quirks};
+    chip8_emu::RunExplorer(argv[optind], options);
+    return 0;
+  }
+
+  if (pool_instances > 0) {
+    const chip8_emu::CorePoolOptions options{
+      pool_instances, instruction_limit > 0 ? instruction_limit : kPoolInstructions, jobs, cycles,
+      seed.value_or(0), quirks, input_log};
+    return chip8_emu::RunCorePool(argv[optind], options) ? 0 : 1;
+  }
+
+  if (viewer_instances > 0) {
+    const chip8_emu::ViewerOptions options{viewer_instances, jobs, cycles, seed.value_or(0), quirks, input_log};
+    return chip8_emu::RunViewer(argv[optind], options) ? 0 : 1;
+  }
+
+  if (!engines.empty()) {
+    if (engines.size() != 2) {
+      std::cerr << "Lockstep needs exactly two engines" << std::endl;
+      return 1;
+    }
+    const chip8_emu::LockstepOptions options{
+      instruction_limit > 0 ? instruction_limit : kLockstepInstructions,
+      lockstep_interval, seed.value_or(0), cycles, quirks, input_log};
+    return chip8_emu::RunLockstep(argv[optind], engines[0], engines[1], options) ? 0 : 1;
+  }
+
+  // Instrumentation::kCoverage records edges too, though -B only wants the bounds checks
+  std::vector<uint8_t> coverage_map;
+  auto chip8 = std::make_unique<chip8_emu::Chip8>(cycles);
 
   chip8->LoadROM(argv[optind]);
-  chip8->InitializeWindow(kWindowScale);
+  if (quirks) chip8->SetQuirks(*quirks);
+  if (seed) chip8->SetSeed(*seed);
+  chip8->SetInputLog(input_log);
+  chip8->SetPolicy(policy);
+  if (policy.instrumentation == chip8_emu::Instrumentation::kDebugger && !chip8->EnableDebugger(debugger_options)) {
+    return 1;
+  }
+  if (policy.instrumentation == chip8_emu::Instrumentation::kCoverage) {
+    coverage_map.resize(chip8_emu::kCoverageMapSize);
+    chip8->SetCoverage(coverage_map.data(), memory_limit);
+  }
+  if (policy.trace == chip8_emu::Trace::kBinary && !chip8->OpenTrace(trace_path)) {
+    return 1;
+  }
+  if (!video_path.empty() && !chip8->OpenVideo(video_path)) {
+    return 1;
+  }
+  if (!shm_name.empty() && !chip8->OpenSharedState(shm_name)) {
+    return 1;
+  }
+  if ((metrics_overlay || !stats_path.empty()) && !chip8->EnableMetrics(metrics_overlay, stats_path)) {
+    return 1;
+  }
+  chip8->SetRunAhead(run_ahead);
+  if (policy.display == chip8_emu::Display::kHeadless) {
+    chip8->SetInstructionLimit(instruction_limit);
+  } else if (terminal_cells) {
+    if (!chip8->InitializeTerminal(*terminal_cells)) return 1;
+    if (watch_rom && !chip8->WatchROM()) return 1;
+  } else {
+    chip8->InitializeWindow(kWindowScale, upscale_filter);
+    if (watch_rom && !chip8->WatchROM()) return 1;
+  }
   bool success = chip8->Run();
   if (!success) {
     std::cerr << "Exit with error" << std::endl;
@@ -0,0 +1,271 @@
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "explorer.hpp"
+#include "chip8.hpp"
+#include "quirks.hpp"
+#include "input_log.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+const std::string kExploreOutputDirectory{"explore_out"};
+constexpr uint8_t kNoKey = 16;  // key state of a step without a key held
+constexpr size_t kScreenTableSlots = 1 << 20;
+constexpr size_t kMaxScreenLogs = 1000;
+
+// Open-addressed set of 64-bit hashes, inserted into concurrently. It never
+// grows: past three quarters full every insertion reports kFull.
+class HashSet {
+ public:
+  enum class Result { kNew, kDuplicate, kFull };
+
+  explicit HashSet(size_t slots);
+  Result Insert(uint64_t hash);
+  size_t GetSize() const { return size_.load(std::memory_order_relaxed); }
+
+ private:
+  std::vector<std::atomic<uint64_t>> slots_;  // 0 is empty
+  std::atomic<size_t> size_;
+};
+
+HashSet::HashSet(size_t slots) : slots_(std::bit_floor(std::max<size_t>(slots, 1024))), size_{0} {}
+
+HashSet::Result HashSet::Insert(uint64_t hash) {
+  if (hash == 0) hash = 1;
+  const size_t mask = slots_.size() - 1;
+  for (size_t index = hash & mask;; index = (index + 1) & mask) {
+    uint64_t slot = slots_[index].load(std::memory_order_relaxed);
+    if (slot == hash) return Result::kDuplicate;
+    if (slot != 0) continue;
+    if (size_.load(std::memory_order_relaxed) >= slots_.size() / 4 * 3) return Result::kFull;
+    if (slots_[index].compare_exchange_strong(slot, hash, std::memory_order_relaxed)) {
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return Result::kNew;
+    }
+    if (slot == hash) return Result::kDuplicate;  // lost the race to the same state
+  }
+}
+
+// How a state was reached: its parent in the previous level and the key
+// state of the step from there
+struct Node {
+  uint32_t parent;
+  uint8_t key;
+};
+
+// Expanded states at one depth. Leaves are only needed for their own input
+// log, so they are not kept.
+struct Level {
+  std::vector<Node> nodes;
+  std::vector<std::unique_ptr<Chip8::Snapshot>> snapshots;  // freed once the next level is built
+};
+
+class Explorer {
+ public:
+  Explorer(const std::vector<uint8_t>& rom, const Quirks& quirks, const ExploreOptions& options);
+  void Run();
+
+ private:
+  void ExpandLevel(size_t depth, Level& next);
+  void ExpandNodes(size_t depth, Chip8& chip8, Level& next);
+  void WriteScreenLog(size_t depth, Node node, size_t screen);
+  std::unique_ptr<Chip8> CreateMachine() const;
+
+  const std::vector<uint8_t>& rom_;
+  const Quirks quirks_;
+  const ExploreOptions& options_;
+  size_t max_frontier_;
+  HashSet states_;
+  HashSet screens_;
+  std::vector<Level> levels_;  // levels_[d] holds the nodes d steps from reset
+  std::vector<std::unique_ptr<Chip8>> machines_;  // one per job
+
+  std::atomic<size_t> next_node_;
+  std::atomic<size_t> frontier_size_;
+  std::atomic<uint64_t> executions_;
+  std::atomic<uint64_t> stopped_;
+  std::atomic<uint64_t> pruned_;
+  std::atomic<uint64_t> unexpanded_;
+  std::atomic<size_t> screen_logs_;
+};
+
+Explorer::Explorer(const std::vector<uint8_t>& rom, const Quirks& quirks, const ExploreOptions& options)
+    : rom_{rom},
+      quirks_{quirks},
+      options_{options},
+      // An eighth of the budget for the table, the rest for two levels of snapshots
+      max_frontier_{std::max<size_t>(options.memory_budget / 8 * 7 / (2 * sizeof(Chip8::Snapshot)), 1)},
+      states_{options.memory_budget / 8 / sizeof(uint64_t)},
+      screens_{kScreenTableSlots},
+      levels_{},
+      machines_{},
+      next_node_{0},
+      frontier_size_{0},
+      executions_{0},
+      stopped_{0},
+      pruned_{0},
+      unexpanded_{0},
+      screen_logs_{0} {}
+
+std::unique_ptr<Chip8> Explorer::CreateMachine() const {
+  auto chip8 = std::make_unique<Chip8>(options_.cycles);
+  chip8->SetQuirks(quirks_);
+  chip8->SetSeed(options_.seed);
+  chip8->LoadProgram(rom_);
+  return chip8;
+}
+
+void Explorer::Run() {
+  const auto start_time = std::chrono::steady_clock::now();
+  for (int j = 0; j < options_.jobs; ++j) machines_.push_back(CreateMachine());
+  Level root;
+  root.nodes.push_back({0, kNoKey});
+  root.snapshots.push_back(std::make_unique<Chip8::Snapshot>());
+  machines_[0]->SaveSnapshot(*root.snapshots.back());
+  states_.Insert(machines_[0]->GetStateHash());
+  screens_.Insert(machines_[0]->GetFrameBuffer().GetHash());
+  levels_.push_back(std::move(root));
+
+  for (size_t depth = 0; depth < static_cast<size_t>(options_.depth) && !levels_.back().snapshots.empty(); ++depth) {
+    Level next;
+    ExpandLevel(depth, next);
+    levels_.back().snapshots.clear();  // only the nodes are needed from now on
+    levels_.push_back(std::move(next));
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    printf("Explore: depth %zu, %zu frontier, %zu states, %zu screens, %llu pruned, %.1f s\n",
+      depth + 1, levels_.back().snapshots.size(), states_.GetSize(), screens_.GetSize(),
+      static_cast<unsigned long long>(pruned_.load()), elapsed.count());
+  }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+  printf("Explore: %llu executions of %d frames (%.0f per second), %llu stopped, %llu not expanded for lack of memory\n",
+    static_cast<unsigned long long>(executions_.load()), options_.step_frames, executions_.load() / elapsed.count(),
+    static_cast<unsigned long long>(stopped_.load()), static_cast<unsigned long long>(unexpanded_.load()));
+  if (screens_.GetSize() > 1) {
+    printf("Explore: input logs of new screens written to %s/\n", kExploreOutputDirectory.c_str());
+  }
+}
+
+void Explorer::ExpandLevel(size_t depth, Level& next) {
+  next_node_ = 0;
+  frontier_size_ = 0;
+  std::vector<Level> parts(options_.jobs);
+  std::vector<std::thread> threads;
+  for (int j = 0; j < options_.jobs; ++j) {
+    threads.emplace_back([this, depth, j, &part = parts[j]] { ExpandNodes(depth, *machines_[j], part); });
+  }
+  for (auto& thread : threads) thread.join();
+
+  for (Level& part : parts) {
+    next.nodes.insert(next.nodes.end(), part.nodes.begin(), part.nodes.end());
+    std::move(part.snapshots.begin(), part.snapshots.end(), std::back_inserter(next.snapshots));
+  }
+}
+
+void Explorer::ExpandNodes(size_t depth, Chip8& chip8, Level& next) {
+  const Level& level = levels_[depth];
+  const uint64_t first_frame = depth * options_.step_frames;
+  const bool expand = depth + 1 < static_cast<size_t>(options_.depth);
+
+  for (size_t index = next_node_++; index < level.snapshots.size(); index = next_node_++) {
+    for (uint8_t key = 0; key <= kNoKey; ++key) {
+      chip8.LoadSnapshot(*level.snapshots[index]);
+      for (uint8_t k = 0; k < 16; ++k) chip8.SetKey(k, k == key);
+      for (uint64_t frame = first_frame; frame < first_frame + options_.step_frames && chip8.IsRunning(); ++frame) {
+        const uint64_t budget = chip8.BeginFrame(frame);
+        for (uint64_t n = 0; n < budget && chip8.IsRunning(); ++n) chip8.Step();
+      }
+      ++executions_;
+
+      const Node node{static_cast<uint32_t>(index), key};
+      const HashSet::Result result = states_.Insert(chip8.GetStateHash());
+      if (result == HashSet::Result::kDuplicate) {
+        ++pruned_;
+        continue;
+      }
+      if (screens_.Insert(chip8.GetFrameBuffer().GetHash()) == HashSet::Result::kNew) {
+        WriteScreenLog(depth, node, ++screen_logs_);
+      }
+      if (!chip8.IsRunning()) {
+        ++stopped_;
+      } else if (expand && result == HashSet::Result::kNew && frontier_size_++ < max_frontier_) {
+        next.nodes.push_back(node);
+        next.snapshots.push_back(std::make_unique<Chip8::Snapshot>());
+        chip8.SaveSnapshot(*next.snapshots.back());
+      } else if (expand) {
+        ++unexpanded_;
+      }
+    }
+  }
+}
+
+void Explorer::WriteScreenLog(size_t depth, Node node, size_t screen) {
+  if (screen > kMaxScreenLogs) return;
+
+  // Key states of the steps from reset, first step first
+  std::vector<uint8_t> keys(depth + 1);
+  keys[depth] = node.key;
+  for (size_t d = depth; d > 0; --d) {
+    node = levels_[d].nodes[node.parent];
+    keys[d - 1] = node.key;
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "screen_%04zu.keys", screen);
+  const std::string path = kExploreOutputDirectory + "/" + name;
+  std::filesystem::create_directories(kExploreOutputDirectory);
+  std::ofstream ofs{path};
+  ofs << "# frame key pressed\n";
+  uint8_t held = kNoKey;
+  for (size_t step = 0; step < keys.size(); ++step) {
+    if (keys[step] == held) continue;
+    const uint64_t frame = step * options_.step_frames;
+    if (held != kNoKey) ofs << frame << ' ' << std::hex << static_cast<int>(held) << std::dec << " 0\n";
+    if (keys[step] != kNoKey) ofs << frame << ' ' << std::hex << static_cast<int>(keys[step]) << std::dec << " 1\n";
+    held = keys[step];
+  }
+
+  const uint64_t frames = keys.size() * options_.step_frames;
+  printf("Explore: screen %zu after %llu frames: ./emu -H %llu -c %d -s %u -q %s -k %s <rom>\n", screen,
+    static_cast<unsigned long long>(frames),
+    static_cast<unsigned long long>(static_cast<uint64_t>(options_.cycles) * frames / kFrameRate),
+    options_.cycles, options_.seed, QuirksToString(quirks_).c_str(), path.c_str());
+}
+
+}  // namespace
+
+void RunExplorer(const std::string& rom, const ExploreOptions& options) {
+  std::ifstream ifs{rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    fprintf(stderr, "Failed to open ROM: %s\n", rom.c_str());
+    return;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  if (0x200 + data.size() > kMemorySize) {
+    fprintf(stderr, "ROM size is too large\n");
+    return;
+  }
+  const Quirks quirks = options.quirks.value_or(LookUpQuirks(Sha1(data)).value_or(kChip8Quirks));
+
+  printf("Explore: %d steps of %d frames on %d jobs, %zu MiB\n", options.depth, options.step_frames,
+    options.jobs, options.memory_budget >> 20);
+  Explorer explorer{data, quirks, options};
+  explorer.Run();
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <optional>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+struct ExploreOptions {
+  int depth;             // steps from reset
+  int step_frames;       // frames each step holds its key state
+  size_t memory_budget;  // bytes for the frontier snapshots and the transposition table
+  int jobs;
+  int cycles;
+  uint32_t seed;
+  std::optional<Quirks> quirks;  // ROM database quirks if empty
+};
+
+// State-space explorer. From reset, every step branches into 17 key states
+// (no key, or one of the 16 held alone) held for step_frames frames, breadth
+// first, with the frontier expanded in parallel on jobs threads. Each
+// reached machine state is hashed with Chip8::GetStateHash into a lock-free
+// transposition table shared by the jobs, and duplicates are pruned. When
+// the next frontier or the table fills memory_budget, new states are still
+// counted but no longer expanded. For every display seen for the first time
+// an input log that reaches it is written to kExploreOutputDirectory, to be
+// replayed with -H, -s and -k.
+void RunExplorer(const std::string& rom, const ExploreOptions& options);
+
+} // namespace chip8_emu
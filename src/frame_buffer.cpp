@@ -0,0 +1,159 @@
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+
+#include "frame_buffer.hpp"
+#include "utils.hpp"
+
+namespace chip8_emu {
+
+FrameBuffer::FrameBuffer()
+    : planes_{},
+      high_resolution_{false},
+      selected_planes_{0x1},
+      dirty_rows_{},
+      row_hashes_{},
+      hash_{0} {
+  dirty_rows_.fill(~0ULL);
+}
+
+void FrameBuffer::Clear() {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    if (selected_planes_ & (1 << p)) {
+      planes_[p].fill({}); // 0-fill
+      MarkDirty(p, ~0ULL);
+    }
+  }
+}
+
+void FrameBuffer::SetHighResolution(bool high_resolution) {
+  high_resolution_ = high_resolution;
+  for (auto& plane : planes_) plane.fill({});
+  dirty_rows_.fill(~0ULL);
+}
+
+bool FrameBuffer::IsHighResolution() const {
+  return high_resolution_;
+}
+
+void FrameBuffer::SelectPlanes(uint8_t mask) {
+  selected_planes_ = mask & ((1 << kNumPlanes) - 1);
+}
+
+uint8_t FrameBuffer::GetSelectedPlanes() const {
+  return selected_planes_;
+}
+
+int FrameBuffer::GetWidth() const {
+  return high_resolution_ ? kHighResWidth : kLowResWidth;
+}
+
+int FrameBuffer::GetHeight() const {
+  return high_resolution_ ? kHighResHeight : kLowResHeight;
+}
+
+uint8_t FrameBuffer::GetPixel(int x, int y) const {
+  const int shift = 63 - (x & 63);
+  uint8_t color = 0;
+  for (int p = 0; p < kNumPlanes; ++p) {
+    color |= ((planes_[p][y][x >> 6] >> shift) & 1) << p;
+  }
+  return color;
+}
+
+const FrameBuffer::Row& FrameBuffer::GetRow(int plane, int y) const {
+  return planes_[plane][y];
+}
+
+uint64_t FrameBuffer::GetHash() const {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    for (uint64_t rows = dirty_rows_[p]; rows != 0; rows &= rows - 1) {
+      const int y = std::countr_zero(rows);
+      const Row& row = planes_[p][y];
+      hash_ ^= row_hashes_[p][y];
+      row_hashes_[p][y] = Mix64(row[0] ^ Mix64(row[1] ^ Mix64(p * kHighResHeight + y + 1)));
+      hash_ ^= row_hashes_[p][y];
+    }
+    dirty_rows_[p] = 0;
+  }
+  return Mix64(hash_ ^ (high_resolution_ ? 1 : 0) ^ (selected_planes_ << 1));
+}
+
+void FrameBuffer::MarkDirty(int plane, uint64_t rows) {
+  dirty_rows_[plane] |= rows;
+}
+
+void FrameBuffer::SetRow(int plane, int y, const Row& row) {
+  planes_[plane][y] = row;
+  MarkDirty(plane, 1ULL << y);
+}
+
+bool FrameBuffer::DrawRow(int plane, int x, int y, uint16_t bits) {
+  MarkDirty(plane, 1ULL << y);
+  return DrawPlaneRow(planes_[plane], high_resolution_, x, y, bits);
+}
+
+bool FrameBuffer::DrawRowWrapped(int plane, int x, int y, uint16_t bits) {
+  MarkDirty(plane, 1ULL << y);
+  return DrawPlaneRowWrapped(planes_[plane], high_resolution_, x, y, bits);
+}
+
+void FrameBuffer::ScrollDown(int n) {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    if (!(selected_planes_ & (1 << p))) continue;
+    ScrollPlaneDown(planes_[p], GetHeight(), n);
+    MarkDirty(p, ~0ULL);
+  }
+}
+
+void FrameBuffer::ScrollUp(int n) {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    if (!(selected_planes_ & (1 << p))) continue;
+    ScrollPlaneUp(planes_[p], GetHeight(), n);
+    MarkDirty(p, ~0ULL);
+  }
+}
+
+void FrameBuffer::ScrollRight() {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    if (!(selected_planes_ & (1 << p))) continue;
+    ScrollPlaneRight(planes_[p], high_resolution_);
+    MarkDirty(p, ~0ULL);
+  }
+}
+
+void FrameBuffer::ScrollLeft() {
+  for (int p = 0; p < kNumPlanes; ++p) {
+    if (!(selected_planes_ & (1 << p))) continue;
+    ScrollPlaneLeft(planes_[p]);
+    MarkDirty(p, ~0ULL);
+  }
+}
+
+void ScrollPlaneDown(FrameBuffer::Plane& plane, int height, int n) {
+  n = std::min(n, height);
+  std::copy_backward(plane.begin(), plane.begin() + height - n, plane.begin() + height);
+  std::fill(plane.begin(), plane.begin() + n, FrameBuffer::Row{});
+}
+
+void ScrollPlaneUp(FrameBuffer::Plane& plane, int height, int n) {
+  n = std::min(n, height);
+  std::copy(plane.begin() + n, plane.begin() + height, plane.begin());
+  std::fill(plane.begin() + height - n, plane.begin() + height, FrameBuffer::Row{});
+}
+
+void ScrollPlaneRight(FrameBuffer::Plane& plane, bool high_resolution) {
+  for (FrameBuffer::Row& row : plane) {
+    row[1] = high_resolution ? (row[1] >> 4) | (row[0] << 60) : 0;
+    row[0] >>= 4;
+  }
+}
+
+void ScrollPlaneLeft(FrameBuffer::Plane& plane) {
+  for (FrameBuffer::Row& row : plane) {
+    row[0] = (row[0] << 4) | (row[1] >> 60);
+    row[1] <<= 4;
+  }
+}
+
+} // namespace chip8_emu
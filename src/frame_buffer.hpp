@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <bit>
+
+namespace chip8_emu {
+
+constexpr int kLowResWidth = 64;
+constexpr int kLowResHeight = 32;
+constexpr int kHighResWidth = 128;   // SUPER-CHIP
+constexpr int kHighResHeight = 64;   // SUPER-CHIP
+constexpr int kNumPlanes = 4;        // XO-CHIP bit planes (16 colors)
+
+// Display that can switch between 64x32 and 128x64 and holds up to four
+// 1-bit planes. Each plane row is packed into two 64-bit words
+// (MSB = leftmost pixel) so that sprite blits and scrolls operate on whole
+// words instead of single pixels.
+class FrameBuffer {
+ public:
+  using Row = std::array<uint64_t, 2>;
+  using Plane = std::array<Row, kHighResHeight>;
+
+  FrameBuffer();
+  void Clear();  // selected planes only
+  void SetHighResolution(bool high_resolution);
+  bool IsHighResolution() const;
+  void SelectPlanes(uint8_t mask);
+  uint8_t GetSelectedPlanes() const;
+  int GetWidth() const;
+  int GetHeight() const;
+  uint8_t GetPixel(int x, int y) const;  // color index combined from all planes
+  const Row& GetRow(int plane, int y) const;
+  void SetRow(int plane, int y, const Row& row);
+  // Hash of the whole display. Rows are marked dirty when written and only
+  // dirty rows are rehashed, so calling this every instruction is cheap.
+  uint64_t GetHash() const;
+
+  // XOR a left-aligned sprite row (bit 15 = leftmost pixel) at (x, y) on one plane.
+  // Pixels beyond the right edge are clipped. Returns true on collision.
+  bool DrawRow(int plane, int x, int y, uint16_t bits);
+  // Same as DrawRow, but pixels beyond the right edge wrap around to the left edge.
+  bool DrawRowWrapped(int plane, int x, int y, uint16_t bits);
+
+  // Scrolls apply to the selected planes only.
+  void ScrollDown(int n);
+  void ScrollUp(int n);  // XO-CHIP
+  void ScrollRight();    // 4 pixels
+  void ScrollLeft();     // 4 pixels
+
+ private:
+  void MarkDirty(int plane, uint64_t rows);
+
+  std::array<Plane, kNumPlanes> planes_;
+  bool high_resolution_;
+  uint8_t selected_planes_;
+
+  mutable std::array<uint64_t, kNumPlanes> dirty_rows_;  // bit y is set if row y changed since GetHash
+  mutable std::array<std::array<uint64_t, kHighResHeight>, kNumPlanes> row_hashes_;
+  mutable uint64_t hash_;  // XOR of row_hashes_
+};
+
+// The row and scroll operations of FrameBuffer on a single plane, without
+// dirty tracking, for CoreState's display. Rows beyond 64 pixels and 32 lines
+// are unused in low resolution. The row operations are inline, since the
+// compact core draws through them in its hot loop.
+inline bool DrawPlaneRow(FrameBuffer::Plane& plane, bool high_resolution, int x, int y, uint16_t bits) {
+  const uint64_t line = static_cast<uint64_t>(bits) << 48;
+  uint64_t left = 0, right = 0;
+  if (x < 64) {
+    left = line >> x;
+    right = x == 0 ? 0 : line << (64 - x);
+  } else {
+    right = line >> (x - 64);
+  }
+  if (!high_resolution) right = 0;  // clip at the 64th column
+
+  FrameBuffer::Row& row = plane[y];
+  const bool collision = ((row[0] & left) | (row[1] & right)) != 0;
+  row[0] ^= left;
+  row[1] ^= right;
+  return collision;
+}
+
+inline bool DrawPlaneRowWrapped(FrameBuffer::Plane& plane, bool high_resolution, int x, int y, uint16_t bits) {
+  // Rotate the row right by x within the current width.
+  const uint64_t line = static_cast<uint64_t>(bits) << 48;
+  uint64_t left = 0, right = 0;
+  if (!high_resolution) {
+    left = std::rotr(line, x);
+  } else if (x < 64) {
+    left = line >> x;
+    right = x == 0 ? 0 : line << (64 - x);
+  } else {
+    left = x == 64 ? 0 : line << (128 - x);
+    right = line >> (x - 64);
+  }
+
+  FrameBuffer::Row& row = plane[y];
+  const bool collision = ((row[0] & left) | (row[1] & right)) != 0;
+  row[0] ^= left;
+  row[1] ^= right;
+  return collision;
+}
+
+void ScrollPlaneDown(FrameBuffer::Plane& plane, int height, int n);
+void ScrollPlaneUp(FrameBuffer::Plane& plane, int height, int n);
+void ScrollPlaneRight(FrameBuffer::Plane& plane, bool high_resolution);
+void ScrollPlaneLeft(FrameBuffer::Plane& plane);
+
+} // namespace chip8_emu
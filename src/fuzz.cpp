@@ -0,0 +1,341 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#include "fuzz.hpp"
+#include "chip8.hpp"
+#include "quirks.hpp"
+#include "input_log.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+const std::string kFuzzOutputDirectory{"fuzz_out"};
+constexpr int kMaxMutations = 4;      // stacked per execution
+constexpr size_t kMaxKeyEvents = 64;
+
+// Random instructions are drawn from these patterns so that most of them decode
+struct OpcodeTemplate {
+  uint16_t pattern;
+  uint16_t operands;
+};
+
+constexpr OpcodeTemplate kOpcodeTemplates[] = {
+  {0x00C0, 0x000F}, {0x00D0, 0x000F}, {0x00E0, 0x0000}, {0x00EE, 0x0000}, {0x00FB, 0x0000},
+  {0x00FC, 0x0000}, {0x00FD, 0x0000}, {0x00FE, 0x0000}, {0x00FF, 0x0000}, {0x1000, 0x0FFF},
+  {0x2000, 0x0FFF}, {0x3000, 0x0FFF}, {0x4000, 0x0FFF}, {0x5000, 0x0FF0}, {0x5002, 0x0FF0},
+  {0x5003, 0x0FF0}, {0x6000, 0x0FFF}, {0x7000, 0x0FFF}, {0x8000, 0x0FF0}, {0x8001, 0x0FF0},
+  {0x8002, 0x0FF0}, {0x8003, 0x0FF0}, {0x8004, 0x0FF0}, {0x8005, 0x0FF0}, {0x8006, 0x0FF0},
+  {0x8007, 0x0FF0}, {0x800E, 0x0FF0}, {0x9000, 0x0FF0}, {0xA000, 0x0FFF}, {0xB000, 0x0FFF},
+  {0xC000, 0x0FFF}, {0xD000, 0x0FFF}, {0xE09E, 0x0F00}, {0xE0A1, 0x0F00}, {0xF000, 0x0000},
+  {0xF001, 0x0F00}, {0xF002, 0x0000}, {0xF007, 0x0F00}, {0xF00A, 0x0F00}, {0xF015, 0x0F00},
+  {0xF018, 0x0F00}, {0xF01E, 0x0F00}, {0xF029, 0x0F00}, {0xF030, 0x0F00}, {0xF033, 0x0F00},
+  {0xF03A, 0x0F00}, {0xF055, 0x0F00}, {0xF065, 0x0F00}, {0xF075, 0x0F00}, {0xF085, 0x0F00},
+};
+
+constexpr uint8_t kInterestingBytes[] = {0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xF0, 0xFF};
+
+// Hit counts are compared in buckets so that loops do not flood the corpus
+constexpr std::array<uint8_t, 256> kHitBuckets = [] {
+  std::array<uint8_t, 256> buckets{};
+  for (int hits = 1; hits < 256; ++hits) {
+    buckets[hits] = hits == 1 ? 1 : hits == 2 ? 2 : hits == 3 ? 4 : hits < 8 ? 8 :
+                    hits < 16 ? 16 : hits < 32 ? 32 : hits < 128 ? 64 : 128;
+  }
+  return buckets;
+}();
+
+struct FuzzInput {
+  std::vector<uint8_t> rom;
+  std::vector<KeyEvent> keys;  // sorted by frame
+};
+
+// State shared by all jobs
+struct FuzzCorpus {
+  std::mutex mutex;
+  std::vector<FuzzInput> inputs;
+  std::set<std::pair<Fault, uint16_t>> faults;  // reported (fault, opcode kind)
+  std::atomic<uint64_t> invalid_instructions{0};  // expected from random bytes, counted only
+  std::array<std::atomic<uint8_t>, kCoverageMapSize> seen_buckets{};
+  std::atomic<uint64_t> executions{0};
+  std::atomic<uint64_t> edges{0};
+};
+
+class FuzzJob {
+ public:
+  FuzzJob(const FuzzOptions& options, const Quirks& quirks, uint32_t memory_limit, FuzzCorpus& corpus,
+          uint64_t seed);
+  void Run();
+
+ private:
+  Fault Execute(const FuzzInput& input);
+  bool HasNewCoverage();
+  void Mutate(FuzzInput& input);
+  FuzzInput Minimize(FuzzInput input, Fault fault, uint16_t pc);
+  void Report(const FuzzInput& input, Fault fault, uint16_t pc, uint16_t kind);
+
+  const FuzzOptions& options_;
+  const Quirks quirks_;
+  const uint32_t memory_limit_;
+  const uint64_t frames_;  // per execution
+  FuzzCorpus& corpus_;
+  std::mt19937_64 rng_;
+  std::unique_ptr<Chip8> chip8_;
+  std::array<uint8_t, kCoverageMapSize> coverage_;
+};
+
+FuzzJob::FuzzJob(const FuzzOptions& options, const Quirks& quirks, uint32_t memory_limit, FuzzCorpus& corpus,
+                 uint64_t seed)
+    : options_{options},
+      quirks_{quirks},
+      memory_limit_{memory_limit},
+      frames_{options.instructions * kFrameRate / options.cycles + 1},
+      corpus_{corpus},
+      rng_{seed},
+      chip8_{std::make_unique<Chip8>(options.cycles)},
+      coverage_{} {
+  chip8_->SetQuirks(quirks);
+  chip8_->SetCoverage(coverage_.data(), memory_limit);
+}
+
+Fault FuzzJob::Execute(const FuzzInput& input) {
+  coverage_.fill(0);
+  chip8_->Reset();
+  chip8_->SetSeed(options_.seed);
+  chip8_->LoadProgram(input.rom);
+
+  size_t next_key_event = 0;
+  uint64_t executed = 0;
+  for (uint64_t frame = 0; executed < options_.instructions && chip8_->IsRunning(); ++frame) {
+    for (; next_key_event < input.keys.size() && input.keys[next_key_event].frame <= frame; ++next_key_event) {
+      chip8_->SetKey(input.keys[next_key_event].key, input.keys[next_key_event].pressed);
+    }
+    const uint64_t budget = std::min(chip8_->BeginFrame(frame), options_.instructions - executed);
+    for (uint64_t n = 0; n < budget && chip8_->IsRunning(); ++n) {
+      chip8_->StepWithCoverage();
+    }
+    executed += budget;
+  }
+  ++corpus_.executions;
+  return chip8_->GetFault();
+}
+
+bool FuzzJob::HasNewCoverage() {
+  bool found = false;
+  for (size_t k = 0; k < coverage_.size(); k += 8) {
+    uint64_t word;
+    std::memcpy(&word, &coverage_[k], 8);
+    if (word == 0) continue;  // most of the map is untouched
+    for (size_t j = k; j < k + 8; ++j) {
+      const uint8_t bucket = kHitBuckets[coverage_[j]];
+      if ((corpus_.seen_buckets[j].load(std::memory_order_relaxed) & bucket) == bucket) continue;
+      const uint8_t previous = corpus_.seen_buckets[j].fetch_or(bucket, std::memory_order_relaxed);
+      if (previous == 0) ++corpus_.edges;
+      found |= (previous & bucket) != bucket;
+    }
+  }
+  return found;
+}
+
+void FuzzJob::Mutate(FuzzInput& input) {
+  const size_t max_rom_size = memory_limit_ - 0x200;
+  const auto random = [this](size_t bound) { return static_cast<size_t>(rng_() % bound); };
+  const int mutations = 1 + random(kMaxMutations);
+  for (int m = 0; m < mutations; ++m) {
+    if (input.rom.size() < 2) input.rom.resize(2);
+    std::vector<uint8_t>& rom = input.rom;
+    switch (random(8)) {
+      case 0:
+        rom[random(rom.size())] ^= 1 << random(8);
+        break;
+      case 1:
+        rom[random(rom.size())] = static_cast<uint8_t>(rng_());
+        break;
+      case 2:
+        rom[random(rom.size())] = kInterestingBytes[random(std::size(kInterestingBytes))];
+        break;
+      case 3: {
+        // Whole instruction at an even offset
+        const OpcodeTemplate& op = kOpcodeTemplates[random(std::size(kOpcodeTemplates))];
+        const uint16_t inst = op.pattern | (static_cast<uint16_t>(rng_()) & op.operands);
+        const size_t offset = random(rom.size() / 2) * 2;
+        rom[offset] = inst >> 8;
+        rom[offset + 1] = inst & 0xFF;
+        break;
+      }
+      case 4: {
+        const size_t from = random(rom.size());
+        const size_t to = random(rom.size());
+        const size_t length = random(std::min<size_t>(rom.size() - std::max(from, to), 32) + 1);
+        std::copy_n(rom.begin() + from, length, rom.begin() + to);
+        break;
+      }
+      case 5:
+        if (rng_() & 1) {
+          if (rom.size() < max_rom_size) rom.insert(rom.begin() + random(rom.size() + 1), static_cast<uint8_t>(rng_()));
+        } else {
+          rom.erase(rom.begin() + random(rom.size()));
+        }
+        break;
+      case 6:
+        if (input.keys.size() < kMaxKeyEvents) {
+          const KeyEvent event{random(frames_), static_cast<uint8_t>(random(16)), (rng_() & 1) != 0};
+          input.keys.insert(std::upper_bound(input.keys.begin(), input.keys.end(), event,
+            [](const KeyEvent& a, const KeyEvent& b) { return a.frame < b.frame; }), event);
+        }
+        break;
+      case 7:
+        if (!input.keys.empty()) input.keys.erase(input.keys.begin() + random(input.keys.size()));
+        break;
+    }
+  }
+}
+
+FuzzInput FuzzJob::Minimize(FuzzInput input, Fault fault, uint16_t pc) {
+  const auto reproduces = [&](const FuzzInput& candidate) {
+    return Execute(candidate) == fault && chip8_->GetPc() == pc;
+  };
+
+  for (size_t k = input.keys.size(); k-- > 0;) {
+    FuzzInput candidate = input;
+    candidate.keys.erase(candidate.keys.begin() + k);
+    if (reproduces(candidate)) input = std::move(candidate);
+  }
+  // Zero out ever smaller chunks of the ROM that do not matter
+  for (size_t chunk = std::bit_ceil(input.rom.size()); chunk > 0; chunk /= 2) {
+    for (size_t offset = 0; offset < input.rom.size(); offset += chunk) {
+      const auto first = input.rom.begin() + offset;
+      const auto last = input.rom.begin() + std::min(offset + chunk, input.rom.size());
+      if (std::all_of(first, last, [](uint8_t byte) { return byte == 0; })) continue;
+      FuzzInput candidate = input;
+      std::fill(candidate.rom.begin() + offset, candidate.rom.begin() + (last - input.rom.begin()), 0);
+      if (reproduces(candidate)) input = std::move(candidate);
+    }
+  }
+  // Memory beyond the ROM is zero anyway
+  while (!input.rom.empty() && input.rom.back() == 0) input.rom.pop_back();
+  return input;
+}
+
+void FuzzJob::Report(const FuzzInput& input, Fault fault, uint16_t pc, uint16_t kind) {
+  const FuzzInput reproducer = Minimize(input, fault, pc);
+
+  char name[64];
+  snprintf(name, sizeof(name), "%s_%04X", FaultToString(fault), kind);
+  const std::string rom_path = kFuzzOutputDirectory + "/" + name + ".ch8";
+  const std::string keys_path = kFuzzOutputDirectory + "/" + name + ".keys";
+
+  std::filesystem::create_directories(kFuzzOutputDirectory);
+  std::ofstream rom_file{rom_path, std::ios::binary};
+  rom_file.write(reinterpret_cast<const char*>(reproducer.rom.data()), reproducer.rom.size());
+  std::ofstream keys_file{keys_path};
+  keys_file << "# frame key pressed\n";
+  for (const KeyEvent& event : reproducer.keys) {
+    keys_file << event.frame << ' ' << std::hex << static_cast<int>(event.key) << std::dec << ' ' << event.pressed << '\n';
+  }
+
+  printf("Fuzz: %s at pc=0x%04X, %zu bytes and %zu key events: ./emu -H %llu -B 0x%X -s %u -q %s -k %s %s\n",
+    FaultToString(fault), pc, reproducer.rom.size(), reproducer.keys.size(),
+    static_cast<unsigned long long>(options_.instructions), memory_limit_, options_.seed,
+    QuirksToString(quirks_).c_str(), keys_path.c_str(), rom_path.c_str());
+}
+
+void FuzzJob::Run() {
+  while (corpus_.executions < options_.executions) {
+    FuzzInput input;
+    {
+      std::lock_guard<std::mutex> lock(corpus_.mutex);
+      input = corpus_.inputs[rng_() % corpus_.inputs.size()];
+    }
+    Mutate(input);
+
+    const Fault fault = Execute(input);
+    if (HasNewCoverage()) {
+      std::lock_guard<std::mutex> lock(corpus_.mutex);
+      corpus_.inputs.push_back(input);
+    }
+    if (fault == Fault::kNone) continue;
+    if (fault == Fault::kInvalidInstruction) {
+      ++corpus_.invalid_instructions;
+      continue;
+    }
+
+    // One reproducer per fault and instruction kind (e.g. Fx55 beyond 4 KB)
+    const uint16_t pc = chip8_->GetPc();
+    const uint16_t kind = GetOpcodeKind(chip8_->GetNextInstruction());
+    {
+      std::lock_guard<std::mutex> lock(corpus_.mutex);
+      if (!corpus_.faults.insert({fault, kind}).second) continue;
+    }
+    Report(input, fault, pc, kind);
+  }
+}
+
+} // namespace
+
+void RunFuzzer(const std::string& rom, const FuzzOptions& options) {
+  std::ifstream ifs{rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    fprintf(stderr, "Failed to open ROM: %s\n", rom.c_str());
+    return;
+  }
+  FuzzInput seed_input{{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}}, {}};
+  if (0x200 + seed_input.rom.size() > kMemorySize) {
+    fprintf(stderr, "ROM size is too large\n");
+    return;
+  }
+
+  const Quirks quirks = options.quirks.value_or(LookUpQuirks(Sha1(seed_input.rom)).value_or(kChip8Quirks));
+  // Accesses beyond 4 KB are faults unless the program is an XO-CHIP one
+  const bool extended_memory =
+    quirks.ToBits() == kXoChipQuirks.ToBits() || 0x200 + seed_input.rom.size() > kLegacyMemorySize;
+  const uint32_t memory_limit = extended_memory ? kMemorySize : kLegacyMemorySize;
+
+  auto corpus = std::make_unique<FuzzCorpus>();
+  corpus->inputs.push_back(seed_input);
+
+  std::vector<std::unique_ptr<FuzzJob>> jobs;
+  for (int j = 0; j < options.jobs; ++j) {
+    jobs.push_back(std::make_unique<FuzzJob>(options, quirks, memory_limit, *corpus, options.seed + j + 1));
+  }
+  printf("Fuzz: %d jobs, %llu instructions per execution, memory limit 0x%X\n", options.jobs,
+    static_cast<unsigned long long>(options.instructions), memory_limit);
+
+  const auto start_time = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (auto& job : jobs) threads.emplace_back([&job] { job->Run(); });
+
+  const auto print_status = [&] {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    std::lock_guard<std::mutex> lock(corpus->mutex);
+    printf("Fuzz: %llu executions (%.0f/s), corpus %zu, edges %llu, faults %zu, invalid instructions %llu\n",
+      static_cast<unsigned long long>(corpus->executions.load()), corpus->executions / elapsed.count(),
+      corpus->inputs.size(), static_cast<unsigned long long>(corpus->edges.load()), corpus->faults.size(),
+      static_cast<unsigned long long>(corpus->invalid_instructions.load()));
+  };
+  while (corpus->executions < options.executions) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    print_status();
+  }
+  for (auto& thread : threads) thread.join();
+  print_status();
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <optional>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+struct FuzzOptions {
+  uint64_t executions;
+  uint64_t instructions;  // per execution
+  int jobs;
+  int cycles;             // instructions per second, sets the frame length for key events
+  uint32_t seed;          // Chip8 random seed, fixed so that reproducers replay exactly
+  std::optional<Quirks> quirks;  // ROM database quirks if empty
+};
+
+// Coverage-guided fuzzer. Mutates the ROM bytes and a key event log, runs
+// them headless with Instrumentation::kCoverage on every job, and keeps
+// inputs that reach new pc or opcode edges. The first stack or memory fault
+// of each instruction kind is minimized and written to kFuzzOutputDirectory
+// as a ROM and an input log that replay it with -H, -s and -k. Invalid
+// instructions are expected from random bytes and only counted.
+void RunFuzzer(const std::string& rom, const FuzzOptions& options);
+
+} // namespace chip8_emu
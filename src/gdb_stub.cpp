@@ -0,0 +1,390 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <array>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gdb_stub.hpp"
+#include "debugger.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr size_t kPacketSize = 0x1000;
+constexpr uint32_t kMaxMemoryRead = (kPacketSize - 4) / 2;
+constexpr auto kTaskPollInterval = std::chrono::milliseconds(10);
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+std::string MakeTargetXml() {
+  std::string xml =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <feature name=\"org.chip8.cpu\">\n";
+  for (int x = 0; x < 16; ++x) {
+    xml += "    <reg name=\"v" + std::string(1, kHexDigits[x]) + "\" bitsize=\"8\" type=\"uint8\"/>\n";
+  }
+  xml +=
+    "    <reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "    <reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "    <reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+  return xml;
+}
+
+int GetRegisterSize(int reg) {
+  return reg == Debugger::kRegisterI || reg == Debugger::kRegisterPc ? 2 : 1;
+}
+
+void AppendHex(std::string& hex, uint8_t value) {
+  hex += kHexDigits[value >> 4];
+  hex += kHexDigits[value & 0xF];
+}
+
+bool DecodeHex(const char* hex, size_t length, std::vector<uint8_t>& data) {
+  if (length % 2 != 0) return false;
+  data.resize(length / 2);
+  for (size_t k = 0; k < data.size(); ++k) {
+    unsigned value;
+    if (std::sscanf(hex + 2 * k, "%2x", &value) != 1) return false;
+    data[k] = value;
+  }
+  return true;
+}
+
+// Registers are sent little-endian, in the target.xml order
+uint16_t DecodeRegister(const std::vector<uint8_t>& data, size_t offset, int reg) {
+  uint16_t value = data[offset];
+  if (GetRegisterSize(reg) == 2) value |= data[offset + 1] << 8;
+  return value;
+}
+
+} // namespace
+
+GdbStub::GdbStub(Debugger& debugger, int port)
+    : debugger_{debugger},
+      port_{port},
+      listen_fd_{-1},
+      client_fd_{-1},
+      wake_fds_{-1, -1},
+      thread_{},
+      stopping_{false},
+      stopped_{false},
+      no_ack_{false},
+      received_{} {}
+
+GdbStub::~GdbStub() {
+  stopping_ = true;
+  if (wake_fds_[1] >= 0 && write(wake_fds_[1], "x", 1) < 0) {}
+  if (thread_.joinable()) thread_.join();
+  if (listen_fd_ >= 0) close(listen_fd_);
+  if (wake_fds_[0] >= 0) close(wake_fds_[0]);
+  if (wake_fds_[1] >= 0) close(wake_fds_[1]);
+}
+
+bool GdbStub::Start() {
+  listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd_ < 0) {
+    std::cerr << "GDB stub: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  const int one = 1;
+  setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port_);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(listen_fd_, 1) < 0) {
+    std::cerr << "GDB stub: cannot listen on port " << port_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (pipe(wake_fds_) < 0) {
+    std::cerr << "GDB stub: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  fcntl(wake_fds_[0], F_SETFL, O_NONBLOCK);
+  fcntl(wake_fds_[1], F_SETFL, O_NONBLOCK);  // NotifyStop never blocks the CPU thread
+
+  printf("GDB stub: listening on 127.0.0.1:%d\n", port_);
+  thread_ = std::thread(&GdbStub::Serve, this);
+  return true;
+}
+
+void GdbStub::NotifyStop() {
+  stopped_ = true;
+  if (write(wake_fds_[1], "x", 1) < 0) {}  // a full pipe already wakes the thread
+}
+
+void GdbStub::Serve() {
+  while (!stopping_) {
+    pollfd fds[] = {{listen_fd_, POLLIN, 0}, {wake_fds_[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) continue;
+    char buffer[64];
+    while (read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {}
+    if (stopping_ || !(fds[0].revents & POLLIN)) continue;
+
+    client_fd_ = accept(listen_fd_, nullptr, nullptr);
+    if (client_fd_ < 0) continue;
+    const int one = 1;
+    setsockopt(client_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    printf("GDB stub: client connected\n");
+    RunSession();
+    close(client_fd_);
+    client_fd_ = -1;
+    printf("GDB stub: client disconnected\n");
+  }
+}
+
+void GdbStub::RunSession() {
+  no_ack_ = false;
+  received_.clear();
+  // Clients expect a stopped target when they attach
+  if (!RunOnCpu<bool>([this] { debugger_.Stop("gdb attached"); return true; })) return;
+  stopped_ = false;
+
+  std::string packet;
+  while (ReadPacket(packet)) {
+    if (packet[0] == 'c' || packet.starts_with("vCont;c")) {
+      if (!Resume(false)) return;
+    } else if (packet[0] == 's' || packet.starts_with("vCont;s")) {
+      if (!Resume(true)) return;
+    } else if (packet == "D") {
+      RunOnCpu<bool>([this] {
+        debugger_.ClearBreakpoints(Debugger::Owner::kGdb);
+        debugger_.ClearWatchpoints(Debugger::Owner::kGdb);
+        debugger_.Continue();
+        return true;
+      });
+      SendPacket("OK");
+      return;
+    } else if (packet == "k") {
+      // No reply to a kill: the session ends with the machine
+      RunOnCpu<bool>([this] { debugger_.Kill(); return true; });
+      return;
+    } else {
+      SendPacket(HandlePacket(packet));
+      if (packet == "QStartNoAckMode") no_ack_ = true;
+    }
+  }
+}
+
+bool GdbStub::ReadPacket(std::string& packet) {
+  while (true) {
+    // Acks and interrupts outside of a run are dropped
+    const size_t start = received_.find('$');
+    if (start == std::string::npos) {
+      received_.clear();
+    } else {
+      const size_t end = received_.find('#', start);
+      if (end != std::string::npos && end + 2 < received_.size()) {
+        packet = received_.substr(start + 1, end - start - 1);
+        const unsigned checksum = std::strtoul(received_.substr(end + 1, 2).c_str(), nullptr, 16);
+        received_.erase(0, end + 3);
+        uint8_t sum = 0;
+        for (char c : packet) sum += c;
+        if (!no_ack_) send(client_fd_, sum == checksum ? "+" : "-", 1, MSG_NOSIGNAL);
+        if (sum == checksum && !packet.empty()) return true;
+        continue;
+      }
+    }
+    if (!ReceiveMore()) return false;
+  }
+}
+
+bool GdbStub::ReceiveMore() {
+  pollfd fds[] = {{client_fd_, POLLIN, 0}, {wake_fds_[0], POLLIN, 0}};
+  if (poll(fds, 2, -1) < 0) return !stopping_;
+  char buffer[kPacketSize];
+  while (read(wake_fds_[0], buffer, sizeof(buffer)) > 0) {}
+  if (stopping_) return false;
+  if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+    const ssize_t size = recv(client_fd_, buffer, sizeof(buffer), 0);
+    if (size <= 0) return false;
+    received_.append(buffer, size);
+  }
+  return true;
+}
+
+void GdbStub::SendPacket(const std::string& data) {
+  uint8_t sum = 0;
+  for (char c : data) sum += c;
+  std::string packet = "$" + data + "#";
+  AppendHex(packet, sum);
+  for (size_t sent = 0; sent < packet.size();) {
+    const ssize_t size = send(client_fd_, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+    if (size <= 0) return;
+    sent += size;
+  }
+}
+
+bool GdbStub::Resume(bool step) {
+  stopped_ = false;
+  if (!RunOnCpu<bool>([this, step] {
+        if (step) {
+          debugger_.Step();
+        } else {
+          debugger_.Continue();
+        }
+        return true;
+      })) {
+    return false;
+  }
+  while (!stopped_) {
+    if (!ReceiveMore()) {
+      if (stopping_) SendPacket("W00");  // the program exited
+      return false;
+    }
+    if (received_.find('\x03') != std::string::npos) {
+      std::erase(received_, '\x03');
+      Interrupt();
+    }
+  }
+  stopped_ = false;
+  SendPacket("S05");
+  return true;
+}
+
+void GdbStub::Interrupt() {
+  RunOnCpu<bool>([this] { debugger_.Stop("interrupt"); return true; });
+}
+
+template <typename Result>
+std::optional<Result> GdbStub::RunOnCpu(std::function<Result()> task) {
+  auto promise = std::make_shared<std::promise<Result>>();
+  auto future = promise->get_future();
+  debugger_.PostTask([promise, task] { promise->set_value(task()); });
+  // The CPU thread stops taking tasks when the program exits
+  while (future.wait_for(kTaskPollInterval) != std::future_status::ready) {
+    if (stopping_) return std::nullopt;
+  }
+  return future.get();
+}
+
+std::string GdbStub::HandlePacket(const std::string& packet) {
+  using Registers = std::array<uint16_t, Debugger::kNumRegisters>;
+  const char* args = packet.c_str() + 1;
+  unsigned addr, length, type, reg;
+
+  if (packet == "?") return "S05";
+  if (packet == "g") {
+    const auto registers = RunOnCpu<Registers>([this] {
+      Registers registers;
+      for (int reg = 0; reg < Debugger::kNumRegisters; ++reg) registers[reg] = debugger_.ReadRegister(reg);
+      return registers;
+    });
+    if (!registers) return "E01";
+    std::string hex;
+    for (int reg = 0; reg < Debugger::kNumRegisters; ++reg) {
+      for (int k = 0; k < GetRegisterSize(reg); ++k) AppendHex(hex, (*registers)[reg] >> (8 * k));
+    }
+    return hex;
+  }
+  if (packet[0] == 'G') {
+    std::vector<uint8_t> data;
+    if (!DecodeHex(args, packet.size() - 1, data)) return "E01";
+    Registers registers;
+    size_t offset = 0;
+    for (int reg = 0; reg < Debugger::kNumRegisters; ++reg) {
+      if (offset + GetRegisterSize(reg) > data.size()) return "E01";
+      registers[reg] = DecodeRegister(data, offset, reg);
+      offset += GetRegisterSize(reg);
+    }
+    RunOnCpu<bool>([this, registers] {
+      for (int reg = 0; reg < Debugger::kNumRegisters; ++reg) debugger_.WriteRegister(reg, registers[reg]);
+      return true;
+    });
+    return "OK";
+  }
+  if (packet[0] == 'p' && std::sscanf(args, "%x", &reg) == 1) {
+    if (reg >= Debugger::kNumRegisters) return "E01";
+    const auto value = RunOnCpu<uint16_t>([this, reg] { return debugger_.ReadRegister(reg); });
+    if (!value) return "E01";
+    std::string hex;
+    for (int k = 0; k < GetRegisterSize(reg); ++k) AppendHex(hex, *value >> (8 * k));
+    return hex;
+  }
+  if (packet[0] == 'P' && std::sscanf(args, "%x=", &reg) == 1) {
+    std::vector<uint8_t> data;
+    const char* hex = std::strchr(args, '=') + 1;
+    if (reg >= Debugger::kNumRegisters || !DecodeHex(hex, std::strlen(hex), data) ||
+        data.size() < static_cast<size_t>(GetRegisterSize(reg))) {
+      return "E01";
+    }
+    const uint16_t value = DecodeRegister(data, 0, reg);
+    RunOnCpu<bool>([this, reg, value] { debugger_.WriteRegister(reg, value); return true; });
+    return "OK";
+  }
+  if (packet[0] == 'm' && std::sscanf(args, "%x,%x", &addr, &length) == 2) {
+    length = std::min(length, kMaxMemoryRead);
+    const auto data = RunOnCpu<std::vector<uint8_t>>([this, addr, length] {
+      return debugger_.ReadMemory(addr, length);
+    });
+    if (!data) return "E01";
+    std::string hex;
+    for (uint8_t value : *data) AppendHex(hex, value);
+    return hex;
+  }
+  if (packet[0] == 'M' && std::sscanf(args, "%x,%x:", &addr, &length) == 2) {
+    std::vector<uint8_t> data;
+    const char* hex = std::strchr(args, ':') + 1;
+    if (!DecodeHex(hex, std::strlen(hex), data) || data.size() != length) return "E01";
+    RunOnCpu<bool>([this, addr, data] { debugger_.WriteMemory(addr, data); return true; });
+    return "OK";
+  }
+  if ((packet[0] == 'Z' || packet[0] == 'z') && std::sscanf(args, "%u,%x,%x", &type, &addr, &length) == 3) {
+    // 0 and 1: software and hardware breakpoints, 2-4: write, read and access watchpoints
+    if (type > 4 || addr > 0xFFFF) return "";
+    if (type >= 2 && (length == 0 || length > 0x10000 - addr)) return "E01";
+    const bool insert = packet[0] == 'Z';
+    RunOnCpu<bool>([this, insert, type, addr, length] {
+      if (type <= 1 && insert) {
+        debugger_.AddBreakpoint({static_cast<uint16_t>(addr), std::nullopt, Debugger::Owner::kGdb});
+      } else if (type <= 1) {
+        debugger_.RemoveBreakpoints(addr, Debugger::Owner::kGdb);
+      } else if (insert) {
+        debugger_.AddWatchpoint({addr, addr + length, type != 2, type != 3, Debugger::Owner::kGdb});
+      } else {
+        debugger_.RemoveWatchpoints(addr, Debugger::Owner::kGdb);
+      }
+      return true;
+    });
+    return "OK";
+  }
+  if (packet.starts_with("qSupported")) {
+    char reply[64];
+    std::snprintf(reply, sizeof(reply), "PacketSize=%zx;qXfer:features:read+;QStartNoAckMode+", kPacketSize);
+    return reply;
+  }
+  if (packet.starts_with("qXfer:features:read:target.xml:") &&
+      std::sscanf(packet.c_str() + std::strlen("qXfer:features:read:target.xml:"), "%x,%x", &addr, &length) == 2) {
+    static const std::string kTargetXml = MakeTargetXml();
+    if (addr >= kTargetXml.size()) return "l";
+    length = std::min<unsigned>(length, kPacketSize - 5);
+    return (addr + length < kTargetXml.size() ? "m" : "l") + kTargetXml.substr(addr, length);
+  }
+  if (packet == "QStartNoAckMode" || packet[0] == 'H' || packet[0] == 'T') return "OK";
+  if (packet == "qAttached") return "1";
+  if (packet == "qC") return "QC1";
+  if (packet == "qfThreadInfo") return "m1";
+  if (packet == "qsThreadInfo") return "l";
+  if (packet == "vCont?") return "vCont;c;s";
+  return "";
+}
+
+} // namespace chip8_emu
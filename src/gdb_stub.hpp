@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace chip8_emu {
+
+class Debugger;
+
+// GDB remote serial protocol server on 127.0.0.1. Packets are parsed and
+// answered on the stub's own thread; the machine state is only touched by
+// Debugger tasks on the CPU thread, so the emulator keeps running at full
+// speed until a breakpoint, watchpoint, step or interrupt stops it.
+//
+// Registers: v0-vF (8 bits), i and pc (16 bits), sp, dt and st (8 bits),
+// described to the client by target.xml.
+class GdbStub {
+ public:
+  GdbStub(Debugger& debugger, int port);
+  ~GdbStub();
+  bool Start();  // listens and starts the thread
+  void NotifyStop();  // CPU thread, after the debugger stopped the machine
+
+ private:
+  void Serve();
+  void RunSession();
+  bool ReadPacket(std::string& packet);
+  bool ReceiveMore();  // false when the client left or the stub stops
+  void SendPacket(const std::string& data);
+  bool Resume(bool step);  // continues or steps, and waits for the stop
+  std::string HandlePacket(const std::string& packet);
+  template <typename Result>
+  std::optional<Result> RunOnCpu(std::function<Result()> task);
+  void Interrupt();
+
+  Debugger& debugger_;
+  int port_;
+  int listen_fd_;
+  int client_fd_;
+  int wake_fds_[2];  // self-pipe for NotifyStop and shutdown
+  std::thread thread_;
+  std::atomic_bool stopping_;
+  std::atomic_bool stopped_;  // set by NotifyStop
+  bool no_ack_;
+  std::string received_;  // bytes not yet parsed
+};
+
+} // namespace chip8_emu
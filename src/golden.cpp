@@ -0,0 +1,332 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "golden.hpp"
+#include "chip8.hpp"
+#include "quirks.hpp"
+#include "input_log.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+const std::string kGoldenOutputDirectory{"golden_out"};
+const std::string kGoldenReferenceDirectory{"golden"};  // next to the manifest
+
+struct GoldenTest {
+  size_t line;  // index in the manifest
+  std::string name;
+  std::string rom;
+  uint64_t frames;
+  std::vector<uint64_t> check_frames;  // ascending
+  std::optional<Quirks> quirks;        // ROM database quirks if empty
+  std::vector<KeyEvent> keys;
+  uint32_t seed;
+  int cycles;
+  std::vector<uint64_t> hashes;  // golden, one per check frame
+};
+
+struct Image {
+  int width;
+  int height;
+  std::vector<uint8_t> pixels;  // palette indices
+};
+
+struct GoldenResult {
+  std::string error;  // the ROM could not be run
+  Fault fault;
+  std::vector<uint64_t> hashes;
+  std::vector<Image> images;
+};
+
+std::optional<std::vector<uint64_t>> ParseList(const std::string& list, int base) {
+  std::vector<uint64_t> values;
+  std::istringstream iss{list};
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    char* end;
+    values.push_back(std::strtoull(item.c_str(), &end, base));
+    if (item.empty() || *end != '\0') return std::nullopt;
+  }
+  return values;
+}
+
+std::optional<GoldenTest> ParseTest(const std::string& line, size_t line_index, const std::filesystem::path& dir,
+                                    const std::string& manifest) {
+  const auto fail = [&](const std::string& what) {
+    fprintf(stderr, "%s:%zu: %s\n", manifest.c_str(), line_index + 1, what.c_str());
+    return std::nullopt;
+  };
+
+  std::istringstream iss{line.substr(0, line.find('#'))};
+  std::string rom;
+  GoldenTest test{line_index, {}, {}, 0, {}, std::nullopt, {}, 0, kMainCycles, {}};
+  if (!(iss >> rom)) return std::nullopt;  // blank line
+  if (!(iss >> test.frames) || test.frames == 0) return fail("invalid frame count");
+  test.rom = (dir / rom).string();
+  test.name = std::filesystem::path(rom).stem().string();
+  test.check_frames = {test.frames};
+
+  std::string field;
+  while (iss >> field) {
+    const size_t equal = field.find('=');
+    const std::string key = field.substr(0, equal);
+    const std::string value = equal == std::string::npos ? "" : field.substr(equal + 1);
+    if (key == "name" && !value.empty()) {
+      test.name = value;
+    } else if (key == "at") {
+      auto frames = ParseList(value, 10);
+      if (!frames || frames->empty()) return fail("invalid frame list: " + value);
+      std::sort(frames->begin(), frames->end());
+      if (frames->front() == 0 || frames->back() > test.frames) return fail("checked frames out of range");
+      test.check_frames = std::move(*frames);
+    } else if (key == "quirks") {
+      test.quirks = ParseQuirks(value);
+      if (!test.quirks) return fail("invalid quirks: " + value);
+    } else if (key == "keys") {
+      auto keys = LoadInputLog((dir / value).string());
+      if (!keys) return fail("invalid input log: " + value);
+      test.keys = std::move(*keys);
+    } else if (key == "seed") {
+      test.seed = std::strtoul(value.c_str(), nullptr, 10);
+    } else if (key == "cycles") {
+      test.cycles = std::atoi(value.c_str());
+      if (test.cycles <= 0) return fail("invalid cycles: " + value);
+    } else if (key == "hash") {
+      auto hashes = ParseList(value, 16);
+      if (!hashes) return fail("invalid hash list: " + value);
+      test.hashes = std::move(*hashes);
+    } else {
+      return fail("unknown field: " + field);
+    }
+  }
+  return test;
+}
+
+Image CaptureImage(const FrameBuffer& frame_buffer) {
+  Image image{frame_buffer.GetWidth(), frame_buffer.GetHeight(), {}};
+  image.pixels.resize(image.width * image.height);
+  for (int y = 0; y < image.height; ++y) {
+    for (int x = 0; x < image.width; ++x) image.pixels[y * image.width + x] = frame_buffer.GetPixel(x, y);
+  }
+  return image;
+}
+
+// The machine is reused across tests, reset in place
+GoldenResult RunTest(const GoldenTest& test, Chip8& chip8) {
+  GoldenResult result{{}, Fault::kNone, {}, {}};
+  std::ifstream ifs{test.rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    result.error = "failed to open " + test.rom;
+    return result;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  if (0x200 + data.size() > kMemorySize) {
+    result.error = "ROM size is too large";
+    return result;
+  }
+
+  chip8.Reset();
+  chip8.SetCycles(test.cycles);
+  chip8.SetQuirks(test.quirks.value_or(LookUpQuirks(Sha1(data)).value_or(kChip8Quirks)));
+  chip8.SetSeed(test.seed);
+  chip8.LoadProgram(data);
+
+  size_t next_key_event = 0;
+  size_t next_check = 0;
+  for (uint64_t frame = 0; frame < test.frames; ++frame) {
+    for (; next_key_event < test.keys.size() && test.keys[next_key_event].frame <= frame; ++next_key_event) {
+      chip8.SetKey(test.keys[next_key_event].key, test.keys[next_key_event].pressed);
+    }
+    const uint64_t budget = chip8.BeginFrame(frame);
+    // A stopped program keeps its last display for the remaining checks
+    for (uint64_t n = 0; n < budget && chip8.IsRunning(); ++n) chip8.Step();
+    for (; next_check < test.check_frames.size() && test.check_frames[next_check] == frame + 1; ++next_check) {
+      result.hashes.push_back(chip8.GetFrameBuffer().GetHash());
+      result.images.push_back(CaptureImage(chip8.GetFrameBuffer()));
+    }
+  }
+  result.fault = chip8.GetFault();
+  return result;
+}
+
+bool WritePgm(const std::string& path, const Image& image) {
+  std::ofstream ofs{path, std::ios::binary};
+  ofs << "P5\n" << image.width << " " << image.height << "\n15\n";
+  ofs.write(reinterpret_cast<const char*>(image.pixels.data()), image.pixels.size());
+  return static_cast<bool>(ofs);
+}
+
+std::optional<Image> ReadPgm(const std::string& path) {
+  std::ifstream ifs{path, std::ios::binary};
+  std::string magic;
+  int max_value;
+  Image image{0, 0, {}};
+  if (!(ifs >> magic >> image.width >> image.height >> max_value) || magic != "P5" || max_value != 15) {
+    return std::nullopt;
+  }
+  ifs.get();
+  image.pixels.resize(image.width * image.height);
+  if (!ifs.read(reinterpret_cast<char*>(image.pixels.data()), image.pixels.size())) return std::nullopt;
+  return image;
+}
+
+// Black where the palette indices differ
+void WriteDiffPbm(const std::string& path, const Image& a, const Image& b) {
+  std::ofstream ofs{path, std::ios::binary};
+  ofs << "P4\n" << a.width << " " << a.height << "\n";
+  std::vector<uint8_t> row((a.width + 7) / 8);
+  for (int y = 0; y < a.height; ++y) {
+    std::fill(row.begin(), row.end(), 0);
+    for (int x = 0; x < a.width; ++x) {
+      const size_t k = y * a.width + x;
+      if (a.pixels[k] != b.pixels[k]) row[x / 8] |= 0x80 >> (x % 8);
+    }
+    ofs.write(reinterpret_cast<const char*>(row.data()), row.size());
+  }
+}
+
+std::string FormatHashes(const std::vector<uint64_t>& hashes) {
+  std::string list;
+  for (uint64_t hash : hashes) {
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    list += (list.empty() ? "" : ",") + std::string(buffer);
+  }
+  return list;
+}
+
+// Replaces the hash field of a manifest line, keeping everything else
+std::string SetHashField(const std::string& line, const std::vector<uint64_t>& hashes) {
+  const size_t comment = line.find('#');
+  std::istringstream iss{line.substr(0, comment)};
+  std::string result, field;
+  while (iss >> field) {
+    if (!field.starts_with("hash=")) result += (result.empty() ? "" : " ") + field;
+  }
+  result += " hash=" + FormatHashes(hashes);
+  if (comment != std::string::npos) result += " " + line.substr(comment);
+  return result;
+}
+
+} // namespace
+
+bool RunGoldenSuite(const std::string& manifest, const GoldenOptions& options) {
+  namespace fs = std::filesystem;
+  std::ifstream ifs{manifest};
+  if (!ifs.is_open()) {
+    fprintf(stderr, "Failed to open golden manifest: %s\n", manifest.c_str());
+    return false;
+  }
+  const fs::path dir = fs::path(manifest).parent_path();
+  std::vector<std::string> lines;
+  std::vector<GoldenTest> tests;
+  std::set<std::string> names;
+  for (std::string line; std::getline(ifs, line);) {
+    lines.push_back(line);
+    std::istringstream iss{line.substr(0, line.find('#'))};
+    std::string first;
+    if (!(iss >> first)) continue;
+    auto test = ParseTest(line, lines.size() - 1, dir, manifest);
+    if (!test) return false;
+    if (!names.insert(test->name).second) {
+      fprintf(stderr, "%s:%zu: duplicate name %s, set name=\n", manifest.c_str(), lines.size(), test->name.c_str());
+      return false;
+    }
+    tests.push_back(std::move(*test));
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+  std::vector<GoldenResult> results(tests.size());
+  std::atomic<size_t> next_test{0};
+  std::vector<std::thread> threads;
+  for (int j = 0; j < std::min<int>(options.jobs, tests.size()); ++j) {
+    threads.emplace_back([&] {
+      auto chip8 = std::make_unique<Chip8>();
+      for (size_t k = next_test++; k < tests.size(); k = next_test++) results[k] = RunTest(tests[k], *chip8);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  const fs::path reference_dir = dir / kGoldenReferenceDirectory;
+  size_t failed = 0;
+  for (size_t k = 0; k < tests.size(); ++k) {
+    const GoldenTest& test = tests[k];
+    const GoldenResult& result = results[k];
+    if (!result.error.empty()) {
+      printf("Golden: %s: %s\n", test.name.c_str(), result.error.c_str());
+      ++failed;
+      continue;
+    }
+
+    if (options.update) {
+      fs::create_directories(reference_dir);
+      for (size_t c = 0; c < test.check_frames.size(); ++c) {
+        WritePgm((reference_dir / (test.name + "_" + std::to_string(test.check_frames[c]) + ".pgm")).string(),
+          result.images[c]);
+      }
+      lines[test.line] = SetHashField(lines[test.line], result.hashes);
+      continue;
+    }
+
+    if (test.hashes.size() != test.check_frames.size()) {
+      printf("Golden: %s: %zu hashes for %zu checked frames, run -U\n", test.name.c_str(), test.hashes.size(),
+        test.check_frames.size());
+      ++failed;
+      continue;
+    }
+    bool passed = true;
+    for (size_t c = 0; c < test.check_frames.size(); ++c) {
+      if (result.hashes[c] == test.hashes[c]) continue;
+      passed = false;
+      const std::string image_name = test.name + "_" + std::to_string(test.check_frames[c]);
+      fs::create_directories(kGoldenOutputDirectory);
+      const std::string actual_path = kGoldenOutputDirectory + "/" + image_name + ".pgm";
+      WritePgm(actual_path, result.images[c]);
+      printf("Golden: %s: frame %llu hash %016llx != %016llx, wrote %s", test.name.c_str(),
+        static_cast<unsigned long long>(test.check_frames[c]), static_cast<unsigned long long>(result.hashes[c]),
+        static_cast<unsigned long long>(test.hashes[c]), actual_path.c_str());
+      const auto reference = ReadPgm((reference_dir / (image_name + ".pgm")).string());
+      if (reference && reference->width == result.images[c].width &&
+          reference->height == result.images[c].height) {
+        const std::string diff_path = kGoldenOutputDirectory + "/" + image_name + "_diff.pbm";
+        WriteDiffPbm(diff_path, *reference, result.images[c]);
+        printf(" and %s", diff_path.c_str());
+      }
+      printf("\n");
+    }
+    if (!passed) {
+      if (result.fault != Fault::kNone) {
+        printf("Golden: %s: stopped by %s\n", test.name.c_str(), FaultToString(result.fault));
+      }
+      ++failed;
+    }
+  }
+
+  if (options.update) {
+    std::ofstream ofs{manifest};
+    for (const std::string& line : lines) ofs << line << "\n";
+    printf("Golden: updated %zu tests in %s in %.2f s\n", tests.size() - failed, manifest.c_str(), elapsed.count());
+  } else {
+    printf("Golden: %zu passed, %zu failed in %.2f s\n", tests.size() - failed, failed, elapsed.count());
+  }
+  return failed == 0;
+}
+
+} // namespace chip8_emu
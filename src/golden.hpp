@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+namespace chip8_emu {
+
+struct GoldenOptions {
+  bool update;  // record the current hashes and reference images instead of comparing
+  int jobs;
+};
+
+// Visual regression suite. Each manifest line runs one ROM headless for a
+// number of frames and hashes the display at the checked frames:
+//
+//   <rom> <frames> [name=<name>] [at=<frame,...>] [quirks=<quirks>]
+//                  [keys=<input_log>] [seed=<n>] [cycles=<n>] [hash=<hash,...>]
+//
+// Paths are relative to the manifest, at defaults to the last frame and
+// name to the ROM's file name without extension. '#' starts a comment.
+// Updating rewrites the hash fields and stores the displays as PGM
+// reference images in golden/ next to the manifest. A mismatch writes the
+// actual display and a PBM diff against the reference to
+// kGoldenOutputDirectory. Tests run in parallel on jobs threads.
+bool RunGoldenSuite(const std::string& manifest, const GoldenOptions& options);
+
+} // namespace chip8_emu
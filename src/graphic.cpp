@@ -1,5 +1,7 @@
 #include <iostream>
 #include <array>
+#include <algorithm>
+#include <cctype>
 
 #include <SDL2/SDL.h>
 
@@ -26,21 +28,88 @@ const std::array<uint8_t, 80> kSprites = {
   0xF0, 0x80, 0xF0, 0x80, 0x80, // F
 };
 
+const std::array<uint8_t, 160> kBigSprites = {
+  0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+  0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+  0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+  0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+  0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+  0x3E, 0x7C, 0xC0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+  0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+  0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+  0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+  0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+  0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, // E
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0, // F
+};
+
+namespace {
+
+// 3x5 glyphs of the metrics overlay, one row per byte (bit 2 = leftmost pixel)
+struct OverlayGlyph {
+  char c;
+  std::array<uint8_t, 5> rows;
+};
+
+constexpr OverlayGlyph kOverlayGlyphs[] = {
+  {'0', {7, 5, 5, 5, 7}}, {'1', {2, 6, 2, 2, 7}}, {'2', {7, 1, 7, 4, 7}}, {'3', {7, 1, 7, 1, 7}},
+  {'4', {5, 5, 7, 1, 1}}, {'5', {7, 4, 7, 1, 7}}, {'6', {7, 4, 7, 5, 7}}, {'7', {7, 1, 1, 1, 1}},
+  {'8', {7, 5, 7, 5, 7}}, {'9', {7, 5, 7, 1, 7}}, {'A', {2, 5, 7, 5, 5}}, {'B', {6, 5, 6, 5, 6}},
+  {'C', {3, 4, 4, 4, 3}}, {'D', {6, 5, 5, 5, 6}}, {'E', {7, 4, 6, 4, 7}}, {'F', {7, 4, 6, 4, 4}},
+  {'G', {3, 4, 5, 5, 3}}, {'H', {5, 5, 7, 5, 5}}, {'I', {7, 2, 2, 2, 7}}, {'J', {1, 1, 1, 5, 2}},
+  {'K', {5, 5, 6, 5, 5}}, {'L', {4, 4, 4, 4, 7}}, {'M', {5, 7, 7, 5, 5}}, {'N', {6, 5, 5, 5, 5}},
+  {'O', {2, 5, 5, 5, 2}}, {'P', {6, 5, 6, 4, 4}}, {'Q', {2, 5, 5, 6, 3}}, {'R', {6, 5, 6, 5, 5}},
+  {'S', {3, 4, 2, 1, 6}}, {'T', {7, 2, 2, 2, 2}}, {'U', {5, 5, 5, 5, 7}}, {'V', {5, 5, 5, 5, 2}},
+  {'W', {5, 5, 7, 7, 5}}, {'X', {5, 5, 2, 5, 5}}, {'Y', {5, 5, 2, 2, 2}}, {'Z', {7, 1, 2, 4, 7}},
+  {'.', {0, 0, 0, 0, 2}}, {'%', {5, 1, 2, 4, 5}}, {'/', {1, 1, 2, 4, 4}}, {':', {0, 2, 0, 2, 0}},
+  {'-', {0, 0, 7, 0, 0}},
+};
+
+// Overlay text is drawn in a logical space of this size, whatever the display
+// resolution, so that it stays small and sharp in low resolution
+constexpr int kOverlayWidth = 256;
+constexpr int kOverlayHeight = 128;
+constexpr int kOverlayGlyphWidth = 4;  // with spacing
+constexpr int kOverlayGlyphHeight = 6;
+
+const OverlayGlyph* FindOverlayGlyph(char c) {
+  const char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+  for (const OverlayGlyph& glyph : kOverlayGlyphs) {
+    if (glyph.c == upper) return &glyph;
+  }
+  return nullptr;  // blank
+}
+
+}  // namespace
+
 Graphic::Graphic()
     : frame_buffer_{},
       window_scale_{15},
-      obj_rgb_{255, 255, 255},
-      bg_rgb_{0, 0, 0},
+      logical_width_{0},
+      palette_{{
+        {0, 0, 0},       {255, 255, 255}, {170, 170, 170}, {85, 85, 85},
+        {255, 0, 0},     {0, 255, 0},     {0, 0, 255},     {255, 255, 0},
+        {136, 0, 0},     {0, 136, 0},     {0, 0, 136},     {136, 136, 0},
+        {255, 0, 255},   {0, 255, 255},   {136, 0, 136},   {0, 136, 136},
+      }},
       window_{nullptr},
       renderer_{nullptr},
-      pixel_{} {
+      pixel_{},
+      upscaler_{},
+      texture_{nullptr},
+      overlay_{nullptr},
+      terminal_{} {
 }
 
 Graphic::~Graphic() {
   Terminate();
 }
 
-void Graphic::InitializeWindow(int window_scale) {
+void Graphic::InitializeWindow(int window_scale, UpscaleFilter filter) {
   window_scale_ = window_scale;
 
   if (SDL_Init(SDL_INIT_VIDEO) != 0) {
@@ -49,60 +118,187 @@ void Graphic::InitializeWindow(int window_scale) {
     std::exit(EXIT_FAILURE);
   }
 
-  if (SDL_CreateWindowAndRenderer(64 * window_scale_, 32 * window_scale_, 0, &window_, &renderer_) != 0) {
+  if (SDL_CreateWindowAndRenderer(kLowResWidth * window_scale_, kLowResHeight * window_scale_, 0, &window_, &renderer_) != 0) {
     std::cerr << "Failed to create SDL window or SDL renderer: " << SDL_GetError() << std::endl;
     SDL_Quit();
     std::exit(EXIT_FAILURE);
   }
   SDL_SetWindowTitle(window_, "CHIP-8 Emulator");
 
-  SDL_SetRenderDrawColor(renderer_, bg_rgb_.r, bg_rgb_.g, bg_rgb_.b, 255);
+  if (filter != UpscaleFilter::kNearest) {
+    upscaler_ = std::make_unique<Upscaler>(filter);
+    const int factor = upscaler_->GetFactor();
+    texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                 kHighResWidth * factor, kHighResHeight * factor);
+    if (texture_ == nullptr) {
+      std::cerr << "Failed to create SDL texture: " << SDL_GetError() << std::endl;
+      SDL_Quit();
+      std::exit(EXIT_FAILURE);
+    }
+  }
+
+  SDL_SetRenderDrawColor(renderer_, palette_[0].r, palette_[0].g, palette_[0].b, 255);
   SDL_RenderClear(renderer_);
   SDL_RenderPresent(renderer_);
   pixel_ = {
-    0,              // x (temporary)
-    0,              // y (temporary)
-    window_scale_,  // width
-    window_scale_,  // height
+    0,  // x (temporary)
+    0,  // y (temporary)
+    0,  // width (temporary)
+    1,  // height
   };
 
   std::cout << "Initialized window" << std::endl;
 }
 
+void Graphic::InitializeTerminal(TerminalCells cells) {
+  terminal_ = std::make_unique<TerminalGraphic>(cells);
+  terminal_->Open();
+}
+
 void Graphic::Render() {
+  if (terminal_) {
+    terminal_->Render(frame_buffer_, GetArgbPalette());
+    return;
+  }
+
+  // The renderer works in display pixels and scales them to the window,
+  // so switching between 64x32 and 128x64 only changes the logical size.
+  if (logical_width_ != frame_buffer_.GetWidth()) {
+    logical_width_ = frame_buffer_.GetWidth();
+    SDL_RenderSetLogicalSize(renderer_, frame_buffer_.GetWidth(), frame_buffer_.GetHeight());
+  }
+
+  if (upscaler_) {
+    RenderUpscaled();
+    return;
+  }
+
   // draw background
-  SDL_SetRenderDrawColor(renderer_, bg_rgb_.r, bg_rgb_.g, bg_rgb_.b, 255);
+  SDL_SetRenderDrawColor(renderer_, palette_[0].r, palette_[0].g, palette_[0].b, 255);
   SDL_RenderClear(renderer_);
 
-  // draw objects
-  SDL_SetRenderDrawColor(renderer_, obj_rgb_.r, obj_rgb_.g, obj_rgb_.b, 255);
-  for (int i = 0; i < 32; ++i) {
-    for (int j = 0; j < 64; ++j) {
-      if (frame_buffer_[i][j] == 1) {
-        pixel_.x = window_scale_ * j;
-        pixel_.y = window_scale_ * i;
-        SDL_RenderFillRect(renderer_, &pixel_);
-      }
+  // draw objects as horizontal runs of the same color
+  const int width = frame_buffer_.GetWidth();
+  for (int i = 0; i < frame_buffer_.GetHeight(); ++i) {
+    int j = 0;
+    while (j < width) {
+      const uint8_t color = frame_buffer_.GetPixel(j, i);
+      const int start = j;
+      while (j < width && frame_buffer_.GetPixel(j, i) == color) ++j;
+      if (color == 0) continue;
+      SDL_SetRenderDrawColor(renderer_, palette_[color].r, palette_[color].g, palette_[color].b, 255);
+      pixel_.x = start;
+      pixel_.y = i;
+      pixel_.w = j - start;
+      SDL_RenderFillRect(renderer_, &pixel_);
     }
   }
+  if (overlay_) DrawOverlay();
   SDL_RenderPresent(renderer_); // This function should not be placed in the loop
 }
 
+ArgbPalette Graphic::GetArgbPalette() const {
+  ArgbPalette palette;
+  for (size_t k = 0; k < palette.size(); ++k) {
+    palette[k] = 0xFF000000 | palette_[k].r << 16 | palette_[k].g << 8 | palette_[k].b;
+  }
+  return palette;
+}
+
+void Graphic::RenderUpscaled() {
+  void* pixels;
+  int pitch;
+  if (SDL_LockTexture(texture_, nullptr, &pixels, &pitch) != 0) return;
+  upscaler_->Upscale(frame_buffer_, GetArgbPalette(), static_cast<uint32_t*>(pixels), pitch);
+  SDL_UnlockTexture(texture_);
+
+  // Only the part the current resolution filled, stretched over the window
+  const int factor = upscaler_->GetFactor();
+  const SDL_Rect source{0, 0, frame_buffer_.GetWidth() * factor, frame_buffer_.GetHeight() * factor};
+  SDL_RenderCopy(renderer_, texture_, &source, nullptr);
+  if (overlay_) DrawOverlay();
+  SDL_RenderPresent(renderer_);
+}
+
+void Graphic::DrawOverlay() {
+  SDL_RenderSetLogicalSize(renderer_, kOverlayWidth, kOverlayHeight);
+
+  // Dark box behind the lines, then each glyph row as runs of lit pixels
+  int columns = 0;
+  int lines = 1;
+  for (int column = 0, k = 0; overlay_[k] != '\0'; ++k) {
+    column = overlay_[k] == '\n' ? 0 : column + 1;
+    lines += overlay_[k] == '\n';
+    columns = std::max(columns, column);
+  }
+  const SDL_Rect box{0, 0, columns * kOverlayGlyphWidth + 1, lines * kOverlayGlyphHeight + 1};
+  SDL_SetRenderDrawColor(renderer_, 0, 0, 0, 255);
+  SDL_RenderFillRect(renderer_, &box);
+
+  SDL_SetRenderDrawColor(renderer_, 255, 255, 0, 255);
+  int x = 1;
+  int y = 1;
+  for (int k = 0; overlay_[k] != '\0'; ++k) {
+    if (overlay_[k] == '\n') {
+      x = 1;
+      y += kOverlayGlyphHeight;
+      continue;
+    }
+    if (const OverlayGlyph* glyph = FindOverlayGlyph(overlay_[k])) {
+      for (int row = 0; row < 5; ++row) {
+        for (int bit = 2; bit >= 0;) {
+          if (((glyph->rows[row] >> bit) & 1) == 0) {
+            --bit;
+            continue;
+          }
+          const int start = bit;
+          while (bit >= 0 && ((glyph->rows[row] >> bit) & 1)) --bit;
+          const SDL_Rect run{x + 2 - start, y + row, start - bit, 1};
+          SDL_RenderFillRect(renderer_, &run);
+        }
+      }
+    }
+    x += kOverlayGlyphWidth;
+  }
+
+  SDL_RenderSetLogicalSize(renderer_, frame_buffer_.GetWidth(), frame_buffer_.GetHeight());
+}
+
+void Graphic::SetOverlay(const char* text) {
+  overlay_ = text;
+}
+
 void Graphic::ChangeObjectColor(Color color) {
-  obj_rgb_ = color;
+  palette_[1] = color;
 }
 
 void Graphic::ChangeBackGroundColor(Color color) {
-  bg_rgb_ = color;
+  palette_[0] = color;
+}
+
+void Graphic::Invalidate() {
+  if (terminal_) terminal_->Invalidate();
+}
+
+const std::array<Color, 1 << kNumPlanes>& Graphic::GetPalette() const {
+  return palette_;
 }
 
-std::array<std::array<bool, 64>, 32>& Graphic::GetBuffer() {
+FrameBuffer& Graphic::GetBuffer() {
   return frame_buffer_;
 }
 
 void Graphic::Terminate() {
+  terminal_.reset();  // restores the screen
+  // Headless machines never initialize SDL, and must not quit it under a
+  // window of their own process (the tiled viewer)
+  if (window_ == nullptr) return;
+  if (texture_ != nullptr) SDL_DestroyTexture(texture_);
+  texture_ = nullptr;
   SDL_DestroyRenderer(renderer_);
   SDL_DestroyWindow(window_);
+  renderer_ = nullptr;
+  window_ = nullptr;
   SDL_Quit();
   std::cout << "Closed window" << std::endl;
 }
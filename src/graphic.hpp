@@ -2,12 +2,20 @@
 
 #include <cstdint>
 #include <array>
+#include <memory>
 
 #include <SDL2/SDL.h>
 
+#include "frame_buffer.hpp"
+#include "upscaler.hpp"
+#include "terminal_graphic.hpp"
+
 namespace chip8_emu {
 
+constexpr uint16_t kSpritesAddress = 0x000;
+constexpr uint16_t kBigSpritesAddress = 0x050;
 extern const std::array<uint8_t, 80> kSprites;
+extern const std::array<uint8_t, 160> kBigSprites;  // SUPER-CHIP 8x10 digits
 
 struct Color {
   uint8_t r, g, b;
@@ -17,20 +25,35 @@ class Graphic {
  public:
   Graphic();
   ~Graphic();
-  void InitializeWindow(int window_scale);
+  void InitializeWindow(int window_scale, UpscaleFilter filter = UpscaleFilter::kNearest);
+  void InitializeTerminal(TerminalCells cells);  // renders to stdout instead of a window
   void Render();
+  void Invalidate();  // the next Render repaints the terminal in full
   void ChangeObjectColor(Color color);
   void ChangeBackGroundColor(Color color);
+  const std::array<Color, 1 << kNumPlanes>& GetPalette() const;
+  // Text drawn over every rendered frame, or nullptr. Lines are separated by
+  // '\n'; the text is read on each Render, so it may change in place.
+  void SetOverlay(const char* text);
   void Terminate();
-  std::array<std::array<bool, 64>, 32>& GetBuffer();
+  FrameBuffer& GetBuffer();
 
  private:
-  std::array<std::array<bool, 64>, 32> frame_buffer_;
+  ArgbPalette GetArgbPalette() const;
+  void RenderUpscaled();
+  void DrawOverlay();
+
+  FrameBuffer frame_buffer_;
   int window_scale_;
-  Color obj_rgb_, bg_rgb_;
+  int logical_width_;
+  std::array<Color, 1 << kNumPlanes> palette_;  // 0: background, 1: objects
   SDL_Window *window_;
   SDL_Renderer *renderer_;
   SDL_Rect pixel_;
+  std::unique_ptr<Upscaler> upscaler_;  // null for UpscaleFilter::kNearest
+  SDL_Texture *texture_;  // streaming, sized for the high resolution display
+  const char* overlay_;  // drawn in the window only
+  std::unique_ptr<TerminalGraphic> terminal_;
 };
 
 } // namespace chip8_emu
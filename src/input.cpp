@@ -1,5 +1,6 @@
 #include <cstdint>
 #include <memory>
+#include <utility>
 
 #include <SDL2/SDL.h>
 
@@ -8,165 +9,248 @@
 
 namespace chip8_emu {
 
-Input::Input(std::shared_ptr<Graphic> graphic)
-    : key_{}, space_is_released_{true}, rand_{std::make_unique<Rand>()}, graphic_{graphic} {}
+Input::Input(Graphic& graphic)
+    : key_{},
+      external_keys_{0},
+      key_event_time_{},
+      wake_event_{SDL_RegisterEvents(1)},
+      space_is_released_{true}, rand_{std::make_unique<Rand>()}, graphic_{graphic}, terminal_{}, terminal_events_{} {}
+
+bool Input::UseTerminal() {
+  terminal_ = std::make_unique<TerminalInput>();
+  return terminal_->Open();
+}
 
 bool Input::GetKey(uint8_t num) const {
-  return key_[num];
+  num &= 0xF;  // Ex9E and ExA1 look at the low nibble of Vx, as on the COSMAC VIP
+  return key_[num] || ((external_keys_ >> num) & 1);
+}
+
+void Input::SetKey(uint8_t num, bool pressed) {
+  key_[num & 0xF] = pressed;
 }
 
-MessageType Input::ProcessInput() {
+void Input::SetExternalKeys(uint16_t keys) {
+  external_keys_ = keys;
+}
+
+void Input::Wake() {
+  if (terminal_) {
+    terminal_->Wake();
+    return;
+  }
+  if (wake_event_ == static_cast<uint32_t>(-1)) return;
+  SDL_Event event{};
+  event.type = wake_event_;
+  SDL_PushEvent(&event);
+}
+
+MessageType Input::ProcessInput(int timeout_ms) {
+  if (terminal_) return ProcessTerminalInput(timeout_ms);
+
   SDL_Event event;
   MessageType msg = MSG_NONE;
 
-  while (SDL_PollEvent(&event)) {
+  bool has_event = timeout_ms > 0 ? SDL_WaitEventTimeout(&event, timeout_ms) : SDL_PollEvent(&event);
+  for (; has_event; has_event = SDL_PollEvent(&event)) {
+    const std::array<bool, 16> keys = key_;
     switch (event.type) {
       case SDL_QUIT:
         msg = MSG_SHUTDOWN;
         break;
       case SDL_KEYDOWN:
-        switch (event.key.keysym.sym) {
-          case SDLK_1:
-            key_[0x1] = 1;
-            break;
-          case SDLK_2:
-            key_[0x2] = 1;
-            break;
-          case SDLK_3:
-            key_[0x3] = 1;
-            break;
-          case SDLK_4:
-            key_[0xC] = 1;
-            break;
-          case SDLK_q:
-            key_[0x4] = 1;
-            break;
-          case SDLK_w:
-            key_[0x5] = 1;
-            break;
-          case SDLK_e:
-            key_[0x6] = 1;
-            break;
-          case SDLK_r:
-            key_[0xD] = 1;
-            break;
-          case SDLK_a:
-            key_[0x7] = 1;
-            break;
-          case SDLK_s:
-            key_[0x8] = 1;
-            break;
-          case SDLK_d:
-            key_[0x9] = 1;
-            break;
-          case SDLK_f:
-            key_[0xE] = 1;
-            break;
-          case SDLK_z:
-            key_[0xA] = 1;
-            break;
-          case SDLK_x:
-            key_[0x0] = 1;
-            break;
-          case SDLK_c:
-            key_[0xB] = 1;
-            break;
-          case SDLK_v:
-            key_[0xF] = 1;
-            break;
-          case SDLK_ESCAPE:
-            msg = MSG_SHUTDOWN;
-            break;
-          case SDLK_SPACE:
-            // allow only one push
-            if (space_is_released_) {
-              msg = MSG_CHANGE_SLEEP_STATE;
-              space_is_released_ = false;
-            }
-            break;
-          case SDLK_t:
-            msg = MSG_TICK_WHILE_SLEEP;
-            break;
-          case SDLK_9: {
-            Color color {
-              rand_->GetRandomByte(),
-              rand_->GetRandomByte(),
-              rand_->GetRandomByte(),
-            };
-            graphic_->ChangeObjectColor(color);
-            msg = MSG_REDRAW;
-            break;
-          }
-          case SDLK_0: {
-            Color color {
-              rand_->GetRandomByte(),
-              rand_->GetRandomByte(),
-              rand_->GetRandomByte(),
-            };
-            graphic_->ChangeBackGroundColor(color);
-            msg = MSG_REDRAW;
-            break;
-          }
-        }
+        if (const MessageType pressed = PressKey(event.key.keysym.sym); pressed != MSG_NONE) msg = pressed;
         break;
       case SDL_KEYUP:
-        switch (event.key.keysym.sym) {
-          case SDLK_1:
-            key_[0x1] = 0;
-            break;
-          case SDLK_2:
-            key_[0x2] = 0;
-            break;
-          case SDLK_3:
-            key_[0x3] = 0;
-            break;
-          case SDLK_4:
-            key_[0xC] = 0;
-            break;
-          case SDLK_q:
-            key_[0x4] = 0;
-            break;
-          case SDLK_w:
-            key_[0x5] = 0;
-            break;
-          case SDLK_e:
-            key_[0x6] = 0;
-            break;
-          case SDLK_r:
-            key_[0xD] = 0;
-            break;
-          case SDLK_a:
-            key_[0x7] = 0;
-            break;
-          case SDLK_s:
-            key_[0x8] = 0;
-            break;
-          case SDLK_d:
-            key_[0x9] = 0;
-            break;
-          case SDLK_f:
-            key_[0xE] = 0;
-            break;
-          case SDLK_z:
-            key_[0xA] = 0;
-            break;
-          case SDLK_x:
-            key_[0x0] = 0;
-            break;
-          case SDLK_c:
-            key_[0xB] = 0;
-            break;
-          case SDLK_v:
-            key_[0xF] = 0;
-            break;
-          case SDLK_SPACE:
-            space_is_released_ = true;
-            break;
-        }
+        ReleaseKey(event.key.keysym.sym);
         break;
     }
+    if (key_ != keys && !key_event_time_) {
+      // SDL stamps events in milliseconds when they are queued
+      const auto queued_time = std::chrono::milliseconds(SDL_GetTicks() - event.key.timestamp);
+      key_event_time_ = std::chrono::steady_clock::now() - queued_time;
+    }
   }
   return msg;
 }
 
+MessageType Input::ProcessTerminalInput(int timeout_ms) {
+  MessageType msg = MSG_NONE;
+  const size_t num_events = terminal_->Poll(timeout_ms, terminal_events_);
+  const std::array<bool, 16> keys = key_;
+  for (size_t k = 0; k < num_events; ++k) {
+    const TerminalKeyEvent& event = terminal_events_[k];
+    if (!event.pressed) {
+      ReleaseKey(event.code);
+    } else if (event.code == kTerminalRedrawKey) {
+      graphic_.Invalidate();
+      msg = MSG_REDRAW;
+    } else if (const MessageType pressed = PressKey(event.code); pressed != MSG_NONE) {
+      msg = pressed;
+    }
+  }
+  if (key_ != keys && !key_event_time_) key_event_time_ = std::chrono::steady_clock::now();
+  return msg;
+}
+
+MessageType Input::PressKey(SDL_Keycode code) {
+  MessageType msg = MSG_NONE;
+  switch (code) {
+    case SDLK_1:
+      key_[0x1] = 1;
+      break;
+    case SDLK_2:
+      key_[0x2] = 1;
+      break;
+    case SDLK_3:
+      key_[0x3] = 1;
+      break;
+    case SDLK_4:
+      key_[0xC] = 1;
+      break;
+    case SDLK_q:
+      key_[0x4] = 1;
+      break;
+    case SDLK_w:
+      key_[0x5] = 1;
+      break;
+    case SDLK_e:
+      key_[0x6] = 1;
+      break;
+    case SDLK_r:
+      key_[0xD] = 1;
+      break;
+    case SDLK_a:
+      key_[0x7] = 1;
+      break;
+    case SDLK_s:
+      key_[0x8] = 1;
+      break;
+    case SDLK_d:
+      key_[0x9] = 1;
+      break;
+    case SDLK_f:
+      key_[0xE] = 1;
+      break;
+    case SDLK_z:
+      key_[0xA] = 1;
+      break;
+    case SDLK_x:
+      key_[0x0] = 1;
+      break;
+    case SDLK_c:
+      key_[0xB] = 1;
+      break;
+    case SDLK_v:
+      key_[0xF] = 1;
+      break;
+    case SDLK_ESCAPE:
+      msg = MSG_SHUTDOWN;
+      break;
+    case SDLK_SPACE:
+      // allow only one push
+      if (space_is_released_) {
+        msg = MSG_CHANGE_SLEEP_STATE;
+        space_is_released_ = false;
+      }
+      break;
+    case SDLK_t:
+      msg = MSG_TICK_WHILE_SLEEP;
+      break;
+    case SDLK_MINUS:
+      msg = MSG_SPEED_DOWN;
+      break;
+    case SDLK_EQUALS:
+      msg = MSG_SPEED_UP;
+      break;
+    case SDLK_BACKSPACE:
+      msg = MSG_SPEED_RESET;
+      break;
+    case SDLK_F5:
+      msg = MSG_RELOAD;
+      break;
+    case SDLK_9: {
+      Color color {
+        rand_->GetRandomByte(),
+        rand_->GetRandomByte(),
+        rand_->GetRandomByte(),
+      };
+      graphic_.ChangeObjectColor(color);
+      msg = MSG_REDRAW;
+      break;
+    }
+    case SDLK_0: {
+      Color color {
+        rand_->GetRandomByte(),
+        rand_->GetRandomByte(),
+        rand_->GetRandomByte(),
+      };
+      graphic_.ChangeBackGroundColor(color);
+      msg = MSG_REDRAW;
+      break;
+    }
+  }
+  return msg;
+}
+
+void Input::ReleaseKey(SDL_Keycode code) {
+  switch (code) {
+    case SDLK_1:
+      key_[0x1] = 0;
+      break;
+    case SDLK_2:
+      key_[0x2] = 0;
+      break;
+    case SDLK_3:
+      key_[0x3] = 0;
+      break;
+    case SDLK_4:
+      key_[0xC] = 0;
+      break;
+    case SDLK_q:
+      key_[0x4] = 0;
+      break;
+    case SDLK_w:
+      key_[0x5] = 0;
+      break;
+    case SDLK_e:
+      key_[0x6] = 0;
+      break;
+    case SDLK_r:
+      key_[0xD] = 0;
+      break;
+    case SDLK_a:
+      key_[0x7] = 0;
+      break;
+    case SDLK_s:
+      key_[0x8] = 0;
+      break;
+    case SDLK_d:
+      key_[0x9] = 0;
+      break;
+    case SDLK_f:
+      key_[0xE] = 0;
+      break;
+    case SDLK_z:
+      key_[0xA] = 0;
+      break;
+    case SDLK_x:
+      key_[0x0] = 0;
+      break;
+    case SDLK_c:
+      key_[0xB] = 0;
+      break;
+    case SDLK_v:
+      key_[0xF] = 0;
+      break;
+    case SDLK_SPACE:
+      space_is_released_ = true;
+      break;
+  }
+}
+
+std::optional<std::chrono::steady_clock::time_point> Input::TakeKeyEventTime() {
+  return std::exchange(key_event_time_, std::nullopt);
+}
+
 }  // namespace chip8_emu
@@ -3,9 +3,12 @@
 #include <cstdint>
 #include <array>
 #include <memory>
+#include <chrono>
+#include <optional>
 
 #include "utils.hpp"
 #include "graphic.hpp"
+#include "terminal_input.hpp"
 
 namespace chip8_emu {
 
@@ -14,21 +17,40 @@ enum MessageType {
   MSG_CHANGE_SLEEP_STATE,
   MSG_TICK_WHILE_SLEEP,
   MSG_REDRAW,
+  MSG_SPEED_DOWN,
+  MSG_SPEED_UP,
+  MSG_SPEED_RESET,
+  MSG_RELOAD,
   MSG_SHUTDOWN,
 };
 
 class Input {
  public:
-  Input(std::shared_ptr<Graphic> graphic_);
+  Input(Graphic& graphic);
+  bool UseTerminal();  // reads keys from stdin instead of SDL events
   bool GetKey(uint8_t num) const;
-  MessageType ProcessInput();
+  void SetKey(uint8_t num, bool pressed);  // scripted input for headless runs
+  void SetExternalKeys(uint16_t keys);  // bit n holds key n down, on top of key_
+  MessageType ProcessInput(int timeout_ms = 0);  // blocks up to timeout_ms for the first event
+  void Wake();  // thread-safe, makes a blocked ProcessInput return
+  // When the first keypad event since the last call was queued, if there was one
+  std::optional<std::chrono::steady_clock::time_point> TakeKeyEventTime();
 
  private:
+  MessageType ProcessTerminalInput(int timeout_ms);
+  MessageType PressKey(SDL_Keycode code);  // MSG_NONE for keypad and unbound keys
+  void ReleaseKey(SDL_Keycode code);
+
   std::array<bool, 16> key_;
+  uint16_t external_keys_;
+  std::optional<std::chrono::steady_clock::time_point> key_event_time_;
+  uint32_t wake_event_;  // registered SDL event type, (uint32_t)-1 if none was left
 
   bool space_is_released_;
   std::unique_ptr<Rand> rand_;
-  std::shared_ptr<Graphic> graphic_;
+  Graphic& graphic_;
+  std::unique_ptr<TerminalInput> terminal_;
+  TerminalInput::Events terminal_events_;
 };
 
 } // namespace chip8_emu
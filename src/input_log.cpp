@@ -0,0 +1,40 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <iostream>
+#include <algorithm>
+
+#include "input_log.hpp"
+
+namespace chip8_emu {
+
+std::optional<std::vector<KeyEvent>> LoadInputLog(const std::string& path) {
+  std::ifstream ifs{path};
+  if (!ifs.is_open()) {
+    std::cerr << "Failed to open input log: " << path << std::endl;
+    return std::nullopt;
+  }
+
+  std::vector<KeyEvent> events;
+  std::string line;
+  for (int line_number = 1; std::getline(ifs, line); ++line_number) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream iss{line};
+    uint64_t frame;
+    unsigned key, pressed;
+    if (!(iss >> frame)) continue;  // blank line
+    if (!(iss >> std::hex >> key >> std::dec >> pressed) || key > 0xF || pressed > 1) {
+      std::cerr << path << ":" << line_number << ": invalid key event" << std::endl;
+      return std::nullopt;
+    }
+    events.push_back({frame, static_cast<uint8_t>(key), pressed == 1});
+  }
+  std::stable_sort(events.begin(), events.end(),
+    [](const KeyEvent& a, const KeyEvent& b) { return a.frame < b.frame; });
+  return events;
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <optional>
+
+namespace chip8_emu {
+
+// Key state change applied at the start of an emulated frame.
+struct KeyEvent {
+  uint64_t frame;
+  uint8_t key;
+  bool pressed;
+};
+
+// Input logs are text files with one "<frame> <key> <0|1>" event per line,
+// where key is a hex digit. '#' starts a comment. Events are returned sorted
+// by frame.
+std::optional<std::vector<KeyEvent>> LoadInputLog(const std::string& path);
+
+} // namespace chip8_emu
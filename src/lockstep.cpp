@@ -0,0 +1,188 @@
+#include <cstdio>
+#include <cstdint>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "lockstep.hpp"
+#include "chip8.hpp"
+#include "quirks.hpp"
+#include "input_log.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr size_t kHistorySize = 16;  // instructions printed before a divergence
+
+struct Engine {
+  const char* name;
+  void (Chip8::*step)();
+};
+
+// Engines that can be compared. Faster cores are added here as they appear
+// next to the interpreter.
+constexpr Engine kEngines[] = {
+  {"interp", &Chip8::Step},  // InterpretInstruction specialized on the quirks
+  {"aot", &Chip8::StepTranslated},  // the ROM's translation linked into emu_aot
+  {"core", &Chip8::StepCore},  // the compact core of the pool run, on the first 4 KB and plane 0
+};
+
+struct HistoryEntry {
+  uint64_t cycle;
+  uint16_t pc_a, inst_a;
+  uint16_t pc_b, inst_b;
+};
+
+class LockstepRun {
+ public:
+  LockstepRun(const std::string& rom, const EngineSpec& a, const EngineSpec& b, const LockstepOptions& options);
+  // Runs up to limit instructions and stops at the first mismatching check at
+  // or after check_from. Returns true on divergence.
+  bool Run(uint64_t limit, uint64_t check_from, uint64_t interval);
+  void PrintDivergence() const;
+  uint64_t GetExecuted() const { return executed_; }
+  uint64_t GetLastMatch() const { return last_match_; }
+
+ private:
+  std::unique_ptr<Chip8> CreateEngine(const std::string& rom, const EngineSpec& spec) const;
+  bool Matches() const;
+
+  uint64_t executed_;
+  uint64_t last_match_;
+  const EngineSpec& spec_a_;
+  const EngineSpec& spec_b_;
+  const LockstepOptions& options_;
+  std::unique_ptr<Chip8> a_;
+  std::unique_ptr<Chip8> b_;
+  std::array<HistoryEntry, kHistorySize> history_;
+};
+
+LockstepRun::LockstepRun(const std::string& rom, const EngineSpec& a, const EngineSpec& b,
+                         const LockstepOptions& options)
+    : executed_{0},
+      last_match_{0},
+      spec_a_{a},
+      spec_b_{b},
+      options_{options},
+      a_{CreateEngine(rom, a)},
+      b_{CreateEngine(rom, b)},
+      history_{} {}
+
+std::unique_ptr<Chip8> LockstepRun::CreateEngine(const std::string& rom, const EngineSpec& spec) const {
+  auto chip8 = std::make_unique<Chip8>(options_.cycles);
+  chip8->LoadROM(rom);
+  if (spec.quirks) {
+    chip8->SetQuirks(*spec.quirks);
+  } else if (options_.quirks) {
+    chip8->SetQuirks(*options_.quirks);
+  }
+  chip8->SetSeed(options_.seed);
+  if (spec.step == &Chip8::StepTranslated && !chip8->HasTranslation()) {
+    printf("Lockstep: no translation of this ROM with these quirks, %s interprets\n", spec.name.c_str());
+  }
+  return chip8;
+}
+
+bool LockstepRun::Matches() const {
+  return a_->IsRunning() == b_->IsRunning() && a_->GetStateHash() == b_->GetStateHash();
+}
+
+bool LockstepRun::Run(uint64_t limit, uint64_t check_from, uint64_t interval) {
+  size_t next_event = 0;
+  for (uint64_t frame = 0; executed_ < limit; ++frame) {
+    for (; next_event < options_.input_log.size() && options_.input_log[next_event].frame <= frame; ++next_event) {
+      const KeyEvent& event = options_.input_log[next_event];
+      a_->SetKey(event.key, event.pressed);
+      b_->SetKey(event.key, event.pressed);
+    }
+    const uint64_t budget = a_->BeginFrame(frame);
+    b_->BeginFrame(frame);
+
+    for (uint64_t n = 0; n < budget && executed_ < limit; ++n) {
+      history_[executed_ % kHistorySize] = {
+        executed_, a_->GetPc(), a_->GetNextInstruction(), b_->GetPc(), b_->GetNextInstruction()};
+      ((*a_).*spec_a_.step)();
+      ((*b_).*spec_b_.step)();
+      ++executed_;
+
+      const bool stopped = !a_->IsRunning() || !b_->IsRunning();
+      if ((executed_ % interval == 0 || stopped || executed_ == limit) && executed_ >= check_from) {
+        if (!Matches()) return true;
+        last_match_ = executed_;
+      }
+      if (stopped) {
+        printf("Lockstep: both engines stopped after %llu instructions (fault: %s)\n",
+          static_cast<unsigned long long>(executed_), FaultToString(a_->GetFault()));
+        return false;
+      }
+    }
+  }
+  return false;
+}
+
+void LockstepRun::PrintDivergence() const {
+  printf("Lockstep: diverged at instruction %llu (%s vs %s)\n",
+    static_cast<unsigned long long>(executed_ - 1), spec_a_.name.c_str(), spec_b_.name.c_str());
+  printf("  %12s %6s %6s | %6s %6s\n", "instruction", "pc", "inst", "pc", "inst");
+  const uint64_t first = executed_ > kHistorySize ? executed_ - kHistorySize : 0;
+  for (uint64_t cycle = first; cycle < executed_; ++cycle) {
+    const HistoryEntry& entry = history_[cycle % kHistorySize];
+    printf("  %12llu 0x%04X 0x%04X | 0x%04X 0x%04X%s\n", static_cast<unsigned long long>(entry.cycle),
+      entry.pc_a, entry.inst_a, entry.pc_b, entry.inst_b,
+      entry.pc_a != entry.pc_b || entry.inst_a != entry.inst_b ? " <" : "");
+  }
+  if (a_->IsRunning() != b_->IsRunning()) {
+    printf("  %s is %s (fault: %s), %s is %s (fault: %s)\n", spec_a_.name.c_str(),
+      a_->IsRunning() ? "running" : "stopped", FaultToString(a_->GetFault()), spec_b_.name.c_str(),
+      b_->IsRunning() ? "running" : "stopped", FaultToString(b_->GetFault()));
+  }
+  printf("State differences (%s != %s):\n", spec_a_.name.c_str(), spec_b_.name.c_str());
+  a_->PrintStateDiff(*b_);
+}
+
+} // namespace
+
+std::optional<EngineSpec> ParseEngine(const std::string& spec) {
+  const size_t colon = spec.find(':');
+  const std::string engine_name = spec.substr(0, colon);
+  for (const Engine& engine : kEngines) {
+    if (engine_name != engine.name) continue;
+    EngineSpec result{spec, engine.step, std::nullopt};
+    if (colon != std::string::npos) {
+      result.quirks = ParseQuirks(spec.substr(colon + 1));
+      if (!result.quirks) return std::nullopt;
+    }
+    return result;
+  }
+  return std::nullopt;
+}
+
+bool RunLockstep(const std::string& rom, const EngineSpec& a, const EngineSpec& b, const LockstepOptions& options) {
+  const auto start_time = std::chrono::steady_clock::now();
+  auto run = std::make_unique<LockstepRun>(rom, a, b, options);
+  bool diverged = run->Run(options.instructions, 0, options.interval);
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+
+  if (diverged && options.interval > 1) {
+    // Replay from reset and check every instruction since the last match
+    const uint64_t limit = run->GetExecuted();
+    const uint64_t check_from = run->GetLastMatch();
+    run = std::make_unique<LockstepRun>(rom, a, b, options);
+    diverged = run->Run(limit, check_from, 1);
+  }
+  if (diverged) {
+    run->PrintDivergence();
+    return false;
+  }
+
+  printf("Lockstep: %llu instructions identical (checked every %llu, %.2f MIPS per engine)\n",
+    static_cast<unsigned long long>(run->GetExecuted()), static_cast<unsigned long long>(options.interval),
+    run->GetExecuted() / elapsed.count() / 1e6);
+  return true;
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "chip8.hpp"
+#include "quirks.hpp"
+#include "input_log.hpp"
+
+namespace chip8_emu {
+
+// One side of a lockstep run: an execution engine and an optional quirk
+// profile, written as "<engine>[:<quirks>]" (e.g. "interp:vip").
+struct EngineSpec {
+  std::string name;
+  void (Chip8::*step)();         // executes one instruction
+  std::optional<Quirks> quirks;  // defaults to LockstepOptions::quirks
+};
+
+std::optional<EngineSpec> ParseEngine(const std::string& spec);
+
+struct LockstepOptions {
+  uint64_t instructions;
+  uint64_t interval;  // compare state hashes every interval instructions
+  uint32_t seed;
+  int cycles;
+  std::optional<Quirks> quirks;  // ROM database quirks if empty
+  std::vector<KeyEvent> input_log;
+};
+
+// Runs two engines side by side on the same ROM, random seed and input log,
+// and compares their full machine state. On the first divergence it prints
+// the instructions leading up to it and the differing state, and returns
+// false. A divergence found with an interval above 1 is replayed with
+// per-instruction checks to pin down the exact instruction.
+bool RunLockstep(const std::string& rom, const EngineSpec& a, const EngineSpec& b, const LockstepOptions& options);
+
+} // namespace chip8_emu
@@ -0,0 +1,155 @@
+#include <cstdio>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "metrics.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr std::array<const char*, kNumCounters> kCounterNames = {
+  "instructions", "frames", "presented_frames", "skipped_frames", "audio_buffers", "audio_underruns",
+};
+
+constexpr std::array<const char*, kNumHistograms> kHistogramNames = {
+  "frame_time", "render_time", "timer_drift", "input_latency",
+};
+
+double ToMilliseconds(uint64_t ns) {
+  return ns / 1e6;
+}
+
+}  // namespace
+
+void Histogram::Record(std::chrono::nanoseconds duration) {
+  const uint64_t ns = duration.count() > 0 ? duration.count() : 0;
+  const uint64_t us = ns / 1000;
+  const int bucket = std::min<int>(std::bit_width(us), kNumBuckets - 1);
+  buckets_[bucket].Add(1);
+  total_ns_.Add(ns);
+  if (ns > max_ns_.load(std::memory_order_relaxed)) max_ns_.store(ns, std::memory_order_relaxed);
+}
+
+Histogram::Summary Histogram::Summarize() const {
+  // Read without synchronization, so counts may be a few records apart
+  std::array<uint64_t, kNumBuckets> counts;
+  uint64_t count = 0;
+  for (int b = 0; b < kNumBuckets; ++b) {
+    counts[b] = buckets_[b].Get();
+    count += counts[b];
+  }
+  const double max_ms = ToMilliseconds(max_ns_.load(std::memory_order_relaxed));
+  const auto percentile = [&](uint64_t per_mille) {
+    const uint64_t rank = (count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int b = 0; b < kNumBuckets; ++b) {
+      seen += counts[b];
+      if (seen >= rank && seen > 0) return std::min(ToMilliseconds((uint64_t{1} << b) * 1000), max_ms);
+    }
+    return 0.0;
+  };
+  return {count, count > 0 ? ToMilliseconds(total_ns_.Get()) / count : 0.0, percentile(500), percentile(990), max_ms};
+}
+
+Metrics::Metrics()
+    : counters_{},
+      histograms_{},
+      start_time_{std::chrono::steady_clock::now()},
+      overlay_time_{start_time_},
+      overlay_instructions_{0},
+      overlay_presented_frames_{0},
+      overlay_{},
+      stats_path_{},
+      mutex_{},
+      condition_{},
+      stop_{false},
+      thread_{} {}
+
+Metrics::~Metrics() {
+  if (!thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  condition_.notify_one();
+  thread_.join();
+  WriteStatsFile();  // final values
+}
+
+bool Metrics::StartStatsFile(const std::string& path) {
+  stats_path_ = path;
+  if (!std::ofstream{path}) {
+    std::cerr << "Failed to open stats file: " << path << std::endl;
+    return false;
+  }
+  WriteStatsFile();
+  thread_ = std::thread([this] {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!condition_.wait_for(lock, kStatsInterval, [this] { return stop_; })) {
+      lock.unlock();
+      WriteStatsFile();
+      lock.lock();
+    }
+  });
+  return true;
+}
+
+void Metrics::WriteStatsFile() {
+  const std::string temporary_path = stats_path_ + ".tmp";
+  {
+    std::ofstream ofs{temporary_path};
+    ofs << ToJson();
+    if (!ofs) return;
+  }
+  std::rename(temporary_path.c_str(), stats_path_.c_str());
+}
+
+std::string Metrics::ToJson() const {
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time_).count();
+  std::ostringstream oss;
+  oss << "{\n  \"seconds\": " << seconds << ",\n  \"counters\": {";
+  for (size_t k = 0; k < kNumCounters; ++k) {
+    oss << (k > 0 ? "," : "") << "\n    \"" << kCounterNames[k] << "\": " << counters_[k].counter.Get();
+  }
+  oss << "\n  },\n  \"histograms_ms\": {";
+  for (size_t k = 0; k < kNumHistograms; ++k) {
+    const Histogram::Summary summary = histograms_[k].histogram.Summarize();
+    oss << (k > 0 ? "," : "") << "\n    \"" << kHistogramNames[k] << "\": {\"count\": " << summary.count
+        << ", \"mean\": " << summary.mean_ms << ", \"p50\": " << summary.p50_ms << ", \"p99\": " << summary.p99_ms
+        << ", \"max\": " << summary.max_ms << "}";
+  }
+  oss << "\n  }\n}\n";
+  return oss.str();
+}
+
+bool Metrics::UpdateOverlay(std::chrono::steady_clock::time_point now) {
+  const auto elapsed = now - overlay_time_;
+  if (elapsed < kOverlayInterval) return false;
+  const double seconds = std::chrono::duration<double>(elapsed).count();
+  const uint64_t instructions = Get(CounterId::kInstructions).Get();
+  const uint64_t presented_frames = Get(CounterId::kPresentedFrames).Get();
+  std::snprintf(overlay_.data(), overlay_.size(),
+                "MIPS %.2f  FPS %.1f  SKIPPED %llu\n"
+                "FRAME %.2f  RENDER %.2f MS P99\n"
+                "DRIFT %.2f  INPUT %.1f MS P99\n"
+                "UNDERRUNS %llu",
+                (instructions - overlay_instructions_) / seconds / 1e6,
+                (presented_frames - overlay_presented_frames_) / seconds,
+                static_cast<unsigned long long>(Get(CounterId::kSkippedFrames).Get()),
+                Get(HistogramId::kFrameTime).Summarize().p99_ms, Get(HistogramId::kRenderTime).Summarize().p99_ms,
+                Get(HistogramId::kTimerDrift).Summarize().p99_ms, Get(HistogramId::kInputLatency).Summarize().p99_ms,
+                static_cast<unsigned long long>(Get(CounterId::kAudioUnderruns).Get()));
+  overlay_time_ = now;
+  overlay_instructions_ = instructions;
+  overlay_presented_frames_ = presented_frames;
+  return true;
+}
+
+} // namespace chip8_emu
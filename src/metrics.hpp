@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace chip8_emu {
+
+// Counter with a single writing thread. Add is a relaxed load and store
+// rather than a locked read-modify-write, so counting costs a plain add;
+// any thread may read.
+class Counter {
+ public:
+  void Add(uint64_t n) { value_.store(value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+  uint64_t Get() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// Durations in power-of-two microsecond buckets, with the same single-writer
+// rule as Counter. Bucket b counts durations below 2^b us.
+class Histogram {
+ public:
+  static constexpr int kNumBuckets = 24;  // the last one also takes everything from 8 s on
+
+  struct Summary {
+    uint64_t count;
+    double mean_ms;
+    double p50_ms;  // upper bound of the bucket holding the percentile, at most max_ms
+    double p99_ms;
+    double max_ms;
+  };
+
+  void Record(std::chrono::nanoseconds duration);
+  Summary Summarize() const;
+
+ private:
+  std::array<Counter, kNumBuckets> buckets_;
+  Counter total_ns_;
+  std::atomic<uint64_t> max_ns_{0};
+};
+
+enum class CounterId {
+  kInstructions,     // run loop, per emulated frame
+  kFrames,           // emulated
+  kPresentedFrames,
+  kSkippedFrames,    // emulated but not presented, the host being late
+  kAudioBuffers,     // mixed by the audio thread
+  kAudioUnderruns,   // audio buffers mixed late enough for the device to run dry
+  kNumCounters,
+};
+
+enum class HistogramId {
+  kFrameTime,     // host frame work: emulation, run-ahead and rendering
+  kRenderTime,    // Graphic::Render, including the present
+  kTimerDrift,    // late delay timer ticks, or late host frames with emulated timers
+  kInputLatency,  // key event to the next present
+  kNumHistograms,
+};
+
+constexpr size_t kNumCounters = static_cast<size_t>(CounterId::kNumCounters);
+constexpr size_t kNumHistograms = static_cast<size_t>(HistogramId::kNumHistograms);
+constexpr size_t kOverlaySize = 192;  // characters of the overlay text, lines separated by '\n'
+constexpr std::chrono::seconds kStatsInterval{1};
+
+// Registry of the emulator's runtime metrics. Each metric is written by one
+// thread (the run loop, the delay timer or the audio callback) and is padded
+// to its own cache line. The stats file is rewritten every kStatsInterval
+// by a thread of its own, as JSON, through a temporary file and a rename so
+// that a scraper never sees a partial file.
+class Metrics {
+ public:
+  Metrics();
+  ~Metrics();
+  Counter& Get(CounterId id) { return counters_[static_cast<size_t>(id)].counter; }
+  Histogram& Get(HistogramId id) { return histograms_[static_cast<size_t>(id)].histogram; }
+  bool StartStatsFile(const std::string& path);
+  std::string ToJson() const;
+  // Reformats the overlay text at most every kOverlayInterval, with rates
+  // over the time since the previous update, and returns true if it did.
+  // Called by the run loop, so it never allocates.
+  bool UpdateOverlay(std::chrono::steady_clock::time_point now);
+  const char* GetOverlay() const { return overlay_.data(); }
+
+ private:
+  static constexpr std::chrono::milliseconds kOverlayInterval{500};
+
+  struct alignas(64) PaddedCounter {
+    Counter counter;
+  };
+  struct alignas(64) PaddedHistogram {
+    Histogram histogram;
+  };
+
+  void WriteStatsFile();
+
+  std::array<PaddedCounter, kNumCounters> counters_;
+  std::array<PaddedHistogram, kNumHistograms> histograms_;
+  const std::chrono::steady_clock::time_point start_time_;
+
+  // Run loop only
+  std::chrono::steady_clock::time_point overlay_time_;
+  uint64_t overlay_instructions_;
+  uint64_t overlay_presented_frames_;
+  std::array<char, kOverlaySize> overlay_;
+
+  std::string stats_path_;
+  std::mutex mutex_;
+  std::condition_variable condition_;  // wakes the stats thread to stop
+  bool stop_;
+  std::thread thread_;
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,56 @@
+#include <string>
+#include <sstream>
+#include <optional>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+const char* const kQuirkNames[kNumQuirks] = {
+  "vf_reset",
+  "memory_increment",
+  "index_overflow",
+  "jump_vx",
+  "clip",
+  "shift_vy",
+};
+
+} // namespace
+
+std::optional<Quirks> ParseQuirks(const std::string& spec) {
+  if (spec == "chip8") return kChip8Quirks;
+  if (spec == "vip") return kVipQuirks;
+  if (spec == "schip") return kSchipQuirks;
+  if (spec == "xochip") return kXoChipQuirks;
+  if (spec == "none") return Quirks::FromBits(0);
+
+  uint8_t bits = 0;
+  std::istringstream iss{spec};
+  std::string name;
+  while (std::getline(iss, name, ',')) {
+    bool found = false;
+    for (int i = 0; i < kNumQuirks; ++i) {
+      if (name == kQuirkNames[i]) {
+        bits |= 1 << i;
+        found = true;
+      }
+    }
+    if (!found) return std::nullopt;
+  }
+  return Quirks::FromBits(bits);
+}
+
+std::string QuirksToString(const Quirks& quirks) {
+  const uint8_t bits = quirks.ToBits();
+  std::string str;
+  for (int i = 0; i < kNumQuirks; ++i) {
+    if (!(bits & (1 << i))) continue;
+    if (!str.empty()) str += ',';
+    str += kQuirkNames[i];
+  }
+  return str.empty() ? "none" : str;
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <optional>
+
+namespace chip8_emu {
+
+// Behaviors that differ between CHIP-8 implementations.
+// Quirks is used as a template parameter of the interpreter, so every
+// profile gets its own instantiation and the hot loop has no quirk branches.
+struct Quirks {
+  bool vf_reset;          // 8xy1/8xy2/8xy3 reset VF (COSMAC VIP)
+  bool memory_increment;  // Fx55/Fx65 increment I (COSMAC VIP)
+  bool index_overflow;    // Fx1E sets VF when I overflows 0xFFF (Amiga)
+  bool jump_vx;           // Bxnn jumps to xnn + Vx instead of nnn + V0 (SUPER-CHIP)
+  bool clip_sprites;      // Dxyn clips at the screen edges instead of wrapping
+  bool shift_vy;          // 8xy6/8xyE shift Vy into Vx instead of shifting Vx (COSMAC VIP)
+
+  constexpr uint8_t ToBits() const {
+    return vf_reset | memory_increment << 1 | index_overflow << 2 |
+           jump_vx << 3 | clip_sprites << 4 | shift_vy << 5;
+  }
+  static constexpr Quirks FromBits(uint8_t bits) {
+    return {
+      (bits & 0x01) != 0,
+      (bits & 0x02) != 0,
+      (bits & 0x04) != 0,
+      (bits & 0x08) != 0,
+      (bits & 0x10) != 0,
+      (bits & 0x20) != 0,
+    };
+  }
+};
+
+constexpr int kNumQuirks = 6;
+
+// Behavior of this emulator before quirk profiles existed
+constexpr Quirks kChip8Quirks{true, true, true, false, true, false};
+constexpr Quirks kVipQuirks{true, true, false, false, true, true};
+constexpr Quirks kSchipQuirks{false, false, false, true, true, false};
+constexpr Quirks kXoChipQuirks{false, true, false, false, false, true};
+
+// Accepts a profile name ("chip8", "vip", "schip", "xochip"), "none" or a
+// comma-separated list of quirk names for a custom profile.
+std::optional<Quirks> ParseQuirks(const std::string& spec);
+std::string QuirksToString(const Quirks& quirks);
+
+} // namespace chip8_emu
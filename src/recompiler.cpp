@@ -0,0 +1,457 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "recompiler.hpp"
+#include "chip8.hpp"
+#include "graphic.hpp"
+#include "quirks.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr uint32_t kProgramStart = 0x200;
+
+std::string Format(const char* format, ...) {
+  char buffer[1024];
+  va_list args;
+  va_start(args, format);
+  std::vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return buffer;
+}
+
+class Recompiler {
+ public:
+  Recompiler(const std::vector<uint8_t>& rom, const Quirks& quirks);
+  void Analyze();
+  void Write(std::ostream& os, const std::string& rom, const std::string& sha1) const;
+  size_t GetNumBlocks() const { return blocks_.size(); }
+  size_t GetNumInstructions() const;
+  size_t GetNumInterpreted() const;
+
+ private:
+  struct Block {
+    uint32_t begin;
+    std::vector<uint32_t> instructions;  // addresses
+  };
+
+  uint16_t Fetch(uint32_t addr) const;
+  uint32_t GetLength(uint32_t addr) const;
+  bool IsInstruction(uint32_t addr) const;  // within the ROM
+  bool IsValid(uint16_t inst) const;
+  bool IsSkip(uint16_t inst) const;
+  bool IsTerminator(uint16_t inst) const;  // ends its block
+  bool IsInlined(uint16_t inst) const;
+  std::vector<uint32_t> GetSuccessors(uint32_t addr) const;
+  std::string TranslateInstruction(uint32_t addr) const;  // statements for inlined instructions
+  void WriteInstruction(std::ostream& os, uint32_t addr, bool last) const;
+
+  std::vector<uint8_t> mem_;
+  uint32_t end_;  // one past the ROM
+  Quirks quirks_;
+  std::vector<bool> reached_;
+  std::vector<bool> leaders_;
+  std::vector<Block> blocks_;
+};
+
+Recompiler::Recompiler(const std::vector<uint8_t>& rom, const Quirks& quirks)
+    : mem_(kMemorySize, 0),
+      end_{static_cast<uint32_t>(kProgramStart + rom.size())},
+      quirks_{quirks},
+      reached_(kMemorySize, false),
+      leaders_(kMemorySize, false),
+      blocks_{} {
+  std::copy(rom.begin(), rom.end(), mem_.begin() + kProgramStart);
+}
+
+uint16_t Recompiler::Fetch(uint32_t addr) const {
+  return (mem_[addr & 0xFFFF] << 8) | mem_[(addr + 1) & 0xFFFF];
+}
+
+uint32_t Recompiler::GetLength(uint32_t addr) const {
+  return Fetch(addr) == 0xF000 ? 4 : 2;
+}
+
+bool Recompiler::IsInstruction(uint32_t addr) const {
+  return addr >= kProgramStart && addr + GetLength(addr) <= end_;
+}
+
+bool Recompiler::IsValid(uint16_t inst) const {
+  switch (inst & 0xF000) {
+    case 0x0000:
+      return (inst & 0xFFE0) == 0x00C0 || inst == 0x00E0 || inst == 0x00EE || (inst >= 0x00FB && inst <= 0x00FF);
+    case 0x5000:
+      return (inst & 0x000F) == 0x0 || (inst & 0x000F) == 0x2 || (inst & 0x000F) == 0x3;
+    case 0x8000:
+      return (inst & 0x000F) <= 0x7 || (inst & 0x000F) == 0xE;
+    case 0xE000:
+      return (inst & 0x00FF) == 0x9E || (inst & 0x00FF) == 0xA1;
+    case 0xF000:
+      switch (inst & 0x00FF) {
+        case 0x00:
+          return inst == 0xF000;
+        case 0x01: case 0x02: case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E: case 0x29:
+        case 0x30: case 0x33: case 0x3A: case 0x55: case 0x65: case 0x75: case 0x85:
+          return true;
+      }
+      return false;
+  }
+  return true;
+}
+
+bool Recompiler::IsSkip(uint16_t inst) const {
+  switch (inst & 0xF000) {
+    case 0x3000:
+    case 0x4000:
+    case 0x9000:
+      return true;
+    case 0x5000:
+      return (inst & 0x000F) == 0x0;
+    case 0xE000:
+      return IsValid(inst);
+  }
+  return false;
+}
+
+bool Recompiler::IsTerminator(uint16_t inst) const {
+  if (!IsValid(inst) || IsSkip(inst)) return true;
+  switch (inst & 0xF000) {
+    case 0x0000:
+      return inst == 0x00EE || inst == 0x00FD;
+    case 0x1000:
+    case 0x2000:
+    case 0xB000:
+      return true;
+    case 0x5000:
+      return (inst & 0x000F) == 0x2;  // writes memory, possibly this block
+    case 0xF000:
+      return (inst & 0x00FF) == 0x33 || (inst & 0x00FF) == 0x55;
+  }
+  return false;
+}
+
+bool Recompiler::IsInlined(uint16_t inst) const {
+  if (!IsValid(inst)) return false;
+  switch (inst & 0xF000) {
+    case 0x0000:
+      return inst == 0x00EE;
+    case 0x1000: case 0x2000: case 0x3000: case 0x4000: case 0x6000: case 0x7000: case 0x8000:
+    case 0x9000: case 0xA000:
+      return true;
+    case 0x5000:
+      return (inst & 0x000F) == 0x0;
+    case 0xF000:
+      switch (inst & 0x00FF) {
+        case 0x00: case 0x1E: case 0x29: case 0x30: case 0x65:
+          return true;
+      }
+      return false;
+  }
+  return false;
+}
+
+std::vector<uint32_t> Recompiler::GetSuccessors(uint32_t addr) const {
+  const uint16_t inst = Fetch(addr);
+  const uint32_t next = addr + GetLength(addr);
+  if (!IsValid(inst) || inst == 0x00EE || inst == 0x00FD || (inst & 0xF000) == 0xB000) return {};
+  if ((inst & 0xF000) == 0x1000) return {inst & 0x0FFFu};
+  if ((inst & 0xF000) == 0x2000) return {inst & 0x0FFFu, next};
+  if (IsSkip(inst)) return {next, next + GetLength(next)};  // as Chip8::SkipInstruction
+  return {next};
+}
+
+void Recompiler::Analyze() {
+  // Follow the control flow, and count the edges into each instruction
+  std::vector<uint8_t> predecessors(kMemorySize, 0);
+  std::vector<uint32_t> worklist{kProgramStart};
+  reached_[kProgramStart] = IsInstruction(kProgramStart);
+  leaders_[kProgramStart] = true;
+  if (!reached_[kProgramStart]) return;
+  while (!worklist.empty()) {
+    const uint32_t addr = worklist.back();
+    worklist.pop_back();
+    const bool terminator = IsTerminator(Fetch(addr));
+    for (uint32_t successor : GetSuccessors(addr)) {
+      if (!IsInstruction(successor)) continue;
+      if (terminator || ++predecessors[successor] > 1) leaders_[successor] = true;
+      if (!reached_[successor]) {
+        reached_[successor] = true;
+        worklist.push_back(successor);
+      }
+    }
+  }
+
+  // Basic blocks run from a leader up to a terminator or the next leader
+  for (uint32_t begin = kProgramStart; begin < end_; ++begin) {
+    if (!reached_[begin] || !leaders_[begin]) continue;
+    Block block{begin, {}};
+    for (uint32_t addr = begin;; addr += GetLength(addr)) {
+      block.instructions.push_back(addr);
+      if (IsTerminator(Fetch(addr))) break;
+      const uint32_t next = addr + GetLength(addr);
+      if (!IsInstruction(next) || !reached_[next] || leaders_[next]) break;
+    }
+    blocks_.push_back(std::move(block));
+  }
+}
+
+size_t Recompiler::GetNumInstructions() const {
+  size_t count = 0;
+  for (const Block& block : blocks_) count += block.instructions.size();
+  return count;
+}
+
+size_t Recompiler::GetNumInterpreted() const {
+  size_t count = 0;
+  for (const Block& block : blocks_) {
+    for (uint32_t addr : block.instructions) count += !IsInlined(Fetch(addr));
+  }
+  return count;
+}
+
+std::string Recompiler::TranslateInstruction(uint32_t addr) const {
+  const uint16_t inst = Fetch(addr);
+  const unsigned x = (inst & 0x0F00) >> 8;
+  const unsigned y = (inst & 0x00F0) >> 4;
+  const unsigned kk = inst & 0x00FF;
+  const unsigned nnn = inst & 0x0FFF;
+  const unsigned next = addr + GetLength(addr);
+  switch (inst & 0xF000) {
+    case 0x0000:  // 00EE
+      return Format(
+        "      if (*c.sp == 0) {\n"
+        "        *c.pc = 0x%04X;\n"
+        "        AotInterpret(c);  // stack underflow\n"
+        "        --budget;\n"
+        "        return;\n"
+        "      }\n"
+        "      *c.pc = c.stack[--*c.sp] + 2;\n", addr);
+    case 0x1000:
+      return Format("      *c.pc = 0x%04X;\n", nnn);
+    case 0x2000:
+      return Format(
+        "      if (*c.sp == %zu) {\n"
+        "        *c.pc = 0x%04X;\n"
+        "        AotInterpret(c);  // stack overflow\n"
+        "        --budget;\n"
+        "        return;\n"
+        "      }\n"
+        "      c.stack[(*c.sp)++] = 0x%04X;\n"
+        "      *c.pc = 0x%04X;\n", kStackSize, addr, addr, nnn);
+    case 0x3000:
+    case 0x4000:
+    case 0x5000:
+    case 0x9000: {
+      const char* op = (inst & 0xF000) == 0x3000 || (inst & 0xF000) == 0x5000 ? "==" : "!=";
+      const std::string operand = (inst & 0xF000) == 0x3000 || (inst & 0xF000) == 0x4000
+        ? Format("0x%02X", kk) : Format("c.v[0x%X]", y);
+      return Format("      *c.pc = c.v[0x%X] %s %s ? 0x%04X : 0x%04X;\n",
+        x, op, operand.c_str(), next + GetLength(next), next);
+    }
+    case 0x6000:
+      return Format("      c.v[0x%X] = 0x%02X;\n", x, kk);
+    case 0x7000:
+      return Format("      c.v[0x%X] += 0x%02X;\n", x, kk);
+    case 0x8000: {
+      const std::string reset = quirks_.vf_reset ? "      c.v[0xF] = 0;\n" : "";
+      const unsigned src = quirks_.shift_vy ? y : x;
+      switch (inst & 0x000F) {
+        case 0x0:
+          return Format("      c.v[0x%X] = c.v[0x%X];\n", x, y);
+        case 0x1:
+          return Format("      c.v[0x%X] |= c.v[0x%X];\n", x, y) + reset;
+        case 0x2:
+          return Format("      c.v[0x%X] &= c.v[0x%X];\n", x, y) + reset;
+        case 0x3:
+          return Format("      c.v[0x%X] ^= c.v[0x%X];\n", x, y) + reset;
+        case 0x4:
+          return Format(
+            "      {\n"
+            "        const unsigned sum = c.v[0x%X] + c.v[0x%X];\n"
+            "        c.v[0xF] = sum > 0xFF;\n"
+            "        c.v[0x%X] = sum & 0xFF;\n"
+            "      }\n", x, y, x);
+        case 0x5:
+          return Format(
+            "      c.v[0xF] = c.v[0x%X] > c.v[0x%X];\n"
+            "      c.v[0x%X] -= c.v[0x%X];\n", x, y, x, y);
+        case 0x6:
+          return Format(
+            "      {\n"
+            "        const uint8_t src = c.v[0x%X];\n"
+            "        c.v[0x%X] = src >> 1;\n"
+            "        c.v[0xF] = src & 0x01;\n"
+            "      }\n", src, x);
+        case 0x7:
+          return Format(
+            "      c.v[0xF] = c.v[0x%X] > c.v[0x%X];\n"
+            "      c.v[0x%X] = c.v[0x%X] - c.v[0x%X];\n", y, x, x, y, x);
+        case 0xE:
+          return Format(
+            "      {\n"
+            "        const uint8_t src = c.v[0x%X];\n"
+            "        c.v[0x%X] = src << 1;\n"
+            "        c.v[0xF] = src >> 7;\n"
+            "      }\n", src, x);
+      }
+      break;
+    }
+    case 0xA000:
+      return Format("      *c.i = 0x%03X;\n", nnn);
+    case 0xF000:
+      switch (inst & 0x00FF) {
+        case 0x00:
+          return Format("      *c.i = 0x%04X;\n", Fetch(addr + 2));
+        case 0x1E:
+          if (quirks_.index_overflow) {
+            return Format(
+              "      *c.i += c.v[0x%X];\n"
+              "      c.v[0xF] = *c.i > 0x0FFF;\n", x);
+          }
+          return Format("      *c.i += c.v[0x%X];\n", x);
+        case 0x29:
+          return Format("      *c.i = 5 * c.v[0x%X];\n", x);
+        case 0x30:
+          return Format("      *c.i = 0x%03X + 10 * (c.v[0x%X] & 0x0F);\n", kBigSpritesAddress, x);
+        case 0x65: {
+          std::string code;
+          for (unsigned k = 0; k <= x; ++k) {
+            code += Format("      c.v[0x%X] = c.mem[static_cast<uint16_t>(*c.i + %u)];\n", k, k);
+          }
+          if (quirks_.memory_increment) code += Format("      *c.i += %u;\n", x + 1);
+          return code;
+        }
+      }
+      break;
+  }
+  return {};
+}
+
+void Recompiler::WriteInstruction(std::ostream& os, uint32_t addr, bool last) const {
+  const uint16_t inst = Fetch(addr);
+  const uint32_t next = addr + GetLength(addr);
+  os << Format("    case 0x%04X:  // %04X\n", addr, inst);
+  if (!IsInlined(inst)) {
+    os << Format("      *c.pc = 0x%04X;\n", addr);
+    os << "      AotInterpret(c);\n";
+    if (last || IsTerminator(inst)) {
+      os << "      --budget;\n"
+            "      return;\n";
+    } else {
+      os << Format("      if (--budget == 0 || *c.pc != 0x%04X) return;\n", next);
+      os << "      [[fallthrough]];\n";
+    }
+    return;
+  }
+
+  os << TranslateInstruction(addr);
+  if (IsTerminator(inst)) {
+    os << "      --budget;\n"
+          "      return;\n";
+  } else if (last) {
+    os << Format("      *c.pc = 0x%04X;\n", next);
+    os << "      --budget;\n"
+          "      return;\n";
+  } else {
+    os << Format("      if (--budget == 0) {\n"
+                 "        *c.pc = 0x%04X;\n"
+                 "        return;\n"
+                 "      }\n", next);
+    os << "      [[fallthrough]];\n";
+  }
+}
+
+void Recompiler::Write(std::ostream& os, const std::string& rom, const std::string& sha1) const {
+  os << "// Translated from " << rom << " by emu -A. Do not edit.\n";
+  os << "// Quirks: " << QuirksToString(quirks_) << "\n\n";
+  os << "#include <cstdint>\n\n";
+  os << "#include \"aot.hpp\"\n\n";
+  os << "namespace {\n\n";
+  os << "using chip8_emu::AotContext;\n";
+  os << "using chip8_emu::AotInterpret;\n\n";
+
+  for (const Block& block : blocks_) {
+    os << Format("void Block_%04X(AotContext& c, uint64_t& budget) {\n", block.begin);
+    os << "  switch (*c.pc) {\n";
+    for (size_t k = 0; k < block.instructions.size(); ++k) {
+      WriteInstruction(os, block.instructions[k], k + 1 == block.instructions.size());
+    }
+    os << "  }\n";
+    os << "}\n\n";
+  }
+
+  os << "const chip8_emu::AotBlock kBlocks[] = {\n";
+  for (const Block& block : blocks_) {
+    const uint32_t last = block.instructions.back();
+    os << Format("  {0x%04X, 0x%04X, &Block_%04X},\n", block.begin, last + GetLength(last), block.begin);
+  }
+  os << "};\n\n";
+
+  os << "const chip8_emu::AotEntry kEntries[] = {\n";
+  for (size_t index = 0; index < blocks_.size(); ++index) {
+    for (uint32_t addr : blocks_[index].instructions) os << Format("  {0x%04X, %zu},\n", addr, index);
+  }
+  os << "};\n\n";
+
+  const uint32_t last = blocks_.back().instructions.back();
+  os << "const chip8_emu::AotTranslation kTranslation{\n";
+  os << "  \"" << sha1 << "\",\n";
+  os << Format("  0x%02X,\n", quirks_.ToBits());
+  os << Format("  0x%04X,\n", blocks_.front().begin);
+  os << Format("  0x%04X,\n", last + GetLength(last));
+  os << "  kBlocks,\n";
+  os << "  sizeof(kBlocks) / sizeof(kBlocks[0]),\n";
+  os << "  kEntries,\n";
+  os << "  sizeof(kEntries) / sizeof(kEntries[0]),\n";
+  os << "};\n\n";
+  os << "[[maybe_unused]] const bool kRegistered = chip8_emu::RegisterAotTranslation(kTranslation);\n\n";
+  os << "}  // namespace\n";
+}
+
+}  // namespace
+
+bool WriteTranslation(const std::string& rom, const std::optional<Quirks>& quirks, const std::string& output) {
+  std::ifstream ifs{rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    std::cerr << "Failed to open ROM: " << rom << std::endl;
+    return false;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  if (kProgramStart + data.size() > kMemorySize) {
+    std::cerr << "ROM size is too large" << std::endl;
+    return false;
+  }
+  const std::string sha1 = Sha1(data);
+
+  Recompiler recompiler{data, quirks.value_or(LookUpQuirks(sha1).value_or(kChip8Quirks))};
+  recompiler.Analyze();
+  if (recompiler.GetNumBlocks() == 0) {
+    std::cerr << "No instructions to translate in " << rom << std::endl;
+    return false;
+  }
+
+  std::ofstream ofs{output};
+  if (!ofs.is_open()) {
+    std::cerr << "Failed to open " << output << std::endl;
+    return false;
+  }
+  recompiler.Write(ofs, rom, sha1);
+  if (!ofs) {
+    std::cerr << "Failed to write " << output << std::endl;
+    return false;
+  }
+  printf("Translated %zu instructions in %zu blocks to %s (%zu left to the interpreter)\n",
+    recompiler.GetNumInstructions(), recompiler.GetNumBlocks(), output.c_str(), recompiler.GetNumInterpreted());
+  return true;
+}
+
+} // namespace chip8_emu
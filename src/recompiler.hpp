@@ -0,0 +1,19 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+// Ahead-of-time recompiler. Follows the control flow of a ROM from 0x200
+// through jumps, calls and skips, and writes a C++ translation unit with one
+// function per basic block, which registers itself as an AotTranslation.
+// Linked into emu_aot (make aot), it replaces the interpreter in headless
+// runs of that ROM with the same quirks (the ROM database's if not given).
+// Register, stack and I instructions are translated; display, input, timers,
+// random numbers, memory writes and indirect jumps go to the interpreter.
+bool WriteTranslation(const std::string& rom, const std::optional<Quirks>& quirks, const std::string& output);
+
+} // namespace chip8_emu
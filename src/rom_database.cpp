@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <optional>
+#include <bit>
+
+#include "rom_database.hpp"
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+const std::string kRomDatabasePath{"../database/quirks.txt"};
+
+namespace {
+
+std::filesystem::path ResolveRomDatabasePath() {
+  std::error_code error;
+  const std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+  // Without /proc the path stays relative to the working directory
+  if (error) return kRomDatabasePath;
+  return (executable.parent_path() / kRomDatabasePath).lexically_normal();
+}
+
+void HashSha1Block(std::array<uint32_t, 5>& h, const uint8_t* block) {
+  std::array<uint32_t, 80> w;
+  for (int i = 0; i < 16; ++i) {
+    w[i] = block[4 * i] << 24 | block[4 * i + 1] << 16 | block[4 * i + 2] << 8 | block[4 * i + 3];
+  }
+  for (int i = 16; i < 80; ++i) {
+    w[i] = std::rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+  for (int i = 0; i < 80; ++i) {
+    uint32_t f, k;
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDC;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6;
+    }
+    const uint32_t tmp = std::rotl(a, 5) + f + e + k + w[i];
+    e = d;
+    d = c;
+    c = std::rotl(b, 30);
+    b = a;
+    a = tmp;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+}
+
+} // namespace
+
+void Sha1(const std::vector<uint8_t>& data, Sha1Digest& digest) {
+  std::array<uint32_t, 5> h = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+  // Whole blocks straight from the data, then the padded tail in one or two more
+  const size_t whole = data.size() / 64 * 64;
+  for (size_t chunk = 0; chunk < whole; chunk += 64) HashSha1Block(h, data.data() + chunk);
+  std::array<uint8_t, 128> tail{};
+  std::copy(data.begin() + whole, data.end(), tail.begin());
+  tail[data.size() - whole] = 0x80;
+  const size_t tail_size = data.size() - whole < 56 ? 64 : 128;
+  const uint64_t bit_length = static_cast<uint64_t>(data.size()) * 8;
+  for (int i = 0; i < 8; ++i) tail[tail_size - 1 - i] = static_cast<uint8_t>(bit_length >> (i * 8));
+  for (size_t chunk = 0; chunk < tail_size; chunk += 64) HashSha1Block(h, tail.data() + chunk);
+
+  static const char kHex[] = "0123456789abcdef";
+  for (size_t k = 0; k < digest.size(); ++k) digest[k] = kHex[(h[k / 8] >> (28 - k % 8 * 4)) & 0xF];
+}
+
+std::string Sha1(const std::vector<uint8_t>& data) {
+  Sha1Digest digest;
+  Sha1(data, digest);
+  return {digest.begin(), digest.end()};
+}
+
+std::optional<Quirks> LookUpQuirks(const std::string& sha1) {
+  const std::filesystem::path path = ResolveRomDatabasePath();
+  std::ifstream ifs{path};
+  if (!ifs.is_open()) {
+    std::cerr << "Failed to open the ROM database " << path << ", using the default quirks" << std::endl;
+    return std::nullopt;
+  }
+  std::string line;
+  while (std::getline(ifs, line)) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream iss{line};
+    std::string hash, spec;
+    if (!(iss >> hash >> spec)) continue;
+    if (hash == sha1) return ParseQuirks(spec);
+  }
+  return std::nullopt;
+}
+
+} // namespace chip8_emu
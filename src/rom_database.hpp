@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "quirks.hpp"
+
+namespace chip8_emu {
+
+extern const std::string kRomDatabasePath;  // relative to the executable's directory
+
+// SHA-1 of the ROM image as 40 lowercase hex digits, the same key used by
+// the community CHIP-8 database, so entries can be copied from there.
+std::string Sha1(const std::vector<uint8_t>& data);
+using Sha1Digest = std::array<char, 40>;
+void Sha1(const std::vector<uint8_t>& data, Sha1Digest& digest);  // without allocating
+
+// Looks up the quirk profile of a ROM in kRomDatabasePath.
+// Each line is "<sha1> <profile or quirk list>", and '#' starts a comment.
+std::optional<Quirks> LookUpQuirks(const std::string& sha1);
+
+} // namespace chip8_emu
@@ -0,0 +1,68 @@
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "rom_watcher.hpp"
+
+namespace chip8_emu {
+
+RomWatcher::RomWatcher() : path_{}, file_name_{}, fd_{-1}, events_{}, write_time_{}, poll_time_{} {}
+
+RomWatcher::~RomWatcher() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool RomWatcher::Open(const std::string& rom) {
+  namespace fs = std::filesystem;
+  path_ = fs::absolute(rom);
+  file_name_ = path_.filename().string();
+  std::error_code error;
+  write_time_ = fs::last_write_time(path_, error);
+  if (error) {
+    std::cerr << "Failed to watch " << path_ << ": " << error.message() << std::endl;
+    return false;
+  }
+  poll_time_ = std::chrono::steady_clock::now();
+#ifdef __linux__
+  fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0 || inotify_add_watch(fd_, path_.parent_path().c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    std::cerr << "Failed to watch " << path_.parent_path() << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+#endif
+  std::cout << "Watching " << path_ << std::endl;
+  return true;
+}
+
+bool RomWatcher::HasChanged() {
+#ifdef __linux__
+  bool changed = false;
+  for (ssize_t length; (length = read(fd_, events_.data(), events_.size())) > 0;) {
+    for (ssize_t offset = 0; offset < length;) {
+      inotify_event event;
+      std::memcpy(&event, events_.data() + offset, sizeof(event));
+      if (event.len > 0 && file_name_ == events_.data() + offset + sizeof(event)) changed = true;
+      offset += sizeof(event) + event.len;
+    }
+  }
+  return changed;
+#else
+  const auto now = std::chrono::steady_clock::now();
+  if (now - poll_time_ < kPollInterval) return false;
+  poll_time_ = now;
+  std::error_code error;
+  const auto write_time = std::filesystem::last_write_time(path_, error);
+  if (error || write_time == write_time_) return false;
+  write_time_ = write_time;
+  return true;
+#endif
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+namespace chip8_emu {
+
+// Tells the run loop when the ROM file has been rewritten. On Linux it
+// watches the ROM's directory with inotify, so that editors and build tools
+// that replace the file through a rename are seen as well, and HasChanged is
+// one non-blocking read. Elsewhere HasChanged compares the modification time
+// at most every kPollInterval. Neither allocates after Open.
+class RomWatcher {
+ public:
+  RomWatcher();
+  ~RomWatcher();
+  bool Open(const std::string& rom);
+  bool HasChanged();  // since the last call
+
+ private:
+  static constexpr std::chrono::milliseconds kPollInterval{250};
+
+  std::filesystem::path path_;
+  std::string file_name_;
+  int fd_;  // inotify instance, or -1
+  std::array<char, 4096> events_;  // inotify records
+  std::filesystem::file_time_type write_time_;
+  std::chrono::steady_clock::time_point poll_time_;
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,135 @@
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shared_state.hpp"
+
+namespace chip8_emu {
+
+SharedState::SharedState() : name_{}, layout_{nullptr} {}
+
+SharedState::~SharedState() {
+  if (!layout_) return;
+  munmap(layout_, sizeof(SharedStateLayout));
+  shm_unlink(name_.c_str());
+}
+
+bool SharedState::Open(const std::string& name) {
+  name_ = name.starts_with("/") ? name : "/" + name;
+  const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    // Another emulator's, or left behind by one that was killed
+    std::cerr << "Shared memory " << name_ << " already exists; remove /dev/shm" << name_
+      << " if no emulator uses it" << std::endl;
+    return false;
+  }
+  if (fd < 0) {
+    std::cerr << "Failed to open shared memory " << name_ << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  if (ftruncate(fd, sizeof(SharedStateLayout)) < 0) {
+    std::cerr << "Failed to size shared memory " << name_ << ": " << std::strerror(errno) << std::endl;
+    close(fd);
+    shm_unlink(name_.c_str());
+    return false;
+  }
+  void* memory = mmap(nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory " << name_ << ": " << std::strerror(errno) << std::endl;
+    shm_unlink(name_.c_str());
+    return false;
+  }
+
+  layout_ = new (memory) SharedStateLayout{};
+  std::memcpy(layout_->magic, kSharedStateMagic, sizeof(kSharedStateMagic));
+  layout_->version = kSharedStateVersion;
+  std::cout << "Shared state: /dev/shm" << name_ << std::endl;
+  return true;
+}
+
+SharedStateLayout& SharedState::BeginPublish() {
+  const uint64_t sequence = layout_->sequence.load(std::memory_order_relaxed);
+  layout_->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);  // odd before any data
+  return *layout_;
+}
+
+void SharedState::EndPublish() {
+  layout_->sequence.store(layout_->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint16_t SharedState::GetKeys() const {
+  return layout_->keys.load(std::memory_order_relaxed);
+}
+
+SharedStateReader::SharedStateReader() : layout_{nullptr} {}
+
+SharedStateReader::~SharedStateReader() {
+  if (layout_) munmap(layout_, sizeof(SharedStateLayout));
+}
+
+bool SharedStateReader::Open(const std::string& name) {
+  const std::string path = name.starts_with("/") ? name : "/" + name;
+  const int fd = shm_open(path.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    std::cerr << "Failed to open shared memory " << path << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) < 0 || static_cast<size_t>(status.st_size) < sizeof(SharedStateLayout)) {
+    std::cerr << "Shared memory " << path << " is too small for the layout" << std::endl;
+    close(fd);
+    return false;
+  }
+  void* memory = mmap(nullptr, sizeof(SharedStateLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory " << path << ": " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  layout_ = static_cast<SharedStateLayout*>(memory);
+  if (std::memcmp(layout_->magic, kSharedStateMagic, sizeof(kSharedStateMagic)) != 0 ||
+      layout_->version != kSharedStateVersion) {
+    std::cerr << "Shared memory " << path << " has an unknown layout" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool SharedStateReader::Read(SharedStateSnapshot& snapshot) const {
+  for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+    const uint64_t sequence = layout_->sequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      std::this_thread::yield();  // a frame takes microseconds to publish
+      continue;
+    }
+    snapshot.frame = layout_->frame;
+    snapshot.high_resolution = layout_->high_resolution;
+    snapshot.sp = layout_->sp;
+    snapshot.delay_timer = layout_->delay_timer;
+    snapshot.sound_timer = layout_->sound_timer;
+    snapshot.i = layout_->i;
+    snapshot.pc = layout_->pc;
+    snapshot.v = layout_->v;
+    snapshot.stack = layout_->stack;
+    snapshot.planes = layout_->planes;
+    std::atomic_thread_fence(std::memory_order_acquire);  // the copies before the second look
+    if (layout_->sequence.load(std::memory_order_relaxed) == sequence) return true;
+  }
+  return false;
+}
+
+void SharedStateReader::SetKeys(uint16_t keys) {
+  layout_->keys.store(keys, std::memory_order_relaxed);
+}
+
+} // namespace chip8_emu
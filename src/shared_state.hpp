@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <string>
+
+#include "frame_buffer.hpp"
+
+namespace chip8_emu {
+
+constexpr char kSharedStateMagic[4] = {'C', '8', 'S', 'M'};
+constexpr uint32_t kSharedStateVersion = 1;
+
+// Layout of the shared memory segment, in host byte order. The emulator
+// rewrites everything but keys once per frame under a seqlock: sequence is
+// odd while it writes, so a reader copies what it needs and retries if
+// sequence was odd or has changed since. keys is written by consumers.
+struct SharedStateLayout {
+  char magic[4];
+  uint32_t version;
+  std::atomic<uint64_t> sequence;
+  uint64_t frame;
+  uint8_t high_resolution;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint16_t i;
+  uint16_t pc;
+  std::array<uint8_t, 16> v;
+  std::array<uint16_t, 16> stack;
+  std::array<FrameBuffer::Plane, kNumPlanes> planes;  // rows of two 64-bit words, MSB = leftmost pixel
+  std::atomic<uint16_t> keys;  // bit n holds key n down
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint16_t>::is_always_lock_free);
+
+// POSIX shared memory segment that publishes the machine to other processes
+// and takes key state from them. The emulator side never waits on readers.
+class SharedState {
+ public:
+  SharedState();
+  ~SharedState();
+  // Creates the segment, removed again on destruction. Fails if it exists,
+  // so that two emulators never write to the same one.
+  bool Open(const std::string& name);
+
+  // Called by the CPU thread once per frame, around the writes to the layout
+  SharedStateLayout& BeginPublish();
+  void EndPublish();
+  uint16_t GetKeys() const;
+
+ private:
+  std::string name_;
+  SharedStateLayout* layout_;
+};
+
+// Everything in the layout that the emulator publishes
+struct SharedStateSnapshot {
+  uint64_t frame;
+  bool high_resolution;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+  uint16_t i;
+  uint16_t pc;
+  std::array<uint8_t, 16> v;
+  std::array<uint16_t, 16> stack;
+  std::array<FrameBuffer::Plane, kNumPlanes> planes;
+};
+
+// Consumer side of a segment created by SharedState, as used by shm_tool.
+class SharedStateReader {
+ public:
+  SharedStateReader();
+  ~SharedStateReader();
+  bool Open(const std::string& name);  // maps the segment and checks its magic and version
+  // Copies a consistent state, retrying while the emulator writes. Returns
+  // false if it kept writing through every attempt.
+  bool Read(SharedStateSnapshot& snapshot) const;
+  void SetKeys(uint16_t keys);
+
+ private:
+  static constexpr int kMaxReadAttempts = 1000;
+
+  SharedStateLayout* layout_;
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "shared_state.hpp"
+
+namespace {
+
+constexpr char kUsage[] =
+  "Usage:\n"
+  "  shm_tool dump <name>\n"
+  "  shm_tool keys <name> <mask>\n";
+
+// Color index of a pixel, from one bit of each plane
+int GetColor(const chip8_emu::SharedStateSnapshot& snapshot, int x, int y) {
+  int color = 0;
+  for (int p = 0; p < chip8_emu::kNumPlanes; ++p) {
+    color |= ((snapshot.planes[p][y][x >> 6] >> (63 - (x & 63))) & 1) << p;
+  }
+  return color;
+}
+
+int Dump(const std::string& name) {
+  chip8_emu::SharedStateReader reader;
+  if (!reader.Open(name)) return 1;
+  chip8_emu::SharedStateSnapshot snapshot;
+  if (!reader.Read(snapshot)) {
+    std::cerr << "The emulator kept writing, try again" << std::endl;
+    return 1;
+  }
+
+  printf("frame=%llu, pc=0x%04X, i=0x%04X, sp=%d, dt=%d, st=%d\n", static_cast<unsigned long long>(snapshot.frame),
+    snapshot.pc, snapshot.i, snapshot.sp, snapshot.delay_timer, snapshot.sound_timer);
+  for (int n = 0; n < 16; ++n) printf("v%X=0x%02X%s", n, snapshot.v[n], n == 15 ? "\n" : ", ");
+  // Low resolution uses the top left quarter of the planes
+  const int width = snapshot.high_resolution ? chip8_emu::kHighResWidth : chip8_emu::kLowResWidth;
+  const int height = snapshot.high_resolution ? chip8_emu::kHighResHeight : chip8_emu::kLowResHeight;
+  for (int y = 0; y < height; ++y) {
+    std::string row(width, '.');
+    for (int x = 0; x < width; ++x) {
+      const int color = GetColor(snapshot, x, y);
+      if (color != 0) row[x] = color == 1 ? '#' : "0123456789ABCDEF"[color];
+    }
+    printf("%s\n", row.c_str());
+  }
+  return 0;
+}
+
+int SetKeys(const std::string& name, const char* mask) {
+  char* end;
+  const unsigned long keys = std::strtoul(mask, &end, 16);
+  if (*end != '\0' || keys > 0xFFFF) {
+    std::cerr << "Invalid key mask: " << mask << std::endl;
+    return 1;
+  }
+  chip8_emu::SharedStateReader reader;
+  if (!reader.Open(name)) return 1;
+  reader.SetKeys(static_cast<uint16_t>(keys));
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc == 3 && std::strcmp(argv[1], "dump") == 0) {
+    return Dump(argv[2]);
+  }
+  if (argc == 4 && std::strcmp(argv[1], "keys") == 0) {
+    return SetKeys(argv[2], argv[3]);
+  }
+  std::cerr << kUsage;
+  return 1;
+}
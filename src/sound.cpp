@@ -1,5 +1,6 @@
 #include <iostream>
 #include <filesystem>
+#include <cmath>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mixer.h>
@@ -10,7 +11,10 @@ namespace chip8_emu {
 
 const std::string kBeepFilePath{"../sound/beep.wav"};
 
-Sound::Sound() : beep_{nullptr} {}
+Sound::Sound()
+    : beep_{nullptr}, pattern_{nullptr}, pattern_samples_{}, is_open_{false}, metrics_{nullptr}, last_mix_time_{} {
+  pattern_samples_.reserve(std::lround(128.0 * kAudioFrequency / GetPatternBitRate(0)) + 1);
+}
 
 Sound::~Sound() {
   Terminate();
@@ -23,13 +27,32 @@ void Sound::InitializeSound() {
     std::exit(EXIT_FAILURE);
   }
 
-  if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 1, 2048) != 0) {
+  if (Mix_OpenAudio(kAudioFrequency, MIX_DEFAULT_FORMAT, 1, kAudioBufferSamples) != 0) {
     std::cerr << "Failed to open SDL mixer" << std::endl;
     SDL_Quit();
     std::exit(EXIT_FAILURE);
   }
 
   OpenAudioFile(kBeepFilePath);
+  if (metrics_) Mix_SetPostMix(&Sound::OnMixed, this);
+  is_open_ = true;
+}
+
+void Sound::SetMetrics(Metrics* metrics) {
+  metrics_ = metrics;
+}
+
+void Sound::OnMixed(void* sound, Uint8*, int) {
+  // The device asks for a buffer every kAudioBufferSamples; one mixed much
+  // later than that means the device has run dry in between
+  constexpr auto kBufferTime = std::chrono::microseconds(1000000LL * kAudioBufferSamples / kAudioFrequency);
+  auto& self = *static_cast<Sound*>(sound);
+  const auto now = std::chrono::steady_clock::now();
+  if (self.last_mix_time_.time_since_epoch().count() != 0 && now - self.last_mix_time_ > kBufferTime * 3 / 2) {
+    self.metrics_->Get(CounterId::kAudioUnderruns).Add(1);
+  }
+  self.last_mix_time_ = now;
+  self.metrics_->Get(CounterId::kAudioBuffers).Add(1);
 }
 
 void Sound::OpenAudioFile(const std::string& file) {
@@ -44,14 +67,57 @@ void Sound::OpenAudioFile(const std::string& file) {
 }
 
 void Sound::Beep() {
-  Mix_PlayChannel(-1, beep_, 0);
+  if (!is_open_) return;
+  if (pattern_) {
+    Mix_PlayChannel(-1, pattern_, -1);
+  } else {
+    Mix_PlayChannel(-1, beep_, 0);
+  }
+}
+
+void Sound::SetPattern(const std::array<uint8_t, 16>& pattern, uint8_t pitch) {
+  const double bit_rate = GetPatternBitRate(pitch);
+  const auto length = static_cast<size_t>(std::lround(128.0 * kAudioFrequency / bit_rate));
+
+  // Programs may change patterns every frame, so the chunk and its samples
+  // are reused. pattern_samples_ has room for the lowest pitch.
+  if (!is_open_) return;
+  if (pattern_) Mix_HaltChannel(-1);
+  pattern_samples_.resize(std::max<size_t>(length, 1));
+  for (size_t i = 0; i < pattern_samples_.size(); ++i) {
+    const auto bit = static_cast<size_t>(i * bit_rate / kAudioFrequency) % 128;
+    pattern_samples_[i] = (pattern[bit / 8] & (0x80 >> (bit % 8))) ? 8000 : -8000;
+  }
+  const auto bytes = static_cast<Uint32>(pattern_samples_.size() * sizeof(int16_t));
+  if (pattern_) {
+    pattern_->alen = bytes;
+  } else {
+    pattern_ = Mix_QuickLoad_RAW(reinterpret_cast<Uint8*>(pattern_samples_.data()), bytes);
+  }
+}
+
+void Sound::ClearPattern() {
+  if (!pattern_) return;
+  Mix_HaltChannel(-1);
+  Mix_FreeChunk(pattern_);
+  pattern_ = nullptr;
+}
+
+double Sound::GetPatternBitRate(uint8_t pitch) {
+  // The 128-bit pattern is played back at 4000 * 2^((pitch - 64) / 48) bits per second.
+  return 4000.0 * std::pow(2.0, (pitch - 64) / 48.0);
 }
 
 void Sound::StopBeep() {
+  if (!is_open_) return;
   Mix_HaltChannel(-1);
 }
 
 void Sound::Terminate() {
+  if (!is_open_) return;
+  is_open_ = false;
+  if (metrics_) Mix_SetPostMix(nullptr, nullptr);
+  if (pattern_) Mix_FreeChunk(pattern_);
   Mix_FreeChunk(beep_);
   Mix_CloseAudio();
   SDL_Quit();
@@ -1,25 +1,45 @@
 #pragma once
 
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <chrono>
+#include <string>
+
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_mixer.h>
 
+#include "metrics.hpp"
+
 namespace chip8_emu {
 
 extern const std::string kBeepFilePath;
+constexpr int kAudioFrequency = 44100;
+constexpr int kAudioBufferSamples = 2048;
 
 class Sound {
  public:
   Sound();
   ~Sound();
   void InitializeSound();
+  void SetMetrics(Metrics* metrics);  // counts mixed buffers and underruns, before InitializeSound
   void Beep();
   void StopBeep();
+  void SetPattern(const std::array<uint8_t, 16>& pattern, uint8_t pitch);  // XO-CHIP
+  void ClearPattern();  // back to beep.wav
   void Terminate();
 
  private:
   void OpenAudioFile(const std::string& file);
+  static double GetPatternBitRate(uint8_t pitch);
+  static void OnMixed(void* sound, Uint8* stream, int length);  // on the audio thread
 
   Mix_Chunk* beep_;
+  Mix_Chunk* pattern_;  // looped instead of beep_ once a pattern is loaded
+  std::vector<int16_t> pattern_samples_;
+  bool is_open_;  // only InitializeSound touches SDL, so headless machines leave it alone
+  Metrics* metrics_;
+  std::chrono::steady_clock::time_point last_mix_time_;  // audio thread only
 };
 
 } // namespace chip8_emu
@@ -1,7 +1,8 @@
-#include <iostream>
+#include <cstdio>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 
 #include "sound_timer.hpp"
 #include "sound.hpp"
@@ -10,10 +11,17 @@ namespace chip8_emu {
 
 SoundTimer::SoundTimer(std::atomic_bool& is_sleeping)
     : st_{0},
+      pattern_{},
+      pitch_{64},
+      has_pattern_{false},
       mutex_{},
+      condition_{},
       thread_{},
       timer_is_running_{false},
       is_beeping_{false},
+      is_paused_{false},
+      is_muted_{false},
+      has_sound_{true},
       system_is_sleeping_{is_sleeping},
       sound_{std::make_unique<Sound>()} {
 }
@@ -27,30 +35,53 @@ SoundTimer::~SoundTimer() {
 void SoundTimer::Start() {
   const auto interval = std::chrono::duration<int, std::ratio<1, kSoundTimerCycles>>(1); // 60 Hz
 
-  sound_->InitializeSound();
+  InitializeSound();
 
   timer_is_running_ = true;
   thread_ = std::thread([this, interval] {
+    bool paused = false;
     while (timer_is_running_) {
+      {
+        // Block while there is nothing to count down, start or stop, instead
+        // of waking at 60 Hz
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this, &paused] {
+          return !timer_is_running_ || system_is_sleeping_ != paused || (!paused && (st_ > 0 || is_beeping_));
+        });
+      }
       std::this_thread::sleep_for(interval);
       if (system_is_sleeping_) {
         // stop timer
         sound_->StopBeep();
+        paused = true;
         continue;
-      } else if (is_beeping_) {
-        // resume timer
+      } else if (paused && is_beeping_) {
+        // resume timer (only once, since XO-CHIP patterns are looped)
         sound_->Beep();
       }
+      paused = false;
       DecrementTimerValue();
     }
   });
 }
 
+void SoundTimer::InitializeSound() {
+  if (has_sound_) sound_->InitializeSound();
+}
+
+void SoundTimer::DisableSound() {
+  has_sound_ = false;
+}
+
+void SoundTimer::SetMetrics(Metrics* metrics) {
+  sound_->SetMetrics(metrics);
+}
+
 void SoundTimer::DecrementTimerValue() {
   std::lock_guard<std::mutex> lock(mutex_);
   if (st_ > 0) {
     if (!is_beeping_) {
-      sound_->Beep();
+      if (IsAudible()) sound_->Beep();
       is_beeping_ = true;
     }
     --st_;
@@ -63,6 +94,19 @@ void SoundTimer::DecrementTimerValue() {
 void SoundTimer::SetRegisterValue(uint8_t value) {
   std::lock_guard<std::mutex> lock(mutex_);
   st_ = value;
+  condition_.notify_one();
+}
+
+void SoundTimer::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  st_ = 0;
+  if (is_beeping_) sound_->StopBeep();
+  is_beeping_ = false;
+  pattern_.fill(0);
+  pitch_ = 64;
+  has_pattern_ = false;
+  sound_->ClearPattern();
+  condition_.notify_one();
 }
 
 uint8_t SoundTimer::GetRegisterValue() {
@@ -70,11 +114,61 @@ uint8_t SoundTimer::GetRegisterValue() {
   return st_;
 }
 
+void SoundTimer::SetAudioPattern(const std::array<uint8_t, 16>& pattern) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pattern_ = pattern;
+  has_pattern_ = true;
+  sound_->SetPattern(pattern_, pitch_);
+  if (is_beeping_ && IsAudible()) sound_->Beep();
+}
+
+void SoundTimer::SetPitch(uint8_t pitch) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pitch_ = pitch;
+  if (!has_pattern_) return;
+  sound_->SetPattern(pattern_, pitch_);
+  if (is_beeping_ && IsAudible()) sound_->Beep();
+}
+
+void SoundTimer::SetPaused(bool paused) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const bool was_audible = IsAudible();
+  is_paused_ = paused;
+  UpdateBeep(was_audible);
+}
+
+void SoundTimer::SetMuted(bool muted) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const bool was_audible = IsAudible();
+  is_muted_ = muted;
+  UpdateBeep(was_audible);
+}
+
+bool SoundTimer::IsAudible() const {
+  return !is_paused_ && !is_muted_;
+}
+
+void SoundTimer::UpdateBeep(bool was_audible) {
+  if (!is_beeping_ || IsAudible() == was_audible) return;
+  if (was_audible) {
+    sound_->StopBeep();
+  } else {
+    sound_->Beep();
+  }
+}
+
+void SoundTimer::Wake() {
+  // Taking the mutex orders the change before the thread's next check
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  condition_.notify_one();
+}
+
 void SoundTimer::Terminate() {
   if (is_beeping_) sound_->StopBeep();
   timer_is_running_ = false;
+  Wake();
   thread_.join();
-  std::cout << "Stopped SoundTimer" << std::endl;
+  std::puts("Stopped SoundTimer");
 }
 
 } // namespace chip8_emu
@@ -1,10 +1,11 @@
 #pragma once
 
-#include <iostream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <memory>
+#include <array>
 
 #include "sound.hpp"
 
@@ -17,18 +18,36 @@ class SoundTimer {
   SoundTimer(std::atomic_bool& is_sleeping);
   ~SoundTimer();
   void Start();
+  void InitializeSound();  // Start() without the thread, for emulated timers
+  void SetMetrics(Metrics* metrics);  // before Start or InitializeSound
+  void DisableSound();  // before Start or InitializeSound, which then leave SDL alone
   void SetRegisterValue(uint8_t value);
+  void Reset();  // timer 0, silent, and beep.wav instead of any XO-CHIP pattern
   uint8_t GetRegisterValue();
+  void SetAudioPattern(const std::array<uint8_t, 16>& pattern);  // XO-CHIP
+  void SetPitch(uint8_t pitch);  // XO-CHIP
+  void DecrementTimerValue();  // called by the thread, or per frame with emulated timers
+  void SetPaused(bool paused);  // emulated timers only
+  void SetMuted(bool muted);  // keeps counting without sound, for fast-forward
+  void Wake();  // re-checks the sleep state after it changed
   void Terminate();
 
  private:
-  void DecrementTimerValue();
+  bool IsAudible() const;
+  void UpdateBeep(bool was_audible);  // with mutex_ held
 
   uint8_t st_;
+  std::array<uint8_t, 16> pattern_;
+  uint8_t pitch_;
+  bool has_pattern_;  // beep.wav is used until a pattern is loaded
   std::mutex mutex_;
+  std::condition_variable condition_;  // the thread waits on it while there is nothing to count
   std::thread thread_;
   std::atomic_bool timer_is_running_;
   bool is_beeping_;
+  bool is_paused_;
+  bool is_muted_;
+  bool has_sound_;
   std::atomic_bool& system_is_sleeping_;
   std::unique_ptr<Sound> sound_;
 };
@@ -0,0 +1,204 @@
+#include <cstdio>
+#include <cerrno>
+#include <string>
+
+#include <unistd.h>
+
+#include "terminal_graphic.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr uint32_t kBlank = ' ';
+constexpr uint32_t kUpperHalfBlock = 0x2580;
+constexpr uint32_t kBraille = 0x2800;
+// Move, both colors and a glyph for every cell, plus the frame's own sequences
+constexpr size_t kMaxFrameBytes = kHighResWidth * kHighResHeight / 2 * 64 + 256;
+
+}  // namespace
+
+std::optional<TerminalCells> ParseTerminalCells(const std::string& name) {
+  if (name == "half") return TerminalCells::kHalfBlock;
+  if (name == "braille") return TerminalCells::kBraille;
+  return std::nullopt;
+}
+
+TerminalGraphic::TerminalGraphic(TerminalCells cells)
+    : cells_{cells},
+      is_open_{false},
+      rows_{0},
+      columns_{0},
+      screen_{},
+      cursor_row_{-1},
+      cursor_column_{-1},
+      foreground_{kUnknownColor},
+      background_{kUnknownColor},
+      out_{},
+      frames_{0},
+      bytes_{0} {}
+
+TerminalGraphic::~TerminalGraphic() {
+  if (!is_open_) return;
+  out_ = "\x1b[0m\x1b[?25h\x1b[?1049l";
+  Flush();
+  printf("Terminal: %llu frames, %llu bytes (%.0f per frame)\n", static_cast<unsigned long long>(frames_),
+         static_cast<unsigned long long>(bytes_), frames_ > 0 ? static_cast<double>(bytes_) / frames_ : 0.0);
+}
+
+void TerminalGraphic::Open() {
+  out_.reserve(kMaxFrameBytes);
+  out_ = "\x1b[?1049h\x1b[?25l";
+  Flush();
+  is_open_ = true;
+}
+
+void TerminalGraphic::Invalidate() {
+  rows_ = 0;
+}
+
+TerminalGraphic::Cell TerminalGraphic::GetCell(const FrameBuffer& frame_buffer, const ArgbPalette& palette, int row,
+                                               int column) const {
+  const uint32_t background = palette[0] & 0xFFFFFF;
+  if (cells_ == TerminalCells::kHalfBlock) {
+    const uint32_t top = palette[frame_buffer.GetPixel(column, row * 2)] & 0xFFFFFF;
+    const uint32_t bottom = palette[frame_buffer.GetPixel(column, row * 2 + 1)] & 0xFFFFFF;
+    if (top == bottom) return {kBlank, bottom, bottom};
+    return {kUpperHalfBlock, top, bottom};
+  }
+
+  // Braille dots 1-3 and 4-6 run down the two columns, 7 and 8 are the bottom row
+  constexpr int kDotBits[4][2] = {{0, 3}, {1, 4}, {2, 5}, {6, 7}};
+  uint32_t dots = 0;
+  uint32_t foreground = background;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 2; ++x) {
+      const uint8_t color = frame_buffer.GetPixel(column * 2 + x, row * 4 + y);
+      if (color == 0) continue;
+      if (dots == 0) foreground = palette[color] & 0xFFFFFF;  // one color per cell
+      dots |= 1 << kDotBits[y][x];
+    }
+  }
+  if (dots == 0) return {kBlank, background, background};
+  return {kBraille + dots, foreground, background};
+}
+
+void TerminalGraphic::Render(const FrameBuffer& frame_buffer, const ArgbPalette& palette) {
+  const bool half_block = cells_ == TerminalCells::kHalfBlock;
+  const int rows = frame_buffer.GetHeight() / (half_block ? 2 : 4);
+  const int columns = frame_buffer.GetWidth() / (half_block ? 1 : 2);
+  out_.clear();
+  const bool repaint = rows != rows_ || columns != columns_;
+  if (repaint) {
+    out_ += "\x1b[0m\x1b[2J";
+    rows_ = rows;
+    columns_ = columns;
+    cursor_row_ = -1;
+    foreground_ = kUnknownColor;
+    background_ = kUnknownColor;
+  }
+
+  for (int row = 0; row < rows; ++row) {
+    for (int column = 0; column < columns; ++column) {
+      const Cell cell = GetCell(frame_buffer, palette, row, column);
+      Cell& shown = screen_[row * columns + column];
+      if (!repaint && cell == shown) continue;
+      shown = cell;
+      MoveTo(row, column);
+      SetColors(cell);
+      AppendGlyph(cell.glyph);
+      // The cursor stays on the last column of a full-width line
+      cursor_column_ = column + 1 < columns ? column + 1 : -1;
+    }
+  }
+
+  if (!out_.empty()) {
+    // Plain colors under the display, for anything else printed meanwhile
+    out_ += "\x1b[0m";
+    foreground_ = kUnknownColor;
+    background_ = kUnknownColor;
+    MoveTo(rows_, 0);
+    Flush();
+  }
+  ++frames_;
+}
+
+void TerminalGraphic::MoveTo(int row, int column) {
+  if (row == cursor_row_ && column == cursor_column_) return;
+  out_ += "\x1b[";
+  if (row == cursor_row_ && cursor_column_ >= 0 && column > cursor_column_) {
+    AppendNumber(column - cursor_column_);
+    out_ += 'C';
+  } else {
+    AppendNumber(row + 1);
+    out_ += ';';
+    AppendNumber(column + 1);
+    out_ += 'H';
+  }
+  cursor_row_ = row;
+  cursor_column_ = column;
+}
+
+void TerminalGraphic::SetColors(const Cell& cell) {
+  const bool set_foreground = cell.glyph != kBlank && cell.foreground != foreground_;
+  const bool set_background = cell.background != background_;
+  if (!set_foreground && !set_background) return;
+  out_ += "\x1b[";
+  if (set_foreground) {
+    out_ += "38;2;";
+    AppendColor(cell.foreground);
+    foreground_ = cell.foreground;
+  }
+  if (set_background) {
+    if (set_foreground) out_ += ';';
+    out_ += "48;2;";
+    AppendColor(cell.background);
+    background_ = cell.background;
+  }
+  out_ += 'm';
+}
+
+void TerminalGraphic::AppendColor(uint32_t rgb) {
+  AppendNumber(rgb >> 16);
+  out_ += ';';
+  AppendNumber((rgb >> 8) & 0xFF);
+  out_ += ';';
+  AppendNumber(rgb & 0xFF);
+}
+
+void TerminalGraphic::AppendNumber(uint32_t n) {
+  char digits[10];
+  int length = 0;
+  do {
+    digits[length++] = static_cast<char>('0' + n % 10);
+    n /= 10;
+  } while (n > 0);
+  while (length > 0) out_ += digits[--length];
+}
+
+void TerminalGraphic::AppendGlyph(uint32_t code_point) {
+  // UTF-8 of the code points used here, which are all below U+10000
+  if (code_point < 0x80) {
+    out_ += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    out_ += static_cast<char>(0xC0 | code_point >> 6);
+    out_ += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    out_ += static_cast<char>(0xE0 | code_point >> 12);
+    out_ += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out_ += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+
+void TerminalGraphic::Flush() {
+  std::fflush(stdout);  // keeps printed messages in order with the frame
+  for (size_t written = 0; written < out_.size();) {
+    const ssize_t n = write(STDOUT_FILENO, out_.data() + written, out_.size() - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    written += n;
+  }
+  bytes_ += out_.size();
+}
+
+} // namespace chip8_emu
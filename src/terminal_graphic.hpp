@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <string>
+
+#include "frame_buffer.hpp"
+#include "upscaler.hpp"
+
+namespace chip8_emu {
+
+enum class TerminalCells {
+  kHalfBlock,  // U+2580 with 24-bit colors, 1x2 pixels per cell: 128x32 cells in high resolution
+  kBraille,    // U+2800 block, 2x4 pixels per cell in one color: 64x16 cells in high resolution
+};
+
+// Accepts "half" or "braille"
+std::optional<TerminalCells> ParseTerminalCells(const std::string& name);
+
+// Draws the display to stdout with ANSI escape sequences, for sessions
+// without a window. The cells of the previous frame are kept, and only the
+// ones that changed are written: the cursor moves only across unchanged
+// cells and colors are set only when they differ from the last ones written,
+// so a static display costs no output at all. The frame is sent with one
+// write from a buffer reserved up front, so Render does not allocate.
+class TerminalGraphic {
+ public:
+  explicit TerminalGraphic(TerminalCells cells);
+  ~TerminalGraphic();  // restores the screen and prints the bytes written
+  void Open();  // switches to the alternate screen
+  void Render(const FrameBuffer& frame_buffer, const ArgbPalette& palette);
+  void Invalidate();  // the next Render repaints every cell
+
+ private:
+  static constexpr int kMaxCells = kHighResWidth * kHighResHeight / 2;
+  static constexpr uint32_t kUnknownColor = UINT32_MAX;
+
+  struct Cell {
+    uint32_t glyph;  // code point
+    uint32_t foreground;  // RGB, equal to background for blank cells
+    uint32_t background;
+    constexpr bool operator==(const Cell&) const = default;
+  };
+
+  Cell GetCell(const FrameBuffer& frame_buffer, const ArgbPalette& palette, int row, int column) const;
+  void MoveTo(int row, int column);
+  void SetColors(const Cell& cell);
+  void AppendColor(uint32_t rgb);
+  void AppendNumber(uint32_t n);
+  void AppendGlyph(uint32_t code_point);
+  void Flush();
+
+  TerminalCells cells_;
+  bool is_open_;
+  int rows_;  // of the cells on screen, 0 when they must all be repainted
+  int columns_;
+  std::array<Cell, kMaxCells> screen_;
+  int cursor_row_;  // -1 if unknown
+  int cursor_column_;
+  uint32_t foreground_;  // last written, or kUnknownColor
+  uint32_t background_;
+  std::string out_;
+  uint64_t frames_;
+  uint64_t bytes_;
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,134 @@
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <iostream>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "terminal_input.hpp"
+
+namespace chip8_emu {
+
+TerminalInput::TerminalInput()
+    : is_open_{false},
+      is_raw_{false},
+      at_end_{false},
+      saved_{},
+      buffer_{},
+      held_{},
+      num_held_{0},
+      wake_pipe_{-1, -1} {}
+
+TerminalInput::~TerminalInput() {
+  if (is_raw_) tcsetattr(STDIN_FILENO, TCSANOW, &saved_);
+  for (const int fd : wake_pipe_) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+bool TerminalInput::Open() {
+  if (pipe2(wake_pipe_.data(), O_NONBLOCK | O_CLOEXEC) != 0) {
+    std::cerr << "Failed to create the wake-up pipe: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  // Piped input is read as it is, for scripted sessions
+  if (isatty(STDIN_FILENO)) {
+    if (tcgetattr(STDIN_FILENO, &saved_) != 0) {
+      std::cerr << "Failed to read the terminal mode: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    termios raw = saved_;
+    raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+    raw.c_iflag &= ~(IXON | ICRNL);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw) != 0) {
+      std::cerr << "Failed to set the terminal to raw mode: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    is_raw_ = true;
+  }
+  is_open_ = true;
+  return true;
+}
+
+size_t TerminalInput::Poll(int timeout_ms, Events& events) {
+  using Clock = std::chrono::steady_clock;
+  auto now = Clock::now();
+  // Wake up in time for the next release
+  for (size_t k = 0; k < num_held_; ++k) {
+    const auto wait = std::chrono::ceil<std::chrono::milliseconds>(held_[k].release_time - now).count();
+    timeout_ms = std::clamp(static_cast<int>(wait), 0, timeout_ms);
+  }
+
+  size_t num_events = 0;
+  pollfd fds[2] = {{wake_pipe_[0], POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+  poll(fds, at_end_ ? 1 : 2, timeout_ms);
+  if (fds[0].revents != 0) {
+    // Only the wake-up matters, not how many were sent
+    while (read(wake_pipe_[0], buffer_.data(), buffer_.size()) > 0) {
+    }
+  }
+  if (!at_end_ && fds[1].revents != 0) {
+    const ssize_t length = read(STDIN_FILENO, buffer_.data(), buffer_.size());
+    if (length == 0) at_end_ = true;
+    now = Clock::now();
+    for (ssize_t k = 0; k < length; ++k) {
+      const unsigned char c = buffer_[k];
+      if (c == 0x1B && k + 1 == length) {
+        Press(SDLK_ESCAPE, now, events, num_events);
+      } else if (c == 0x1B && buffer_[k + 1] == '[') {
+        // CSI: parameters up to a final byte. Only F5 is used.
+        ssize_t end = k + 2;
+        while (end < length && (buffer_[end] < 0x40 || buffer_[end] > 0x7E)) ++end;
+        if (end < length && buffer_[end] == '~' && end - (k + 2) == 2 && std::memcmp(&buffer_[k + 2], "15", 2) == 0) {
+          Press(SDLK_F5, now, events, num_events);
+        }
+        k = end;
+      } else if (c == 0x1B && buffer_[k + 1] == 'O') {
+        k += 2;  // SS3: F1-F4 and keypad keys
+      } else if (c == 0x03) {
+        Press(SDLK_ESCAPE, now, events, num_events);  // Ctrl-C, as ISIG is off
+      } else if (c == 0x7F || c == 0x08) {
+        Press(SDLK_BACKSPACE, now, events, num_events);
+      } else if (c == kTerminalRedrawKey) {
+        Press(kTerminalRedrawKey, now, events, num_events);
+      } else if (c >= 0x20 && c < 0x7F) {
+        Press(std::tolower(c), now, events, num_events);  // SDL keycodes of printable keys are their characters
+      }
+    }
+  }
+
+  for (size_t k = 0; k < num_held_ && num_events < kMaxEvents;) {
+    if (held_[k].release_time > now) {
+      ++k;
+      continue;
+    }
+    events[num_events++] = {held_[k].code, false};
+    held_[k] = held_[--num_held_];
+  }
+  return num_events;
+}
+
+void TerminalInput::Wake() {
+  const char byte = 0;
+  [[maybe_unused]] const ssize_t written = write(wake_pipe_[1], &byte, 1);  // a full pipe is awake already
+}
+
+void TerminalInput::Press(SDL_Keycode code, std::chrono::steady_clock::time_point now, Events& events,
+                          size_t& num_events) {
+  for (size_t k = 0; k < num_held_; ++k) {
+    if (held_[k].code != code) continue;
+    held_[k].release_time = std::max(held_[k].release_time, now + kRepeatHold);  // autorepeat
+    return;
+  }
+  if (num_held_ == kMaxHeldKeys || num_events == kMaxEvents) return;
+  held_[num_held_++] = {code, now + kKeyHold};
+  events[num_events++] = {code, true};
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <chrono>
+
+#include <termios.h>
+#include <SDL2/SDL.h>
+
+namespace chip8_emu {
+
+struct TerminalKeyEvent {
+  SDL_Keycode code;  // the SDL keycode of the key, so that Input maps both alike
+  bool pressed;
+};
+
+constexpr SDL_Keycode kTerminalRedrawKey = 0x0C;  // Ctrl-L
+
+// Keyboard input from stdin in raw mode. Terminals send key presses and
+// autorepeats but no releases, so a key counts as held until kKeyHold has
+// passed since the press, longer than the usual autorepeat delay of up to
+// 660 ms, or kRepeatHold since the last autorepeat. Ctrl-C quits like
+// Escape, and Ctrl-L repaints.
+class TerminalInput {
+ public:
+  static constexpr size_t kMaxEvents = 64;  // per Poll
+  using Events = std::array<TerminalKeyEvent, kMaxEvents>;
+
+  TerminalInput();
+  ~TerminalInput();  // restores the terminal
+  bool Open();
+  // Waits up to timeout_ms for input, then returns the number of events:
+  // presses of keys not held yet and releases of keys held long enough
+  size_t Poll(int timeout_ms, Events& events);
+  void Wake();  // thread-safe, makes a waiting Poll return
+
+ private:
+  static constexpr std::chrono::milliseconds kKeyHold{750};
+  static constexpr std::chrono::milliseconds kRepeatHold{150};  // a few autorepeat intervals
+  static constexpr size_t kMaxHeldKeys = 32;
+
+  struct HeldKey {
+    SDL_Keycode code;
+    std::chrono::steady_clock::time_point release_time;
+  };
+
+  void Press(SDL_Keycode code, std::chrono::steady_clock::time_point now, Events& events, size_t& num_events);
+
+  bool is_open_;
+  bool is_raw_;  // false when stdin is not a terminal
+  bool at_end_;  // of piped input
+  termios saved_;
+  std::array<unsigned char, 256> buffer_;
+  std::array<HeldKey, kMaxHeldKeys> held_;
+  size_t num_held_;
+  std::array<int, 2> wake_pipe_;  // written by Wake, polled along with stdin
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+#include <zlib.h>
+
+#include "trace.hpp"
+
+namespace chip8_emu {
+
+TraceWriter::TraceWriter()
+    : buffer_{std::make_unique<uint8_t[]>(kNumChunks * (kChunkSize + kMaxRecordSize))},
+      sizes_{},
+      write_{buffer_.get()},
+      chunk_limit_{buffer_.get() + kChunkSize},
+      prev_{},
+      head_{0},
+      tail_cache_{0},
+      tail_{0},
+      is_open_{false},
+      thread_{},
+      file_{nullptr} {
+}
+
+TraceWriter::~TraceWriter() {
+  Close();
+}
+
+bool TraceWriter::Open(const std::string& path) {
+  file_ = gzopen(path.c_str(), "wb1");  // fastest level, the delta encoding does most of the work
+  if (!file_) {
+    std::cerr << "Failed to open trace file: " << path << std::endl;
+    return false;
+  }
+  gzwrite(file_, kTraceMagic, sizeof(kTraceMagic));
+  gzwrite(file_, &kTraceVersion, sizeof(kTraceVersion));
+
+  is_open_ = true;
+  thread_ = std::thread([this] { Drain(); });
+  return true;
+}
+
+void TraceWriter::NextChunk() {
+  const uint64_t head = head_.load(std::memory_order_relaxed);
+  uint8_t* chunk = buffer_.get() + (head % kNumChunks) * (kChunkSize + kMaxRecordSize);
+  sizes_[head % kNumChunks] = write_ - chunk;
+  head_.store(head + 1, std::memory_order_release);
+
+  while (head + 1 - tail_cache_ >= kNumChunks) {
+    tail_cache_ = tail_.load(std::memory_order_acquire);
+    if (head + 1 - tail_cache_ >= kNumChunks) std::this_thread::yield();
+  }
+  write_ = buffer_.get() + ((head + 1) % kNumChunks) * (kChunkSize + kMaxRecordSize);
+  chunk_limit_ = write_ + kChunkSize;
+}
+
+void TraceWriter::Drain() {
+  while (true) {
+    // Read is_open_ before head_, so that the last chunk is not missed on Close.
+    const bool is_open = is_open_;
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head) {
+      if (!is_open) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    for (; tail != head; ++tail) {
+      const uint8_t* chunk = buffer_.get() + (tail % kNumChunks) * (kChunkSize + kMaxRecordSize);
+      gzwrite(file_, chunk, static_cast<unsigned>(sizes_[tail % kNumChunks]));
+      tail_.store(tail + 1, std::memory_order_release);
+    }
+  }
+}
+
+void TraceWriter::Close() {
+  if (!file_) return;
+  NextChunk();  // the partly filled chunk
+  is_open_ = false;
+  thread_.join();
+  gzclose(file_);
+  file_ = nullptr;
+  std::cout << "Closed trace" << std::endl;
+}
+
+TraceReader::TraceReader() : file_{nullptr}, prev_{} {}
+
+TraceReader::~TraceReader() {
+  if (file_) gzclose(file_);
+}
+
+bool TraceReader::Open(const std::string& path) {
+  file_ = gzopen(path.c_str(), "rb");
+  if (!file_) {
+    std::cerr << "Failed to open trace file: " << path << std::endl;
+    return false;
+  }
+  char magic[sizeof(kTraceMagic)];
+  uint32_t version;
+  if (gzread(file_, magic, sizeof(magic)) != sizeof(magic) ||
+      std::memcmp(magic, kTraceMagic, sizeof(magic)) != 0 ||
+      gzread(file_, &version, sizeof(version)) != sizeof(version) ||
+      version != kTraceVersion) {
+    std::cerr << "Not a trace file: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TraceReader::Next(TraceRecord& record) {
+  uint8_t flags;
+  if (gzread(file_, &flags, sizeof(flags)) != sizeof(flags)) return false;
+
+  record = prev_;
+  record.cycle = prev_.cycle + 1;
+  record.pc = static_cast<uint16_t>(prev_.pc + 2);
+  record.changed = 0;
+  if ((flags & kTraceCycle) && gzread(file_, &record.cycle, sizeof(record.cycle)) != sizeof(record.cycle)) {
+    return false;
+  }
+  if ((flags & kTracePc) && gzread(file_, &record.pc, sizeof(record.pc)) != sizeof(record.pc)) return false;
+  if ((flags & kTraceOpcode) && gzread(file_, &record.opcode, sizeof(record.opcode)) != sizeof(record.opcode)) {
+    return false;
+  }
+  if ((flags & kTraceI) && gzread(file_, &record.i, sizeof(record.i)) != sizeof(record.i)) return false;
+  if (flags & kTraceV) {
+    if (gzread(file_, &record.changed, sizeof(record.changed)) != sizeof(record.changed)) return false;
+    for (int n = 0; n < 16; ++n) {
+      if ((record.changed & (1 << n)) && gzread(file_, &record.v[n], 1) != 1) return false;
+    }
+  }
+  prev_ = record;
+  return true;
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <bit>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <zlib.h>
+
+namespace chip8_emu {
+
+// One executed instruction. Registers are the values after the instruction.
+struct TraceRecord {
+  uint64_t cycle;
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t i;
+  uint16_t changed;  // bit n is set if Vn was changed by the instruction (set by TraceReader)
+  std::array<uint8_t, 16> v;
+};
+static_assert(sizeof(TraceRecord) == 32);
+
+// Trace files are a gzip stream of a header followed by records in host
+// (little-endian) byte order. Each record is a flags byte followed by the
+// fields that differ from what the previous record predicts, in this order:
+constexpr uint8_t kTraceCycle = 0x01;    // uint64_t cycle, unless it is the previous one + 1
+constexpr uint8_t kTracePc = 0x02;       // uint16_t pc, unless it is the previous one + 2
+constexpr uint8_t kTraceOpcode = 0x04;   // uint16_t opcode, unless it is the previous one
+constexpr uint8_t kTraceI = 0x08;        // uint16_t i, unless it is the previous one
+constexpr uint8_t kTraceV = 0x10;        // uint16_t mask of the changed Vn, then their values
+// Most instructions take 3 to 6 bytes, so the CPU thread encodes them as it
+// goes and gzip only sees a small stream.
+constexpr char kTraceMagic[4] = {'C', '8', 'T', 'R'};
+constexpr uint32_t kTraceVersion = 2;
+
+// The CPU thread encodes records into fixed-size chunks of a buffer, and a
+// background thread compresses the filled chunks to a file. Chunks are
+// handed over single-producer single-consumer, one atomic store per chunk.
+class TraceWriter {
+ public:
+  TraceWriter();
+  ~TraceWriter();
+  bool Open(const std::string& path);
+  void Close();  // CPU thread, after the last Push
+
+  // Called by the CPU thread only. Waits if the writer falls every chunk behind.
+  void Push(const TraceRecord& record) {
+    uint8_t* p = write_ + 1;
+    uint8_t flags = 0;
+    if (record.cycle != prev_.cycle + 1) {
+      flags |= kTraceCycle;
+      p = Append(p, record.cycle);
+    }
+    if (record.pc != static_cast<uint16_t>(prev_.pc + 2)) {
+      flags |= kTracePc;
+      p = Append(p, record.pc);
+    }
+    if (record.opcode != prev_.opcode) {
+      flags |= kTraceOpcode;
+      p = Append(p, record.opcode);
+    }
+    if (record.i != prev_.i) {
+      flags |= kTraceI;
+      p = Append(p, record.i);
+    }
+    uint64_t v[2], prev_v[2];
+    std::memcpy(v, record.v.data(), sizeof(v));
+    std::memcpy(prev_v, prev_.v.data(), sizeof(prev_v));
+    const uint16_t mask = ChangedBytes(v[0] ^ prev_v[0]) | ChangedBytes(v[1] ^ prev_v[1]) << 8;
+    if (mask != 0) {
+      flags |= kTraceV;
+      p = Append(p, mask);
+      for (uint32_t m = mask; m != 0; m &= m - 1) *p++ = record.v[std::countr_zero(m)];
+    }
+    *write_ = flags;
+    write_ = p;
+    prev_ = record;
+    if (write_ >= chunk_limit_) NextChunk();
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 1 << 18;
+  static constexpr size_t kNumChunks = 16;
+  static constexpr size_t kMaxRecordSize = 1 + 8 + 3 * 2 + 2 + 16;
+
+  template <typename T>
+  static uint8_t* Append(uint8_t* p, T value) {
+    std::memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+  }
+  // Bit n is set if byte n of x is not zero
+  static uint16_t ChangedBytes(uint64_t x) {
+    constexpr uint64_t kLow7 = 0x7F7F7F7F7F7F7F7F;
+    const uint64_t high = (((x & kLow7) + kLow7) | x) & ~kLow7;
+    return static_cast<uint16_t>(((high >> 7) * 0x0102040810204080) >> 56);
+  }
+  void NextChunk();  // publishes the current chunk and waits until the next one is free
+  void Drain();
+
+  std::unique_ptr<uint8_t[]> buffer_;  // kNumChunks chunks, each with room for one more record
+  std::array<size_t, kNumChunks> sizes_;  // bytes used in each published chunk
+  uint8_t* write_;        // CPU thread: next byte of the current chunk
+  uint8_t* chunk_limit_;  // CPU thread: the chunk is published once write_ reaches it
+  TraceRecord prev_;      // CPU thread: the last record pushed
+  alignas(64) std::atomic<uint64_t> head_;  // chunks published by the CPU thread
+  uint64_t tail_cache_;                     // CPU thread's copy of tail_
+  alignas(64) std::atomic<uint64_t> tail_;  // chunks written out by the writer thread
+  std::atomic_bool is_open_;
+  std::thread thread_;
+  gzFile file_;
+};
+
+class TraceReader {
+ public:
+  TraceReader();
+  ~TraceReader();
+  bool Open(const std::string& path);
+  bool Next(TraceRecord& record);  // false at the end of the trace
+
+ private:
+  gzFile file_;
+  TraceRecord prev_;
+};
+
+} // namespace chip8_emu
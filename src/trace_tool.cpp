@@ -0,0 +1,127 @@
+#include <unistd.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "trace.hpp"
+
+namespace {
+
+constexpr char kUsage[] =
+  "Usage:\n"
+  "  trace_tool dump [-p lo-hi] [-o opcode/mask] [-c first-last] <trace>\n"
+  "  trace_tool diff <trace_a> <trace_b>\n";
+
+struct Filter {
+  uint16_t pc_lo = 0x0000, pc_hi = 0xFFFF;
+  uint16_t opcode = 0x0000, opcode_mask = 0x0000;
+  uint64_t cycle_first = 0, cycle_last = UINT64_MAX;
+
+  bool Match(const chip8_emu::TraceRecord& record) const {
+    return record.pc >= pc_lo && record.pc <= pc_hi &&
+           (record.opcode & opcode_mask) == opcode &&
+           record.cycle >= cycle_first && record.cycle <= cycle_last;
+  }
+};
+
+void PrintRecord(const chip8_emu::TraceRecord& record) {
+  printf("cycle=%llu, pc=0x%04X, inst=0x%04X, i=0x%04X",
+    static_cast<unsigned long long>(record.cycle), record.pc, record.opcode, record.i);
+  for (int n = 0; n < 16; ++n) {
+    if (record.changed & (1 << n)) printf(", v%X=0x%02X", n, record.v[n]);
+  }
+  printf("\n");
+}
+
+int Dump(int argc, char** argv) {
+  Filter filter;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:o:c:")) != -1) {
+    switch (opt) {
+      case 'p':
+        if (sscanf(optarg, "%hx-%hx", &filter.pc_lo, &filter.pc_hi) != 2) {
+          std::cerr << "Invalid pc range: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'o':
+        if (sscanf(optarg, "%hx/%hx", &filter.opcode, &filter.opcode_mask) != 2) {
+          std::cerr << "Invalid opcode filter: " << optarg << std::endl;
+          return 1;
+        }
+        filter.opcode &= filter.opcode_mask;
+        break;
+      case 'c': {
+        unsigned long long first, last;
+        if (sscanf(optarg, "%llu-%llu", &first, &last) != 2) {
+          std::cerr << "Invalid cycle range: " << optarg << std::endl;
+          return 1;
+        }
+        filter.cycle_first = first;
+        filter.cycle_last = last;
+        break;
+      }
+      default:
+        std::cerr << kUsage;
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    std::cerr << kUsage;
+    return 1;
+  }
+
+  chip8_emu::TraceReader reader;
+  if (!reader.Open(argv[optind])) return 1;
+  chip8_emu::TraceRecord record;
+  while (reader.Next(record)) {
+    if (record.cycle > filter.cycle_last) break;
+    if (filter.Match(record)) PrintRecord(record);
+  }
+  return 0;
+}
+
+int Diff(const std::string& path_a, const std::string& path_b) {
+  chip8_emu::TraceReader reader_a, reader_b;
+  if (!reader_a.Open(path_a) || !reader_b.Open(path_b)) return 1;
+
+  chip8_emu::TraceRecord a, b;
+  uint64_t count = 0;
+  while (true) {
+    const bool has_a = reader_a.Next(a);
+    const bool has_b = reader_b.Next(b);
+    if (!has_a && !has_b) break;
+    if (has_a != has_b) {
+      printf("%s ends after %llu records\n", has_a ? path_b.c_str() : path_a.c_str(),
+        static_cast<unsigned long long>(count));
+      return 1;
+    }
+    if (std::memcmp(&a, &b, sizeof(a)) != 0) {
+      printf("First divergence at record %llu\n", static_cast<unsigned long long>(count));
+      printf("< ");
+      PrintRecord(a);
+      printf("> ");
+      PrintRecord(b);
+      return 1;
+    }
+    ++count;
+  }
+  printf("Identical (%llu records)\n", static_cast<unsigned long long>(count));
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc >= 2 && std::strcmp(argv[1], "dump") == 0) {
+    return Dump(argc - 1, argv + 1);
+  }
+  if (argc == 4 && std::strcmp(argv[1], "diff") == 0) {
+    return Diff(argv[2], argv[3]);
+  }
+  std::cerr << kUsage;
+  return 1;
+}
@@ -0,0 +1,270 @@
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <optional>
+#include <string>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "upscaler.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+// The filters are written once against these operations on a run of
+// kLanes palette indices, where a lane mask is 0xFF for true and 0 for
+// false. SSE2 is part of x86-64, so it needs no runtime dispatch; a run is
+// a single pixel elsewhere. Display widths are multiples of 16.
+#if defined(__SSE2__)
+using Lanes = __m128i;
+constexpr int kLanes = 16;
+
+inline Lanes Load(const uint8_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline void Store(uint8_t* p, Lanes a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), a); }
+inline Lanes Eq(Lanes a, Lanes b) { return _mm_cmpeq_epi8(a, b); }
+inline Lanes And(Lanes a, Lanes b) { return _mm_and_si128(a, b); }
+inline Lanes AndNot(Lanes m, Lanes a) { return _mm_andnot_si128(m, a); }  // ~m & a
+inline Lanes Or(Lanes a, Lanes b) { return _mm_or_si128(a, b); }
+inline Lanes Pair(Lanes a, Lanes b) {
+  return Or(And(_mm_slli_epi16(a, 4), _mm_set1_epi8(static_cast<char>(0xF0))), b);
+}
+#else
+using Lanes = uint8_t;
+constexpr int kLanes = 1;
+
+inline Lanes Load(const uint8_t* p) { return *p; }
+inline void Store(uint8_t* p, Lanes a) { *p = a; }
+inline Lanes Eq(Lanes a, Lanes b) { return a == b ? 0xFF : 0; }
+inline Lanes And(Lanes a, Lanes b) { return a & b; }
+inline Lanes AndNot(Lanes m, Lanes a) { return ~m & a; }
+inline Lanes Or(Lanes a, Lanes b) { return a | b; }
+inline Lanes Pair(Lanes a, Lanes b) { return static_cast<uint8_t>(a << 4 | b); }
+#endif
+
+inline Lanes Select(Lanes m, Lanes a, Lanes b) { return Or(And(m, a), AndNot(m, b)); }
+inline Lanes Plain(Lanes a) { return Pair(a, a); }
+
+// Scales the run of pixels at e in an image with the given stride. Writes
+// factor x factor runs of index pairs to block, the run of output row r and
+// column c at (r * factor + c) * kLanes.
+template <UpscaleFilter kFilter>
+void ScaleRun(const uint8_t* e, int stride, uint8_t* block) {
+  //  A B C
+  //  D E F
+  //  G H I
+  const Lanes E = Load(e);
+  if constexpr (kFilter == UpscaleFilter::kScanlines) {
+    for (int k = 0; k < 9; ++k) Store(block + k * kLanes, Plain(E));
+    return;
+  }
+  const Lanes B = Load(e - stride), D = Load(e - 1), F = Load(e + 1), H = Load(e + stride);
+  const Lanes db = Eq(D, B), bf = Eq(B, F), dh = Eq(D, H), hf = Eq(H, F);
+  // Corners of E cut by two equal neighbors that the other two do not continue
+  Lanes c0 = AndNot(Or(bf, dh), db);
+  Lanes c2 = AndNot(Or(db, hf), bf);
+  Lanes c6 = AndNot(Or(db, hf), dh);
+  Lanes c8 = AndNot(Or(bf, dh), hf);
+
+  if constexpr (kFilter == UpscaleFilter::kScale2x) {
+    Store(block + 0 * kLanes, Plain(Select(c0, D, E)));
+    Store(block + 1 * kLanes, Plain(Select(c2, F, E)));
+    Store(block + 2 * kLanes, Plain(Select(c6, D, E)));
+    Store(block + 3 * kLanes, Plain(Select(c8, F, E)));
+    return;
+  }
+
+  const Lanes A = Load(e - stride - 1), C = Load(e - stride + 1);
+  const Lanes G = Load(e + stride - 1), I = Load(e + stride + 1);
+  const Lanes ea = Eq(E, A), ec = Eq(E, C), eg = Eq(E, G), ei = Eq(E, I);
+  if constexpr (kFilter == UpscaleFilter::kEdge) {
+    // Only where E carries on along the edge, so that the corners of
+    // rectangles stay square while staircases become diagonals
+    c0 = And(c0, Or(ec, eg));
+    c2 = And(c2, Or(ea, ei));
+    c6 = And(c6, Or(ea, ei));
+    c8 = And(c8, Or(ec, eg));
+  }
+  const Lanes e1 = Or(AndNot(ec, c0), AndNot(ea, c2));
+  const Lanes e3 = Or(AndNot(eg, c0), AndNot(ea, c6));
+  const Lanes e5 = Or(AndNot(ei, c2), AndNot(ec, c8));
+  const Lanes e7 = Or(AndNot(ei, c6), AndNot(eg, c8));
+  Store(block + 1 * kLanes, Plain(Select(e1, B, E)));
+  Store(block + 3 * kLanes, Plain(Select(e3, D, E)));
+  Store(block + 4 * kLanes, Plain(E));
+  Store(block + 5 * kLanes, Plain(Select(e5, F, E)));
+  Store(block + 7 * kLanes, Plain(Select(e7, H, E)));
+  if constexpr (kFilter == UpscaleFilter::kEdge) {
+    // Corners are blended half way instead of replaced
+    const Lanes plain = Plain(E);
+    Store(block + 0 * kLanes, Select(c0, Pair(D, E), plain));
+    Store(block + 2 * kLanes, Select(c2, Pair(F, E), plain));
+    Store(block + 6 * kLanes, Select(c6, Pair(D, E), plain));
+    Store(block + 8 * kLanes, Select(c8, Pair(F, E), plain));
+  } else {
+    Store(block + 0 * kLanes, Plain(Select(c0, D, E)));
+    Store(block + 2 * kLanes, Plain(Select(c2, F, E)));
+    Store(block + 6 * kLanes, Plain(Select(c6, D, E)));
+    Store(block + 8 * kLanes, Plain(Select(c8, F, E)));
+  }
+}
+
+// Calls sink(x, y) after each run of an image has been scaled into block
+template <UpscaleFilter kFilter, typename Sink>
+void ScaleImage(const uint8_t* image, int stride, int pad, int width, int height, uint8_t* block, Sink&& sink) {
+  for (int y = 0; y < height; ++y) {
+    const uint8_t* row = image + (y + 1) * stride + pad;
+    for (int x = 0; x < width; x += kLanes) {
+      ScaleRun<kFilter>(row + x, stride, block);
+      sink(x, y);
+    }
+  }
+}
+
+// Repeats the edge pixels of an image into its one pixel border
+void FillBorder(uint8_t* image, int stride, int pad, int width, int height) {
+  for (int y = 1; y <= height; ++y) {
+    uint8_t* row = image + y * stride + pad;
+    row[-1] = row[0];
+    row[width] = row[width - 1];
+  }
+  std::memcpy(image, image + stride, stride);
+  std::memcpy(image + (height + 1) * stride, image + height * stride, stride);
+}
+
+// Turns the index pairs of a scaled run into ARGB8888 pixels, at (x, y) in
+// the coordinates of the image before scaling
+template <int kFactor>
+void WriteRun(const uint8_t* block, const uint32_t* table, const uint32_t* last_row_table, uint32_t* pixels,
+              int row_pixels, int x, int y) {
+  for (int r = 0; r < kFactor; ++r) {
+    const uint32_t* row_table = r == kFactor - 1 ? last_row_table : table;
+    uint32_t* out = pixels + (y * kFactor + r) * row_pixels + x * kFactor;
+    for (int c = 0; c < kFactor; ++c) {
+      const uint8_t* pairs = block + (r * kFactor + c) * kLanes;
+      for (int i = 0; i < kLanes; ++i) out[i * kFactor + c] = row_table[pairs[i]];
+    }
+  }
+}
+
+uint32_t Mix(uint32_t a, uint32_t b, int num, int den) {
+  uint32_t mixed = 0xFF000000;
+  for (int shift = 0; shift < 24; shift += 8) {
+    const uint32_t ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+    mixed |= ((ca * num + cb * (den - num)) / den) << shift;
+  }
+  return mixed;
+}
+
+}  // namespace
+
+std::optional<UpscaleFilter> ParseUpscaleFilter(const std::string& name) {
+  if (name == "nearest") return UpscaleFilter::kNearest;
+  if (name == "scale2x") return UpscaleFilter::kScale2x;
+  if (name == "scale3x") return UpscaleFilter::kScale3x;
+  if (name == "scale4x") return UpscaleFilter::kScale4x;
+  if (name == "edge") return UpscaleFilter::kEdge;
+  if (name == "scanlines") return UpscaleFilter::kScanlines;
+  return std::nullopt;
+}
+
+int GetUpscaleFactor(UpscaleFilter filter) {
+  switch (filter) {
+    case UpscaleFilter::kNearest:
+      return 1;
+    case UpscaleFilter::kScale2x:
+      return 2;
+    case UpscaleFilter::kScale4x:
+      return 4;
+    default:
+      return 3;
+  }
+}
+
+Upscaler::Upscaler(UpscaleFilter filter)
+    : filter_{filter},
+      factor_{GetUpscaleFactor(filter)},
+      source_{},
+      scaled_{},
+      block_{},
+      table_palette_{},
+      has_tables_{false},
+      table_{},
+      dark_table_{} {
+}
+
+void Upscaler::UpdateTables(const ArgbPalette& palette) {
+  if (has_tables_ && palette == table_palette_) return;
+  table_palette_ = palette;
+  has_tables_ = true;
+  for (int a = 0; a < 16; ++a) {
+    for (int b = 0; b < 16; ++b) {
+      table_[a << 4 | b] = Mix(palette[a], palette[b], 1, 2);
+      dark_table_[a << 4 | b] = Mix(table_[a << 4 | b], 0xFF000000, 1, 2);
+    }
+  }
+}
+
+void Upscaler::LoadIndices(const FrameBuffer& frame_buffer) {
+  const int width = frame_buffer.GetWidth();
+  const int height = frame_buffer.GetHeight();
+  for (int y = 0; y < height; ++y) {
+    uint8_t* row = &source_[(y + 1) * kStride + kPad];
+    std::memset(row, 0, width);
+    for (int p = 0; p < kNumPlanes; ++p) {
+      const FrameBuffer::Row& bits = frame_buffer.GetRow(p, y);
+      for (int x = 0; x < width; ++x) row[x] |= ((bits[x >> 6] >> (63 - (x & 63))) & 1) << p;
+    }
+  }
+  FillBorder(source_.data(), kStride, kPad, width, height);
+}
+
+void Upscaler::Upscale(const FrameBuffer& frame_buffer, const ArgbPalette& palette, uint32_t* pixels, int pitch) {
+  UpdateTables(palette);
+  LoadIndices(frame_buffer);
+  const int width = frame_buffer.GetWidth();
+  const int height = frame_buffer.GetHeight();
+  const int row_pixels = pitch / static_cast<int>(sizeof(uint32_t));
+  uint8_t* block = block_.data();
+
+  const uint32_t* table = table_.data();
+  const uint32_t* last_row_table = filter_ == UpscaleFilter::kScanlines ? dark_table_.data() : table;
+  const auto to_pixels2 = [&](int x, int y) { WriteRun<2>(block, table, last_row_table, pixels, row_pixels, x, y); };
+  const auto to_pixels3 = [&](int x, int y) { WriteRun<3>(block, table, last_row_table, pixels, row_pixels, x, y); };
+
+  switch (filter_) {
+    case UpscaleFilter::kNearest:
+      break;
+    case UpscaleFilter::kScale2x:
+      ScaleImage<UpscaleFilter::kScale2x>(source_.data(), kStride, kPad, width, height, block, to_pixels2);
+      break;
+    case UpscaleFilter::kScale3x:
+      ScaleImage<UpscaleFilter::kScale3x>(source_.data(), kStride, kPad, width, height, block, to_pixels3);
+      break;
+    case UpscaleFilter::kEdge:
+      ScaleImage<UpscaleFilter::kEdge>(source_.data(), kStride, kPad, width, height, block, to_pixels3);
+      break;
+    case UpscaleFilter::kScanlines:
+      ScaleImage<UpscaleFilter::kScanlines>(source_.data(), kStride, kPad, width, height, block, to_pixels3);
+      break;
+    case UpscaleFilter::kScale4x: {
+      // Scale2x into scaled_ as plain indices, then Scale2x again
+      ScaleImage<UpscaleFilter::kScale2x>(source_.data(), kStride, kPad, width, height, block, [&](int x, int y) {
+        for (int r = 0; r < 2; ++r) {
+          uint8_t* out = &scaled_[(y * 2 + r + 1) * kStride + kPad + x * 2];
+          for (int i = 0; i < kLanes; ++i) {
+            for (int c = 0; c < 2; ++c) out[i * 2 + c] = block[(r * 2 + c) * kLanes + i] & 0xF;
+          }
+        }
+      });
+      FillBorder(scaled_.data(), kStride, kPad, width * 2, height * 2);
+      ScaleImage<UpscaleFilter::kScale2x>(scaled_.data(), kStride, kPad, width * 2, height * 2, block,
+                                          to_pixels2);
+      break;
+    }
+  }
+}
+
+} // namespace chip8_emu
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <string>
+
+#include "frame_buffer.hpp"
+
+namespace chip8_emu {
+
+// Filters for the window. kNearest is left to the renderer; the others run on
+// the CPU and fill a streaming texture.
+enum class UpscaleFilter {
+  kNearest,
+  kScale2x,    // EPX / AdvMAME2x
+  kScale3x,    // AdvMAME3x
+  kScale4x,    // Scale2x applied twice
+  kEdge,       // 3x, Scale3x rules only along diagonal edges, corners blended
+  kScanlines,  // 3x, every third row darkened
+};
+
+constexpr int kMaxUpscaleFactor = 4;
+
+// Accepts "nearest", "scale2x", "scale3x", "scale4x", "edge" or "scanlines"
+std::optional<UpscaleFilter> ParseUpscaleFilter(const std::string& name);
+int GetUpscaleFactor(UpscaleFilter filter);
+
+using ArgbPalette = std::array<uint32_t, 1 << kNumPlanes>;  // ARGB8888 per palette index
+
+// Works on the palette indices of the display, 16 pixels at a time with SSE2
+// where available. Every output pixel is a pair of indices, which a 256-entry
+// table turns into ARGB8888: plain pixels pair an index with itself, and
+// blended ones pair two. Holds all its buffers, so Upscale never allocates.
+class Upscaler {
+ public:
+  explicit Upscaler(UpscaleFilter filter);
+  UpscaleFilter GetFilter() const { return filter_; }
+  int GetFactor() const { return factor_; }
+  // Writes the display scaled by GetFactor to ARGB8888 pixels, pitch in bytes
+  void Upscale(const FrameBuffer& frame_buffer, const ArgbPalette& palette, uint32_t* pixels, int pitch);
+
+ private:
+  // Palette indices with a one pixel border repeating the edges, and slack
+  // so that 16-byte loads around the border stay in bounds
+  static constexpr int kPad = 16;
+  static constexpr int kStride = kHighResWidth * 2 + 2 * kPad;  // fits the Scale2x pass of Scale4x
+  static constexpr int kRows = kHighResHeight * 2 + 2;
+  using Image = std::array<uint8_t, kStride * kRows>;
+
+  void UpdateTables(const ArgbPalette& palette);
+  void LoadIndices(const FrameBuffer& frame_buffer);
+
+  UpscaleFilter filter_;
+  int factor_;
+  Image source_;
+  Image scaled_;  // Scale4x: output of the first Scale2x pass
+  std::array<uint8_t, kMaxUpscaleFactor * kMaxUpscaleFactor * 16> block_;  // pairs of a 16-pixel run
+  ArgbPalette table_palette_;  // palette the tables were made for
+  bool has_tables_;
+  std::array<uint32_t, 256> table_;       // ARGB8888 of each index pair
+  std::array<uint32_t, 256> dark_table_;  // kScanlines
+};
+
+} // namespace chip8_emu
@@ -7,8 +7,22 @@ namespace chip8_emu {
 
 Rand::Rand() : rd_{}, gen_{rd_()}, dis_{0, 255} {}
 
+void Rand::Seed(uint32_t seed) {
+  gen_.seed(seed);
+  dis_.reset();
+}
+
 uint8_t Rand::GetRandomByte() {
   return static_cast<uint8_t>(dis_(gen_));
 }
 
+const std::mt19937& Rand::GetGenerator() const {
+  return gen_;
+}
+
+void Rand::SetGenerator(const std::mt19937& gen) {
+  gen_ = gen;
+  dis_.reset();
+}
+
 } // namespace chip8_emu
@@ -8,7 +8,10 @@ namespace chip8_emu {
 class Rand {
  public:
   Rand();
+  void Seed(uint32_t seed);  // reproducible sequence for lockstep, fuzzing and regression runs
   uint8_t GetRandomByte();  // return [0, 255]
+  const std::mt19937& GetGenerator() const;  // for snapshots
+  void SetGenerator(const std::mt19937& gen);
 
  private:
   std::random_device rd_;
@@ -16,4 +19,16 @@ class Rand {
   std::uniform_int_distribution<> dis_;
 };
 
+// splitmix64 finalizer. Used to build order-independent state hashes by
+// XORing Mix64 of (position, value) pairs, which can be updated in O(1) when
+// a single value changes.
+constexpr uint64_t Mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ULL;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBULL;
+  x ^= x >> 31;
+  return x;
+}
+
 } // namespace chip8_emu
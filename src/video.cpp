@@ -0,0 +1,334 @@
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "video.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+constexpr int kGifMinCodeSize = 4;  // 16 colors
+constexpr int kGifClearCode = 1 << kGifMinCodeSize;
+constexpr int kGifMaxCode = 4095;
+constexpr int kGifMinDelay = 2;  // 1/100 s, shorter delays are slowed down by viewers
+
+void AppendVarint(std::vector<uint8_t>& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+void Append16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+// LSB-first bit packing into GIF sub-blocks of up to 255 bytes
+class GifBitWriter {
+ public:
+  explicit GifBitWriter(std::vector<uint8_t>& out) : out_{out}, bits_{0}, num_bits_{0}, block_start_{0} {
+    StartBlock();
+  }
+
+  void Write(uint32_t code, int size) {
+    bits_ |= code << num_bits_;
+    num_bits_ += size;
+    while (num_bits_ >= 8) {
+      WriteByte(bits_ & 0xFF);
+      bits_ >>= 8;
+      num_bits_ -= 8;
+    }
+  }
+
+  void Finish() {
+    if (num_bits_ > 0) WriteByte(bits_ & 0xFF);
+    if (out_.size() - block_start_ > 1) {
+      out_[block_start_] = out_.size() - block_start_ - 1;
+    } else {
+      out_.pop_back();  // empty block
+    }
+    out_.push_back(0);  // block terminator
+  }
+
+ private:
+  void StartBlock() {
+    block_start_ = out_.size();
+    out_.push_back(0);  // size, patched when the block is full
+  }
+
+  void WriteByte(uint8_t value) {
+    out_.push_back(value);
+    if (out_.size() - block_start_ - 1 == 255) {
+      out_[block_start_] = 255;
+      StartBlock();
+    }
+  }
+
+  std::vector<uint8_t>& out_;
+  uint32_t bits_;
+  int num_bits_;
+  size_t block_start_;
+};
+
+} // namespace
+
+VideoFormat GetVideoFormat(const std::string& path) {
+  if (path.ends_with(".y4m")) return VideoFormat::kY4m;
+  if (path.ends_with(".gif")) return VideoFormat::kGif;
+  return VideoFormat::kRaw;
+}
+
+VideoWriter::VideoWriter()
+    : format_{VideoFormat::kRaw},
+      palette_{},
+      ring_buffer_{std::make_unique<std::array<Image, kRingSize>>()},
+      ring_{ring_buffer_->data()},
+      head_{0},
+      tail_cache_{0},
+      frame_{0},
+      last_hash_{0},
+      dropped_{0},
+      tail_{0},
+      is_open_{false},
+      thread_{},
+      file_{nullptr},
+      path_{},
+      end_frame_{0},
+      written_frames_{0},
+      gif_time_{0},
+      out_{} {
+}
+
+VideoWriter::~VideoWriter() {
+  Close();
+}
+
+bool VideoWriter::Open(const std::string& path, const std::array<Color, 1 << kNumPlanes>& palette) {
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) {
+    std::cerr << "Failed to open video file: " << path << std::endl;
+    return false;
+  }
+  format_ = GetVideoFormat(path);
+  palette_ = palette;
+  path_ = path;
+
+  out_.clear();
+  switch (format_) {
+    case VideoFormat::kRaw:
+      out_.insert(out_.end(), kVideoMagic, kVideoMagic + sizeof(kVideoMagic));
+      out_.insert(out_.end(), reinterpret_cast<const uint8_t*>(&kVideoVersion),
+        reinterpret_cast<const uint8_t*>(&kVideoVersion) + sizeof(kVideoVersion));
+      Append16(out_, kHighResWidth);
+      Append16(out_, kHighResHeight);
+      Append16(out_, kVideoFrameRate);
+      break;
+    case VideoFormat::kY4m: {
+      const std::string header = "YUV4MPEG2 W" + std::to_string(kHighResWidth) + " H" +
+        std::to_string(kHighResHeight) + " F" + std::to_string(kVideoFrameRate) + ":1 Ip A1:1 C420jpeg\n";
+      out_.insert(out_.end(), header.begin(), header.end());
+      break;
+    }
+    case VideoFormat::kGif: {
+      const std::string header = "GIF89a";
+      out_.insert(out_.end(), header.begin(), header.end());
+      Append16(out_, kHighResWidth);
+      Append16(out_, kHighResHeight);
+      out_.push_back(0x80 | (kGifMinCodeSize - 1));  // global color table of 16 colors
+      out_.push_back(0);  // background color
+      out_.push_back(0);  // aspect ratio
+      for (const Color& color : palette_) {
+        out_.push_back(color.r);
+        out_.push_back(color.g);
+        out_.push_back(color.b);
+      }
+      const std::string loop = "\x21\xFF\x0BNETSCAPE2.0\x03\x01";  // loop forever
+      out_.insert(out_.end(), loop.begin(), loop.end());
+      Append16(out_, 0);
+      out_.push_back(0);
+      break;
+    }
+  }
+  std::fwrite(out_.data(), 1, out_.size(), file_);
+
+  is_open_ = true;
+  thread_ = std::thread([this] { Drain(); });
+  return true;
+}
+
+void VideoWriter::Drain() {
+  Pixels pixels, next;
+  uint64_t pixels_frame = 0;
+  bool has_pixels = false;
+
+  while (true) {
+    // Read is_open_ before head_, so that the last batch is not missed on Close.
+    const bool is_open = is_open_;
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head) {
+      if (!is_open) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    for (; tail != head; ++tail) {
+      const Image& image = ring_[tail & (kRingSize - 1)];
+      ToPixels(image, next);
+      // An image is written once the next one tells how long it was shown
+      if (has_pixels) WriteImage(pixels, image.frame - pixels_frame);
+      pixels.swap(next);
+      pixels_frame = image.frame;
+      has_pixels = true;
+      tail_.store(tail + 1, std::memory_order_release);
+    }
+  }
+  if (has_pixels) WriteImage(pixels, std::max<uint64_t>(end_frame_ - pixels_frame, 1));
+  if (format_ == VideoFormat::kGif) std::fputc(0x3B, file_);  // trailer
+}
+
+void VideoWriter::ToPixels(const Image& image, Pixels& pixels) {
+  pixels.fill(0);
+  const int scale = image.high_resolution ? 1 : 2;
+  const int width = kHighResWidth / scale;
+  const int height = kHighResHeight / scale;
+  for (int p = 0; p < kNumPlanes; ++p) {
+    for (int y = 0; y < height; ++y) {
+      const FrameBuffer::Row& row = image.planes[p][y];
+      if ((row[0] | row[1]) == 0) continue;
+      for (int x = 0; x < width; ++x) {
+        if (!((row[x >> 6] >> (63 - (x & 63))) & 1)) continue;
+        for (int dy = 0; dy < scale; ++dy) {
+          for (int dx = 0; dx < scale; ++dx) {
+            pixels[(y * scale + dy) * kHighResWidth + x * scale + dx] |= 1 << p;
+          }
+        }
+      }
+    }
+  }
+}
+
+void VideoWriter::WriteImage(const Pixels& pixels, uint64_t frames) {
+  written_frames_ += frames;
+  out_.clear();
+  switch (format_) {
+    case VideoFormat::kRaw:
+      AppendVarint(out_, frames);
+      for (size_t k = 0; k < pixels.size();) {
+        size_t end = k + 1;
+        while (end < pixels.size() && pixels[end] == pixels[k]) ++end;
+        AppendVarint(out_, end - k);
+        out_.push_back(pixels[k]);
+        k = end;
+      }
+      break;
+    case VideoFormat::kY4m: {
+      const std::string frame_header = "FRAME\n";
+      out_.insert(out_.end(), frame_header.begin(), frame_header.end());
+      for (uint8_t index : pixels) {
+        const Color& c = palette_[index];
+        out_.push_back((77 * c.r + 150 * c.g + 29 * c.b + 128) >> 8);
+      }
+      // Chroma of each 2x2 block, from the average color
+      std::vector<uint8_t> u, v;
+      for (int y = 0; y < kHighResHeight; y += 2) {
+        for (int x = 0; x < kHighResWidth; x += 2) {
+          int r = 0, g = 0, b = 0;
+          for (int k = 0; k < 4; ++k) {
+            const Color& c = palette_[pixels[(y + k / 2) * kHighResWidth + x + k % 2]];
+            r += c.r;
+            g += c.g;
+            b += c.b;
+          }
+          u.push_back(std::clamp((-43 * r - 85 * g + 128 * b + 4 * 128 * 256 + 512) / 1024, 0, 255));
+          v.push_back(std::clamp((128 * r - 107 * g - 21 * b + 4 * 128 * 256 + 512) / 1024, 0, 255));
+        }
+      }
+      out_.insert(out_.end(), u.begin(), u.end());
+      out_.insert(out_.end(), v.begin(), v.end());
+      // Y4M has no frame durations, so the frame is repeated, one write at a
+      // time as a long still image would not fit in memory
+      for (uint64_t k = 1; k < frames; ++k) std::fwrite(out_.data(), 1, out_.size(), file_);
+      if (frames == 0) out_.clear();
+      break;
+    }
+    case VideoFormat::kGif:
+      WriteGifImage(pixels);
+      break;
+  }
+  std::fwrite(out_.data(), 1, out_.size(), file_);
+}
+
+void VideoWriter::WriteGifImage(const Pixels& pixels) {
+  // Images shown for less than the minimum delay are skipped, and the
+  // next image takes over their time.
+  const uint64_t delay = written_frames_ * 100 / kVideoFrameRate - gif_time_;
+  if (delay < kGifMinDelay) return;
+  gif_time_ += std::min<uint64_t>(delay, 0xFFFF);
+
+  out_.insert(out_.end(), {0x21, 0xF9, 0x04, 0x00});  // graphic control extension
+  Append16(out_, std::min<uint64_t>(delay, 0xFFFF));
+  out_.insert(out_.end(), {0x00, 0x00});
+
+  out_.push_back(0x2C);  // image descriptor
+  Append16(out_, 0);
+  Append16(out_, 0);
+  Append16(out_, kHighResWidth);
+  Append16(out_, kHighResHeight);
+  out_.push_back(0);  // no local color table
+  out_.push_back(kGifMinCodeSize);
+  WriteGifCodes(pixels);
+}
+
+void VideoWriter::WriteGifCodes(const Pixels& pixels) {
+  // LZW with a code tree over the 16-color alphabet
+  std::vector<std::array<uint16_t, 1 << kGifMinCodeSize>> tree(kGifMaxCode + 1);
+  GifBitWriter writer{out_};
+  int code_size = kGifMinCodeSize + 1;
+  int max_code = kGifClearCode + 1;
+  writer.Write(kGifClearCode, code_size);
+
+  int code = -1;
+  for (uint8_t index : pixels) {
+    if (code < 0) {
+      code = index;
+    } else if (tree[code][index] != 0) {
+      code = tree[code][index];
+    } else {
+      writer.Write(code, code_size);
+      tree[code][index] = ++max_code;
+      if (max_code >= (1 << code_size)) ++code_size;
+      if (max_code == kGifMaxCode) {
+        writer.Write(kGifClearCode, code_size);
+        for (auto& next : tree) next.fill(0);
+        code_size = kGifMinCodeSize + 1;
+        max_code = kGifClearCode + 1;
+      }
+      code = index;
+    }
+  }
+  writer.Write(code, code_size);
+  writer.Write(kGifClearCode, code_size);
+  writer.Write(kGifClearCode + 1, kGifMinCodeSize + 1);  // end of information
+  writer.Finish();
+}
+
+void VideoWriter::Close() {
+  if (!file_) return;
+  end_frame_ = frame_;
+  is_open_ = false;
+  thread_.join();
+  std::fclose(file_);
+  file_ = nullptr;
+  printf("Recorded %llu frames to %s (%llu dropped)\n", static_cast<unsigned long long>(written_frames_),
+    path_.c_str(), static_cast<unsigned long long>(dropped_));
+}
+
+} // namespace chip8_emu
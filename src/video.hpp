@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame_buffer.hpp"
+#include "graphic.hpp"
+
+namespace chip8_emu {
+
+constexpr int kVideoFrameRate = 60;  // one image per emulated frame
+
+// Videos are always 128x64; low resolution pixels are doubled.
+//
+// kRaw files start with kVideoMagic, kVideoVersion and the width, height and
+// frame rate as 16-bit little-endian values. Each image follows as a varint
+// number of frames it is shown, then the 128x64 palette indices as runs of a
+// varint length and an index byte.
+enum class VideoFormat {
+  kRaw,
+  kY4m,  // 4:2:0, full range BT.601
+  kGif,  // animated, identical frames merged into longer delays
+};
+
+constexpr char kVideoMagic[4] = {'C', '8', 'V', 'D'};
+constexpr uint32_t kVideoVersion = 1;
+
+VideoFormat GetVideoFormat(const std::string& path);  // by extension, kRaw by default
+
+// Takes frames from the CPU thread through a single-producer single-consumer
+// ring, which a background thread encodes to a file. Unchanged frames are
+// not queued, and frames are dropped instead of waiting if the writer falls
+// a full ring behind.
+class VideoWriter {
+ public:
+  VideoWriter();
+  ~VideoWriter();
+  bool Open(const std::string& path, const std::array<Color, 1 << kNumPlanes>& palette);
+  void Close();
+
+  // Called by the CPU thread once per emulated frame. Never blocks.
+  void Push(const FrameBuffer& frame_buffer) {
+    const uint64_t frame = frame_++;
+    const uint64_t hash = frame_buffer.GetHash();
+    if (frame > 0 && hash == last_hash_) return;
+
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ >= kRingSize) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ >= kRingSize) {
+        ++dropped_;
+        return;
+      }
+    }
+    Image& image = ring_[head & (kRingSize - 1)];
+    image.frame = frame;
+    image.high_resolution = frame_buffer.IsHighResolution();
+    for (int p = 0; p < kNumPlanes; ++p) {
+      for (int y = 0; y < kHighResHeight; ++y) image.planes[p][y] = frame_buffer.GetRow(p, y);
+    }
+    head_.store(head + 1, std::memory_order_release);
+    last_hash_ = hash;
+  }
+
+ private:
+  static constexpr uint64_t kRingSize = 1 << 8;
+
+  struct Image {
+    uint64_t frame;  // first frame it is shown
+    bool high_resolution;
+    std::array<FrameBuffer::Plane, kNumPlanes> planes;
+  };
+  using Pixels = std::array<uint8_t, kHighResWidth * kHighResHeight>;  // palette indices
+
+  void Drain();
+  static void ToPixels(const Image& image, Pixels& pixels);
+  void WriteImage(const Pixels& pixels, uint64_t frames);  // shown for frames
+  void WriteGifImage(const Pixels& pixels);
+  void WriteGifCodes(const Pixels& pixels);
+
+  VideoFormat format_;
+  std::array<Color, 1 << kNumPlanes> palette_;
+  std::unique_ptr<std::array<Image, kRingSize>> ring_buffer_;
+  Image* ring_;
+  alignas(64) std::atomic<uint64_t> head_;  // written by the CPU thread
+  uint64_t tail_cache_;                     // CPU thread's copy of tail_
+  uint64_t frame_;                          // CPU thread
+  uint64_t last_hash_;                      // CPU thread
+  uint64_t dropped_;                        // CPU thread
+  alignas(64) std::atomic<uint64_t> tail_;  // written by the writer thread
+  std::atomic_bool is_open_;
+  std::thread thread_;
+  FILE* file_;
+  std::string path_;
+  std::atomic<uint64_t> end_frame_;  // set by Close
+  uint64_t written_frames_;  // writer thread
+  uint64_t gif_time_;        // writer thread, sum of the GIF delays in 1/100 s
+  std::vector<uint8_t> out_;  // writer thread
+};
+
+} // namespace chip8_emu
@@ -0,0 +1,321 @@
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+#include "viewer.hpp"
+#include "chip8.hpp"
+#include "graphic.hpp"
+#include "quirks.hpp"
+#include "rom_database.hpp"
+
+namespace chip8_emu {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Tiles are 128x64; low resolution displays are doubled
+constexpr int kTileWidth = kHighResWidth;
+constexpr int kTileHeight = kHighResHeight;
+constexpr int kTileGap = 2;
+constexpr uint32_t kGapColor = 0xFF303030;
+constexpr int kMaxWindowWidth = 1600;
+constexpr int kMaxWindowHeight = 900;
+constexpr int kMaxFramesBehind = 4;  // a worker further behind its deadline drops the backlog
+
+// Latest display of one instance, written by its worker under a seqlock:
+// sequence is odd while the worker writes, and the window thread copies the
+// rest and discards the copy if sequence was odd or has changed since.
+struct alignas(64) FrameSlot {
+  std::atomic<uint64_t> sequence{0};
+  bool running;
+  bool high_resolution;
+  std::array<FrameBuffer::Plane, kNumPlanes> planes;
+};
+
+struct Tile {
+  bool running;
+  bool high_resolution;
+  std::array<FrameBuffer::Plane, kNumPlanes> planes;
+};
+
+class Viewer {
+ public:
+  Viewer(const std::vector<uint8_t>& rom, const Quirks& quirks, const ViewerOptions& options);
+  bool Run();
+
+ private:
+  void RunWorker(int job);
+  void Publish(FrameSlot& slot, const Chip8& chip8);
+  bool Sample(const FrameSlot& slot, uint64_t& shown_sequence);
+  void DrawTile(int index);
+  bool InitializeWindow();
+  void CloseWindow();
+
+  const std::vector<uint8_t>& rom_;
+  const Quirks quirks_;
+  const ViewerOptions& options_;
+  const int columns_;
+  const int rows_;
+  const int canvas_width_;
+  const int canvas_height_;
+  std::unique_ptr<FrameSlot[]> slots_;
+  std::atomic<bool> stop_;
+
+  // Window thread only
+  Tile tile_;  // sampled from a slot
+  std::array<uint32_t, 1 << kNumPlanes> palette_;
+  std::array<uint32_t, 1 << kNumPlanes> dim_palette_;  // stopped instances
+  std::vector<uint32_t> canvas_;
+  SDL_Window* window_;
+  SDL_Renderer* renderer_;
+  SDL_Texture* texture_;
+};
+
+Viewer::Viewer(const std::vector<uint8_t>& rom, const Quirks& quirks, const ViewerOptions& options)
+    : rom_{rom},
+      quirks_{quirks},
+      options_{options},
+      columns_{static_cast<int>(std::ceil(std::sqrt(options.instances * 2.0)))},  // tiles are 2:1
+      rows_{(options.instances + columns_ - 1) / columns_},
+      canvas_width_{columns_ * (kTileWidth + kTileGap) - kTileGap},
+      canvas_height_{rows_ * (kTileHeight + kTileGap) - kTileGap},
+      slots_{std::make_unique<FrameSlot[]>(options.instances)},
+      stop_{false},
+      tile_{},
+      palette_{},
+      dim_palette_{},
+      canvas_(static_cast<size_t>(canvas_width_) * canvas_height_, kGapColor),
+      window_{nullptr},
+      renderer_{nullptr},
+      texture_{nullptr} {
+  const Graphic graphic;
+  for (size_t k = 0; k < palette_.size(); ++k) {
+    const Color& color = graphic.GetPalette()[k];
+    palette_[k] = 0xFF000000 | color.r << 16 | color.g << 8 | color.b;
+    dim_palette_[k] = 0xFF000000 | (color.r / 3) << 16 | (color.g / 3) << 8 | (color.b / 3);
+  }
+}
+
+void Viewer::Publish(FrameSlot& slot, const Chip8& chip8) {
+  const uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);  // odd before any data
+  const FrameBuffer& frame_buffer = chip8.GetFrameBuffer();
+  slot.running = chip8.IsRunning();
+  slot.high_resolution = frame_buffer.IsHighResolution();
+  for (int p = 0; p < kNumPlanes; ++p) {
+    for (int y = 0; y < kHighResHeight; ++y) slot.planes[p][y] = frame_buffer.GetRow(p, y);
+  }
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool Viewer::Sample(const FrameSlot& slot, uint64_t& shown_sequence) {
+  const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+  if (sequence == shown_sequence || (sequence & 1) != 0) return false;
+  tile_.running = slot.running;
+  tile_.high_resolution = slot.high_resolution;
+  tile_.planes = slot.planes;
+  std::atomic_thread_fence(std::memory_order_acquire);  // data before the second check
+  if (slot.sequence.load(std::memory_order_relaxed) != sequence) return false;
+  shown_sequence = sequence;
+  return true;
+}
+
+void Viewer::RunWorker(int job) {
+  // Instances job, job + jobs, ...
+  std::vector<std::unique_ptr<Chip8>> machines;
+  std::vector<int> indices;
+  for (int k = job; k < options_.instances; k += options_.jobs) {
+    auto chip8 = std::make_unique<Chip8>(options_.cycles);
+    chip8->SetQuirks(quirks_);
+    chip8->SetSeed(options_.seed + k);
+    chip8->LoadProgram(rom_);
+    Publish(slots_[k], *chip8);
+    machines.push_back(std::move(chip8));
+    indices.push_back(k);
+  }
+  std::vector<uint64_t> hashes(machines.size());
+  for (size_t m = 0; m < machines.size(); ++m) hashes[m] = machines[m]->GetFrameBuffer().GetHash();
+
+  const auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<int, std::ratio<1, kFrameRate>>(1));
+  auto deadline = Clock::now();
+  size_t next_key_event = 0;
+  for (uint64_t frame = 0; !stop_.load(std::memory_order_relaxed); ++frame) {
+    const size_t first_key_event = next_key_event;
+    while (next_key_event < options_.input_log.size() && options_.input_log[next_key_event].frame <= frame) {
+      ++next_key_event;
+    }
+    for (size_t m = 0; m < machines.size(); ++m) {
+      Chip8& chip8 = *machines[m];
+      if (!chip8.IsRunning()) continue;
+      for (size_t e = first_key_event; e < next_key_event; ++e) {
+        chip8.SetKey(options_.input_log[e].key, options_.input_log[e].pressed);
+      }
+      const uint64_t budget = chip8.BeginFrame(frame);
+      for (uint64_t n = 0; n < budget && chip8.IsRunning(); ++n) chip8.Step();
+
+      const uint64_t hash = chip8.GetFrameBuffer().GetHash();
+      if (hash != hashes[m] || !chip8.IsRunning()) {
+        hashes[m] = hash;
+        Publish(slots_[indices[m]], chip8);
+      }
+    }
+
+    deadline += interval;
+    const auto now = Clock::now();
+    if (now < deadline) {
+      std::this_thread::sleep_until(deadline);
+    } else if (now - deadline > kMaxFramesBehind * interval) {
+      deadline = now;
+    }
+  }
+}
+
+void Viewer::DrawTile(int index) {
+  const int left = index % columns_ * (kTileWidth + kTileGap);
+  const int top = index / columns_ * (kTileHeight + kTileGap);
+  const auto& palette = tile_.running ? palette_ : dim_palette_;
+  const int shift = tile_.high_resolution ? 0 : 1;  // display pixels per tile pixel, as a shift
+  for (int y = 0; y < kTileHeight; ++y) {
+    uint32_t* out = &canvas_[static_cast<size_t>(top + y) * canvas_width_ + left];
+    const int display_y = y >> shift;
+    for (int x = 0; x < kTileWidth; ++x) {
+      const int display_x = x >> shift;
+      uint8_t color = 0;
+      for (int p = 0; p < kNumPlanes; ++p) {
+        color |= ((tile_.planes[p][display_y][display_x >> 6] >> (63 - (display_x & 63))) & 1) << p;
+      }
+      out[x] = palette[color];
+    }
+  }
+  const SDL_Rect rect{left, top, kTileWidth, kTileHeight};
+  SDL_UpdateTexture(texture_, &rect, &canvas_[static_cast<size_t>(top) * canvas_width_ + left],
+                    canvas_width_ * static_cast<int>(sizeof(uint32_t)));
+}
+
+bool Viewer::InitializeWindow() {
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    fprintf(stderr, "Failed to initialize SDL graphic: %s\n", SDL_GetError());
+    return false;
+  }
+  // Integer scale when the tiles fit, shrunk to the largest window otherwise
+  const double fit = std::min(static_cast<double>(kMaxWindowWidth) / canvas_width_,
+                              static_cast<double>(kMaxWindowHeight) / canvas_height_);
+  const double scale = fit >= 1 ? std::floor(fit) : fit;
+  if (SDL_CreateWindowAndRenderer(std::max(1, static_cast<int>(canvas_width_ * scale)),
+                                  std::max(1, static_cast<int>(canvas_height_ * scale)), 0, &window_, &renderer_) == 0) {
+    texture_ = SDL_CreateTexture(renderer_, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                 canvas_width_, canvas_height_);
+  }
+  if (texture_ == nullptr) {
+    fprintf(stderr, "Failed to create SDL window, renderer or texture: %s\n", SDL_GetError());
+    CloseWindow();
+    return false;
+  }
+  SDL_RenderSetLogicalSize(renderer_, canvas_width_, canvas_height_);
+  SDL_UpdateTexture(texture_, nullptr, canvas_.data(), canvas_width_ * static_cast<int>(sizeof(uint32_t)));
+  return true;
+}
+
+void Viewer::CloseWindow() {
+  if (texture_ != nullptr) SDL_DestroyTexture(texture_);
+  if (renderer_ != nullptr) SDL_DestroyRenderer(renderer_);
+  if (window_ != nullptr) SDL_DestroyWindow(window_);
+  SDL_Quit();
+}
+
+bool Viewer::Run() {
+  if (!InitializeWindow()) return false;
+  printf("Viewer: %d instances in %dx%d tiles on %d jobs\n", options_.instances, columns_, rows_, options_.jobs);
+
+  std::vector<std::thread> workers;
+  for (int j = 0; j < options_.jobs; ++j) workers.emplace_back([this, j] { RunWorker(j); });
+
+  const auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<int, std::ratio<1, kFrameRate>>(1));
+  std::vector<uint64_t> shown_sequences(options_.instances, 0);
+  std::vector<bool> running(options_.instances, true);
+  int num_running = -1;  // sets the title on the first refresh
+  auto deadline = Clock::now();
+  bool quit = false;
+  while (!quit) {
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
+        quit = true;
+      }
+    }
+
+    int changed = 0;
+    for (int k = 0; k < options_.instances; ++k) {
+      if (!Sample(slots_[k], shown_sequences[k])) continue;
+      running[k] = tile_.running;
+      DrawTile(k);
+      ++changed;
+    }
+    const int now_running = static_cast<int>(std::count(running.begin(), running.end(), true));
+    if (now_running != num_running) {
+      num_running = now_running;
+      const std::string title =
+          "CHIP-8 Viewer: " + std::to_string(num_running) + " of " + std::to_string(options_.instances) + " running";
+      SDL_SetWindowTitle(window_, title.c_str());
+    }
+    if (changed > 0) {
+      SDL_RenderClear(renderer_);
+      SDL_RenderCopy(renderer_, texture_, nullptr, nullptr);
+      SDL_RenderPresent(renderer_);
+    }
+
+    deadline += interval;
+    const auto now = Clock::now();
+    if (now < deadline) {
+      std::this_thread::sleep_until(deadline);
+    } else {
+      deadline = now;
+    }
+  }
+
+  stop_ = true;
+  for (auto& worker : workers) worker.join();
+  CloseWindow();
+  printf("Viewer: closed with %d of %d instances running\n", num_running, options_.instances);
+  return true;
+}
+
+}  // namespace
+
+bool RunViewer(const std::string& rom, const ViewerOptions& options) {
+  std::ifstream ifs{rom, std::ios::binary};
+  if (!ifs.is_open()) {
+    fprintf(stderr, "Failed to open ROM: %s\n", rom.c_str());
+    return false;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+  if (0x200 + data.size() > kMemorySize) {
+    fprintf(stderr, "ROM size is too large\n");
+    return false;
+  }
+  const Quirks quirks = options.quirks.value_or(LookUpQuirks(Sha1(data)).value_or(kChip8Quirks));
+
+  // More jobs than instances would leave threads without work
+  ViewerOptions viewer_options = options;
+  viewer_options.jobs = std::min(options.jobs, options.instances);
+  auto viewer = std::make_unique<Viewer>(data, quirks, viewer_options);
+  return viewer->Run();
+}
+
+} // namespace chip8_emu
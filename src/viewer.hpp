@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <optional>
+#include <vector>
+
+#include "quirks.hpp"
+#include "input_log.hpp"
+
+namespace chip8_emu {
+
+struct ViewerOptions {
+  int instances;
+  int jobs;
+  int cycles;
+  uint32_t seed;  // instance k runs with seed + k
+  std::optional<Quirks> quirks;  // ROM database quirks if empty
+  std::vector<KeyEvent> input_log;  // replayed on every instance
+};
+
+// Tiled viewer. Runs instances copies of a ROM headless on jobs worker
+// threads, paced at kFrameRate, and shows all of their displays in one
+// window. Each worker publishes a changed display into a per-instance slot
+// under a seqlock and never waits. The window thread samples the slots once
+// per refresh and redraws only the tiles whose slot changed; a slot caught
+// mid-write keeps its old tile until the next refresh. Stopped instances are
+// dimmed. Returns false if the ROM cannot be loaded.
+bool RunViewer(const std::string& rom, const ViewerOptions& options);
+
+} // namespace chip8_emu